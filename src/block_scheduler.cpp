@@ -0,0 +1,169 @@
+/** This file is part of the RHybrid simulation.
+ *
+ *  Copyright 2018- Aalto University
+ *  Copyright 2015- Finnish Meteorological Institute
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <functional>
+
+#include "block_scheduler.h"
+
+using namespace std;
+
+BlockScheduler::BlockScheduler() {
+   N_queues = 0;
+   queues = NULL;
+   busyID = -1;
+   waitID = -1;
+   setName("scheduled blocks");
+}
+
+BlockScheduler::~BlockScheduler() {
+   deallocate();
+}
+
+void BlockScheduler::allocate(int N_threads) {
+   deallocate();
+   N_queues = N_threads;
+   queues = new Queue[N_queues];
+   #ifdef _OPENMP
+      for(int q=0;q<N_queues;++q) { omp_init_lock(&(queues[q].lock)); }
+   #endif
+}
+
+void BlockScheduler::deallocate() {
+   #ifdef _OPENMP
+      for(int q=0;q<N_queues;++q) { omp_destroy_lock(&(queues[q].lock)); }
+   #endif
+   delete [] queues; queues = NULL;
+   N_queues = 0;
+}
+
+/** Get the next block to process. The thread's own queue is tried first, after it has
+ * been exhausted the largest remaining block of any other queue is stolen.
+ * @param thread Number of the calling thread.
+ * @param index Index of the block to process in the array given to schedule().
+ * @return If false, all blocks have been processed.*/
+bool BlockScheduler::next(int thread,size_t& index) {
+   if(pop(queues[thread],index) == true) { return true; }
+
+   while(true) {
+      // Find the queue whose next block is the heaviest:
+      int victim = -1;
+      unsigned int maxWeight = 0;
+      for(int q=0;q<N_queues;++q) {
+	 if(q == thread) { continue; }
+	 Queue& queue = queues[q];
+	 #ifdef _OPENMP
+	    omp_set_lock(&(queue.lock));
+	 #endif
+	 if(queue.head < queue.blocks.size() && (victim < 0 || queue.weights[queue.head] > maxWeight)) {
+	    victim = q;
+	    maxWeight = queue.weights[queue.head];
+	 }
+	 #ifdef _OPENMP
+	    omp_unset_lock(&(queue.lock));
+	 #endif
+      }
+      if(victim < 0) { return false; }
+
+      // Victim's queue may have been emptied in between, in which case search again:
+      if(pop(queues[victim],index) == true) { return true; }
+   }
+}
+
+bool BlockScheduler::pop(Queue& queue,size_t& index) {
+   bool success = false;
+   #ifdef _OPENMP
+      omp_set_lock(&(queue.lock));
+   #endif
+   if(queue.head < queue.blocks.size()) {
+      index = queue.blocks[queue.head];
+      ++queue.head;
+      success = true;
+   }
+   #ifdef _OPENMP
+      omp_unset_lock(&(queue.lock));
+   #endif
+   return success;
+}
+
+/** Deal the given blocks to thread queues. Must be called outside parallel regions.
+ * @param blocks Local IDs of the blocks to process.
+ * @param N_particles Number of particles in each local block, used as block weights.*/
+void BlockScheduler::schedule(const std::vector<pargrid::CellID>& blocks,const unsigned int* N_particles) {
+   const int N_threads = getMaxThreads();
+   if(N_threads != N_queues) { allocate(N_threads); }
+
+   // Empty blocks still have a small cost:
+   sorted.resize(blocks.size());
+   for(size_t b=0; b<blocks.size(); ++b) {
+      sorted[b] = make_pair(N_particles[blocks[b]]+1,b);
+   }
+   sort(sorted.begin(),sorted.end(),greater<pair<unsigned int,size_t> >());
+
+   for(int q=0;q<N_queues;++q) {
+      queues[q].blocks.clear();
+      queues[q].weights.clear();
+      queues[q].head = 0;
+      queues[q].totalWeight = 0;
+   }
+
+   // Each block goes to the queue with the least total weight so far:
+   for(size_t b=0; b<sorted.size(); ++b) {
+      int target = 0;
+      for(int q=1;q<N_queues;++q) {
+	 if(queues[q].totalWeight < queues[target].totalWeight) { target = q; }
+      }
+      queues[target].blocks.push_back(sorted[b].second);
+      queues[target].weights.push_back(sorted[b].first);
+      queues[target].totalWeight += sorted[b].first;
+   }
+}
+
+/** Set the name of the scheduled stage used in profile region names.
+ * @param name Name of the stage.*/
+void BlockScheduler::setName(const std::string& name) {
+   busyName = name + " busy";
+   waitName = name + " wait";
+   busyID = -1;
+   waitID = -1;
+}
+
+/** Called by each thread in the parallel region before its first call to next().
+ * @param thread Number of the calling thread.*/
+void BlockScheduler::startThread(int thread) {
+   #if PROFILE_LEVEL > 0
+      if(thread == 0) { profile::start(busyName,busyID); }
+   #endif
+}
+
+/** Called by each thread in the parallel region after next() has returned false. All
+ * threads of the region must call this, as threads are synchronised here when profiling.
+ * @param thread Number of the calling thread.*/
+void BlockScheduler::stopThread(int thread) {
+   #if PROFILE_LEVEL > 0
+      if(thread == 0) {
+	 profile::stop();
+	 profile::start(waitName,waitID);
+      }
+      #ifdef _OPENMP
+         #pragma omp barrier
+      #endif
+      if(thread == 0) { profile::stop(); }
+   #endif
+}
@@ -0,0 +1,114 @@
+/** This file is part of the RHybrid simulation.
+ *
+ *  Copyright 2018- Aalto University
+ *  Copyright 2015- Finnish Meteorological Institute
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BLOCK_SCHEDULER_H
+#define BLOCK_SCHEDULER_H
+
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <mpi.h>
+#include <simulationclasses.h>
+
+/** Number of the calling OpenMP thread, zero without OpenMP.*/
+inline int getThreadNumber() {
+#ifdef _OPENMP
+   return omp_get_thread_num();
+#else
+   return 0;
+#endif
+}
+
+/** Number of OpenMP threads used by parallel regions, one without OpenMP.*/
+inline int getMaxThreads() {
+#ifdef _OPENMP
+   return omp_get_max_threads();
+#else
+   return 1;
+#endif
+}
+
+/** Wall clock time [s] that may be read by any thread. With OpenMP, MPI is only
+ * called from the master thread (MPI_THREAD_FUNNELED), so MPI_Wtime is not used.*/
+inline double getWallTime() {
+#ifdef _OPENMP
+   return omp_get_wtime();
+#else
+   return MPI_Wtime();
+#endif
+}
+
+/** Work-stealing scheduler of particle blocks for OpenMP threads. Blocks are weighted
+ * by their particle counts, sorted into decreasing order and dealt to per-thread queues
+ * so that each queue gets roughly the same total weight. Each thread processes its own
+ * queue starting from the largest block, and an idle thread steals the largest remaining
+ * block of the other queues.
+ *
+ * Usage: call schedule() outside a parallel region, then inside the region each thread
+ * calls startThread(), next() until it returns false, and stopThread(). Blocks are returned
+ * as indices to the array given to schedule(), so that per-block results can be stored in
+ * the same order and reduced deterministically afterwards.
+ *
+ * The profiler only times the master thread, so the master thread's time spent on blocks
+ * is recorded in profile region "<name> busy" and the time it waits for the other threads
+ * to finish in region "<name> wait". The latter is the load imbalance of the stage.*/
+class BlockScheduler {
+ public:
+   BlockScheduler();
+   ~BlockScheduler();
+
+   bool next(int thread,size_t& index);
+   void schedule(const std::vector<pargrid::CellID>& blocks,const unsigned int* N_particles);
+   void setName(const std::string& name);
+   void startThread(int thread);
+   void stopThread(int thread);
+
+ private:
+   BlockScheduler(const BlockScheduler& scheduler);
+   BlockScheduler& operator=(const BlockScheduler& scheduler);
+
+   struct Queue {
+      std::vector<size_t> blocks;           /**< Indices of blocks dealt to the thread, in decreasing order of weight.*/
+      std::vector<unsigned int> weights;     /**< Weights of the blocks.*/
+      size_t head;                           /**< Index of the next unprocessed block.*/
+      unsigned long totalWeight;             /**< Sum of weights, only used when dealing blocks.*/
+      #ifdef _OPENMP
+         omp_lock_t lock;
+      #endif
+   };
+
+   int N_queues;
+   Queue* queues;                            /**< Queues of threads, owned by the scheduler.*/
+   std::vector<std::pair<unsigned int,size_t> > sorted; /**< Block weights and indices sorted by weight.*/
+   std::string busyName;                     /**< Name of the profile region of master thread's work.*/
+   std::string waitName;                     /**< Name of the profile region of master thread's wait.*/
+   int busyID;
+   int waitID;
+
+   void allocate(int N_threads);
+   void deallocate();
+   bool pop(Queue& queue,size_t& index);
+};
+
+#endif
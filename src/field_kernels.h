@@ -0,0 +1,483 @@
+/** This file is part of the RHybrid simulation.
+ *
+ *  Copyright 2018- Aalto University
+ *  Copyright 2015- Finnish Meteorological Institute
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIELD_KERNELS_H
+#define FIELD_KERNELS_H
+
+#include <cmath>
+
+#include <definitions.h>
+#include <constants.h>
+
+/** Stencil kernels of the field solver templated on the block widths. Kernels work on a
+ * single block: input is the padded (WIDTH+2)^3 array of the block and its neighbours
+ * filled by fetchData and output points to the first element of the block in a ParGrid
+ * array. Pointwise kernels (calcNodeUe, calcNodeE) read and write ParGrid arrays of the
+ * block directly. All indices are compile-time expressions of the widths, so loops over a
+ * block have constant trip counts that the compiler can unroll and vectorise.
+ *
+ * Kernels with an INTERIOR parameter have two versions: INTERIOR = true is used in blocks
+ * with all neighbours, where the loops cover the whole block. Otherwise the loops start from
+ * di,dj,dk, which skip nodes/faces at the -x/-y/-z boundary of the simulation domain.*/
+namespace fieldkernels {
+
+   /** Memory layout of a block and its padded copy, must match block::index and block::arrayIndex.*/
+   template<int WX,int WY,int WZ>
+   struct BlockLayout {
+      static constexpr int WIDTH_X = WX;
+      static constexpr int WIDTH_Y = WY;
+      static constexpr int WIDTH_Z = WZ;
+      static constexpr int SIZE = WX*WY*WZ;                   /**< Number of cells in a block.*/
+      static constexpr int PADDED = (WX+2)*(WY+2)*(WZ+2);     /**< Number of cells in a padded block.*/
+      static constexpr int SX = 1;                            /**< Strides of the padded block.*/
+      static constexpr int SY = WX+2;
+      static constexpr int SZ = (WX+2)*(WY+2);
+
+      static constexpr int index(int i,int j,int k) { return (k*WY + j)*WX + i; }
+      static constexpr int arrayIndex(int i,int j,int k) { return k*SZ + j*SY + i*SX; }
+      static constexpr int neighbourIndex(int i,int j,int k) { return (k+1)*9 + (j+1)*3 + (i+1); } /**< Offsets in -1..1.*/
+   };
+
+   /** Copy the cells of the neighbour at offset (OI,OJ,OK) that border the block to the padded array.*/
+   template<class BLOCK,int DIM,int OI,int OJ,int OK,typename CELLID> inline
+   void fetchNeighbour(const Real* data,Real* array,const CELLID* nbrLIDs,CELLID invalid) {
+      const CELLID nbrLID = nbrLIDs[BLOCK::neighbourIndex(OI,OJ,OK)];
+      if(nbrLID == invalid) { return; }
+      // source cells in the neighbour: last layer at -1, all at 0, first layer at +1
+      const int i0 = (OI < 0) ? BLOCK::WIDTH_X-1 : 0;
+      const int j0 = (OJ < 0) ? BLOCK::WIDTH_Y-1 : 0;
+      const int k0 = (OK < 0) ? BLOCK::WIDTH_Z-1 : 0;
+      const int ni = (OI == 0) ? BLOCK::WIDTH_X : 1;
+      const int nj = (OJ == 0) ? BLOCK::WIDTH_Y : 1;
+      const int nk = (OK == 0) ? BLOCK::WIDTH_Z : 1;
+      // rows along x are contiguous in both arrays
+      for(int k=k0;k<k0+nk;++k) for(int j=j0;j<j0+nj;++j) {
+	 const Real* src = data + (nbrLID*BLOCK::SIZE + BLOCK::index(i0,j,k))*DIM;
+	 Real* dst = array + BLOCK::arrayIndex(i0+1+OI*BLOCK::WIDTH_X,j+1+OJ*BLOCK::WIDTH_Y,k+1+OK*BLOCK::WIDTH_Z)*DIM;
+	 for(int l=0;l<ni*DIM;++l) { dst[l] = src[l]; }
+      }
+   }
+
+   /** Copy the block and neighbours N,...,26 in BLOCK::neighbourIndex order, one instantiation
+    * per neighbour so that all loop bounds are constants.*/
+   template<class BLOCK,int DIM,int N>
+   struct FetchNeighbours {
+      template<typename CELLID>
+      static void fetch(const Real* data,Real* array,const CELLID* nbrLIDs,CELLID invalid) {
+	 fetchNeighbour<BLOCK,DIM,N%3-1,(N/3)%3-1,N/9-1>(data,array,nbrLIDs,invalid);
+	 FetchNeighbours<BLOCK,DIM,N+1>::fetch(data,array,nbrLIDs,invalid);
+      }
+   };
+
+   template<class BLOCK,int DIM>
+   struct FetchNeighbours<BLOCK,DIM,27> {
+      template<typename CELLID>
+      static void fetch(const Real*,Real*,const CELLID*,CELLID) { }
+   };
+
+   /** Copy a block and all its existing neighbours from a ParGrid array to the padded array.
+    * Elements of missing neighbours are not touched.
+    * @param nbrLIDs Local IDs of the block and its 26 neighbours in BLOCK::neighbourIndex order.
+    * @param invalid Local ID of missing neighbours.
+    * CELLID is the local cell ID type of ParGrid, so that the kernels do not depend on its headers.*/
+   template<class BLOCK,typename CELLID> inline
+   void fetchData(const Real* data,Real* array,const CELLID* nbrLIDs,CELLID invalid,int vectorDim) {
+      if(vectorDim == 3) { FetchNeighbours<BLOCK,3,0>::fetch(data,array,nbrLIDs,invalid); }
+      else if(vectorDim == 1) { FetchNeighbours<BLOCK,1,0>::fetch(data,array,nbrLIDs,invalid); }
+      else {
+	 const int width[3] = {BLOCK::WIDTH_X,BLOCK::WIDTH_Y,BLOCK::WIDTH_Z};
+	 for(int ok=-1;ok<=1;++ok) for(int oj=-1;oj<=1;++oj) for(int oi=-1;oi<=1;++oi) {
+	    const CELLID nbrLID = nbrLIDs[BLOCK::neighbourIndex(oi,oj,ok)];
+	    if(nbrLID == invalid) { continue; }
+	    const int o[3] = {oi,oj,ok};
+	    int start[3];
+	    int count[3];
+	    for(int d=0;d<3;++d) {
+	       start[d] = (o[d] < 0) ? width[d]-1 : 0;
+	       count[d] = (o[d] == 0) ? width[d] : 1;
+	    }
+	    const int rowSize = count[0]*vectorDim;
+	    for(int k=start[2];k<start[2]+count[2];++k) for(int j=start[1];j<start[1]+count[1];++j) {
+	       const Real* src = data + (nbrLID*BLOCK::SIZE + BLOCK::index(start[0],j,k))*vectorDim;
+	       Real* dst = array + BLOCK::arrayIndex(start[0]+1+oi*BLOCK::WIDTH_X,j+1+oj*BLOCK::WIDTH_Y,k+1+ok*BLOCK::WIDTH_Z)*vectorDim;
+	       for(int l=0;l<rowSize;++l) { dst[l] = src[l]; }
+	    }
+	 }
+      }
+   }
+
+   // interpolation from faces to cells
+   template<class BLOCK> inline
+   void face2Cell(const Real* array,Real* cellData) {
+      for(int k=0; k<BLOCK::WIDTH_Z; ++k) for(int j=0; j<BLOCK::WIDTH_Y; ++j) for(int i=0; i<BLOCK::WIDTH_X; ++i) {
+	 const int n = BLOCK::index(i,j,k)*3;
+	 const int a = BLOCK::arrayIndex(i+1,j+1,k+1)*3;
+	 cellData[n+0] = 0.5*(array[a+0] + array[a-BLOCK::SX*3+0]);
+	 cellData[n+1] = 0.5*(array[a+1] + array[a-BLOCK::SY*3+1]);
+	 cellData[n+2] = 0.5*(array[a+2] + array[a-BLOCK::SZ*3+2]);
+      }
+   }
+
+   // interpolation from cells to nodes
+   template<class BLOCK,int DIM,bool INTERIOR> inline
+   void cell2Node(const Real* array,Real* nodeData,int di,int dj,int dk) {
+      // cells around node (i,j,k) relative to padded cell (i+1,j+1,k+1)
+      const int c[8] = {
+	 BLOCK::arrayIndex(0,0,0)*DIM,BLOCK::arrayIndex(0,0,1)*DIM,BLOCK::arrayIndex(0,1,0)*DIM,BLOCK::arrayIndex(1,0,0)*DIM,
+	 BLOCK::arrayIndex(0,1,1)*DIM,BLOCK::arrayIndex(1,1,0)*DIM,BLOCK::arrayIndex(1,0,1)*DIM,BLOCK::arrayIndex(1,1,1)*DIM
+      };
+      const int i0 = INTERIOR ? 0 : di;
+      const int j0 = INTERIOR ? 0 : dj;
+      const int k0 = INTERIOR ? 0 : dk;
+      for(int k=k0; k<BLOCK::WIDTH_Z; ++k) for(int j=j0; j<BLOCK::WIDTH_Y; ++j) for(int i=i0; i<BLOCK::WIDTH_X; ++i) {
+	 const int n = BLOCK::index(i,j,k)*DIM;
+	 const int a = BLOCK::arrayIndex(i+1,j+1,k+1)*DIM;
+	 for(int l=0;l<DIM;++l) {
+	    nodeData[n+l] = 0.125*(array[a+c[0]+l] + array[a+c[1]+l] + array[a+c[2]+l] + array[a+c[3]+l] +
+				   array[a+c[4]+l] + array[a+c[5]+l] + array[a+c[6]+l] + array[a+c[7]+l]);
+	 }
+      }
+   }
+
+   // interpolation from nodes to cells
+   template<class BLOCK> inline
+   void node2Cell(const Real* array,Real* cellData) {
+      // nodes around cell (i,j,k) relative to padded node (i+1,j+1,k+1)
+      const int c[8] = {
+	 0,-BLOCK::arrayIndex(1,0,0)*3,-BLOCK::arrayIndex(1,1,0)*3,-BLOCK::arrayIndex(0,1,0)*3,
+	 -BLOCK::arrayIndex(0,0,1)*3,-BLOCK::arrayIndex(0,1,1)*3,-BLOCK::arrayIndex(1,0,1)*3,-BLOCK::arrayIndex(1,1,1)*3
+      };
+      for(int k=0; k<BLOCK::WIDTH_Z; ++k) for(int j=0; j<BLOCK::WIDTH_Y; ++j) for(int i=0; i<BLOCK::WIDTH_X; ++i) {
+	 const int n = BLOCK::index(i,j,k)*3;
+	 const int a = BLOCK::arrayIndex(i+1,j+1,k+1)*3;
+	 for(int l=0;l<3;++l) {
+	    cellData[n+l] = 0.125*(array[a+c[0]+l] + array[a+c[1]+l] + array[a+c[2]+l] + array[a+c[3]+l] +
+				   array[a+c[4]+l] + array[a+c[5]+l] + array[a+c[6]+l] + array[a+c[7]+l]);
+	 }
+      }
+   }
+
+   /** Gaussian average of node data over the 27 nodes around each node. In blocks without
+    * all neighbours, elements of the padded array equal to initVal are excluded from the
+    * average and the remaining weights renormalised. nodeAvg in hybrid_propagator.cpp sets
+    * only the first element to initVal, as before templating, so missing neighbours are
+    * otherwise read as zeros and averaged with their normal weights.
+    * @param C Weights of the node itself, direct, sqrt(2)*dx and sqrt(3)*dx neighbours.*/
+   template<class BLOCK,int DIM,bool INTERIOR> inline
+   void nodeAvg(const Real* array,Real* nodeData,const Real* C,Real initVal,int di,int dj,int dk) {
+      // nodes relative to padded node (i,j,k) and their weight classes
+      const int o[27] = {
+	 BLOCK::arrayIndex(1,1,1)*DIM,
+	 BLOCK::arrayIndex(1,1,0)*DIM,BLOCK::arrayIndex(0,1,1)*DIM,BLOCK::arrayIndex(1,2,1)*DIM,
+	 BLOCK::arrayIndex(2,1,1)*DIM,BLOCK::arrayIndex(1,0,1)*DIM,BLOCK::arrayIndex(1,1,2)*DIM,
+	 BLOCK::arrayIndex(0,1,0)*DIM,BLOCK::arrayIndex(1,0,0)*DIM,BLOCK::arrayIndex(1,2,0)*DIM,
+	 BLOCK::arrayIndex(2,1,0)*DIM,BLOCK::arrayIndex(0,0,1)*DIM,BLOCK::arrayIndex(0,2,1)*DIM,
+	 BLOCK::arrayIndex(2,2,1)*DIM,BLOCK::arrayIndex(2,0,1)*DIM,BLOCK::arrayIndex(0,1,2)*DIM,
+	 BLOCK::arrayIndex(1,2,2)*DIM,BLOCK::arrayIndex(2,1,2)*DIM,BLOCK::arrayIndex(1,0,2)*DIM,
+	 BLOCK::arrayIndex(0,0,2)*DIM,BLOCK::arrayIndex(0,2,2)*DIM,BLOCK::arrayIndex(2,0,2)*DIM,
+	 BLOCK::arrayIndex(2,2,2)*DIM,BLOCK::arrayIndex(0,0,0)*DIM,BLOCK::arrayIndex(0,2,0)*DIM,
+	 BLOCK::arrayIndex(2,0,0)*DIM,BLOCK::arrayIndex(2,2,0)*DIM
+      };
+      const int w[27] = {0, 1,1,1,1,1,1, 2,2,2,2,2,2,2,2,2,2,2,2, 3,3,3,3,3,3,3,3};
+      Real weights[27];
+      for(int m=0;m<27;++m) { weights[m] = C[w[m]]; }
+      const int i0 = INTERIOR ? 0 : di;
+      const int j0 = INTERIOR ? 0 : dj;
+      const int k0 = INTERIOR ? 0 : dk;
+      for(int k=k0; k<BLOCK::WIDTH_Z; ++k) for(int j=j0; j<BLOCK::WIDTH_Y; ++j) for(int i=i0; i<BLOCK::WIDTH_X; ++i) {
+	 const int n = BLOCK::index(i,j,k)*DIM;
+	 const int a = BLOCK::arrayIndex(i,j,k)*DIM;
+	 if(INTERIOR == true) {
+	    // all nodes exist, components are summed side by side in the same order as below
+	    Real sum[DIM];
+	    for(int l=0;l<DIM;++l) { sum[l] = 0.0; }
+	    for(int m=0;m<27;++m) for(int l=0;l<DIM;++l) { sum[l] += weights[m]*array[a+o[m]+l]; }
+	    for(int l=0;l<DIM;++l) { nodeData[n+l] = sum[l]; }
+	    continue;
+	 }
+	 for(int l=0;l<DIM;++l) {
+	    Real sum = 0.0;
+	    Real value[27];
+	    Real weight[27];
+	    bool missingFound = false;
+	    for(int m=0;m<27;++m) {
+	       value[m] = array[a+o[m]+l];
+	       weight[m] = weights[m];
+	       if(value[m] == initVal) { value[m] = 0.0; weight[m] = 0.0; missingFound = true; }
+	    }
+	    // renormalize if boundary node found
+	    if(missingFound == true) {
+	       Real Csum = 0.0;
+	       for(int m=0;m<27;++m) { Csum += weight[m]; }
+	       if(Csum > 0.0) { for(int m=0;m<27;++m) { weight[m] /= Csum; } }
+	    }
+	    for(int m=0;m<27;++m) { sum += weight[m]*value[m]; }
+	    nodeData[n+l] = sum;
+	 }
+      }
+   }
+
+   // upwind nodeB using cellB and nodeUe
+   template<class BLOCK,bool INTERIOR> inline
+   void upwindNodeB(const Real* cellB,const Real* nodeUe,Real* nodeB,int di,int dj,int dk) {
+      // cells around node (i,j,k) relative to padded cell (i+1,j+1,k+1)
+      const int c111 = BLOCK::arrayIndex(0,0,0)*3;
+      const int c112 = BLOCK::arrayIndex(0,0,1)*3;
+      const int c121 = BLOCK::arrayIndex(0,1,0)*3;
+      const int c211 = BLOCK::arrayIndex(1,0,0)*3;
+      const int c122 = BLOCK::arrayIndex(0,1,1)*3;
+      const int c221 = BLOCK::arrayIndex(1,1,0)*3;
+      const int c212 = BLOCK::arrayIndex(1,0,1)*3;
+      const int c222 = BLOCK::arrayIndex(1,1,1)*3;
+      const int i0 = INTERIOR ? 0 : di;
+      const int j0 = INTERIOR ? 0 : dj;
+      const int k0 = INTERIOR ? 0 : dk;
+      for(int k=k0; k<BLOCK::WIDTH_Z; ++k) for(int j=j0; j<BLOCK::WIDTH_Y; ++j) for(int i=i0; i<BLOCK::WIDTH_X; ++i) {
+	 const int n = BLOCK::index(i,j,k)*3;
+	 const Real* a = cellB + BLOCK::arrayIndex(i+1,j+1,k+1)*3;
+	 // upwind displacement vector = (-0.5,0,0) if Ue = 0, otherwise -0.5*nodeUe/|nodeUe| (dimensionless, dx=1)
+	 Real xUpwind = -0.5;
+	 Real yUpwind = 0;
+	 Real zUpwind = 0;
+	 const Real Ue = sqrt(nodeUe[n+0]*nodeUe[n+0] + nodeUe[n+1]*nodeUe[n+1] + nodeUe[n+2]*nodeUe[n+2]);
+	 if(Ue > 0) {
+	    const Real s = -0.5/Ue;
+	    xUpwind = nodeUe[n+0]*s;
+	    yUpwind = nodeUe[n+1]*s;
+	    zUpwind = nodeUe[n+2]*s;
+	 }
+	 // squared distances to the cell centroids at -0.5 and +0.5 in each direction
+	 const Real xm = (-0.5-xUpwind)*(-0.5-xUpwind);
+	 const Real xp = (+0.5-xUpwind)*(+0.5-xUpwind);
+	 const Real ym = (-0.5-yUpwind)*(-0.5-yUpwind);
+	 const Real yp = (+0.5-yUpwind)*(+0.5-yUpwind);
+	 const Real zm = (-0.5-zUpwind)*(-0.5-zUpwind);
+	 const Real zp = (+0.5-zUpwind)*(+0.5-zUpwind);
+	 // weighting factors for the eight cells around the node
+	 const Real w111 = 1/sqrt(xm + ym + zm);
+	 const Real w112 = 1/sqrt(xm + ym + zp);
+	 const Real w121 = 1/sqrt(xm + yp + zm);
+	 const Real w211 = 1/sqrt(xp + ym + zm);
+	 const Real w122 = 1/sqrt(xm + yp + zp);
+	 const Real w221 = 1/sqrt(xp + yp + zm);
+	 const Real w212 = 1/sqrt(xp + ym + zp);
+	 const Real w222 = 1/sqrt(xp + yp + zp);
+	 const Real wsum = w111+w112+w121+w211+w122+w221+w212+w222;
+	 if(wsum > 0) {
+	    for(int l=0;l<3;++l) {
+	       nodeB[n+l] = (w111*a[c111+l] + w112*a[c112+l] + w121*a[c121+l] + w211*a[c211+l] +
+			     w122*a[c122+l] + w221*a[c221+l] + w212*a[c212+l] + w222*a[c222+l])/wsum;
+	    }
+	 }
+	 else {
+	    nodeB[n+0] = nodeB[n+1] = nodeB[n+2] = 0.0;
+	 }
+      }
+   }
+
+   /** Current density at nodes from the edge currents of curl(faceB)/mu0.
+    * @param maxVw Maximum whistler speed, the current is limited at nodes exceeding it (USE_MAXVW).*/
+   template<class BLOCK,bool INTERIOR> inline
+   void calcNodeJ(const Real* Bf,const Real* nodeB,const Real* nodeRhoQi,Real* nodeJ,
+#ifdef USE_MAXVW
+		  Real* counterNodeMaxVw,Real maxVw,
+#endif
+		  Real dx,int di,int dj,int dk) {
+      const int X = BLOCK::arrayIndex(1,0,0)*3;
+      const int Y = BLOCK::arrayIndex(0,1,0)*3;
+      const int Z = BLOCK::arrayIndex(0,0,1)*3;
+      const int i0 = INTERIOR ? 0 : di;
+      const int j0 = INTERIOR ? 0 : dj;
+      const int k0 = INTERIOR ? 0 : dk;
+      for(int k=k0; k<BLOCK::WIDTH_Z; ++k) for(int j=j0; j<BLOCK::WIDTH_Y; ++j) for(int i=i0; i<BLOCK::WIDTH_X; ++i) {
+	 const int n = BLOCK::index(i,j,k);
+	 const int n3 = n*3;
+	 const int a = BLOCK::arrayIndex(i+1,j+1,k+1)*3;
+	 const Real edgeJx1 = - Bf[a+2]     + Bf[a+1]     + Bf[a+Y+2]   - Bf[a+Z+1];
+	 const Real edgeJx2 = - Bf[a+X+2]   + Bf[a+X+1]   + Bf[a+X+Y+2] - Bf[a+X+Z+1];
+	 const Real edgeJy1 = + Bf[a+2]     + Bf[a+Z+0]   - Bf[a+X+2]   - Bf[a+0];
+	 const Real edgeJy2 = + Bf[a+Y+2]   + Bf[a+Y+Z+0] - Bf[a+X+Y+2] - Bf[a+Y+0];
+	 const Real edgeJz1 = - Bf[a+1]     + Bf[a+0]     + Bf[a+X+1]   - Bf[a+Y+0];
+	 const Real edgeJz2 = - Bf[a+Z+1]   + Bf[a+Z+0]   + Bf[a+X+Z+1] - Bf[a+Y+Z+0];
+	 Real d = 1.0;
+#ifdef USE_MAXVW
+	 Real vw = 0.0; // fastest whistler signal p. 28 Alho (2016)
+	 const Real ne = nodeRhoQi[n]/constants::CHARGE_ELEMENTARY;
+	 const Real Btot = sqrt(nodeB[n3+0]*nodeB[n3+0] + nodeB[n3+1]*nodeB[n3+1] + nodeB[n3+2]*nodeB[n3+2]);
+	 if(ne > 0.0 && dx > 0.0) {
+	    vw = 2.0*Btot*M_PI/( constants::PERMEABILITY*ne*constants::CHARGE_ELEMENTARY*dx );
+	 }
+	 if(vw > maxVw && maxVw > 0.0) {
+	    d = vw/maxVw;
+	    counterNodeMaxVw[n]++;
+	 }
+#endif
+	 const Real s = 0.5/(dx*constants::PERMEABILITY*d);
+	 nodeJ[n3+0] = (edgeJx1 + edgeJx2)*s;
+	 nodeJ[n3+1] = (edgeJy1 + edgeJy2)*s;
+	 nodeJ[n3+2] = (edgeJz1 + edgeJz2)*s;
+      }
+   }
+
+   /** Electron velocity at nodes, Ue = -(J - Ji)/rhoqi with the Hall term, otherwise Ji/rhoqi.
+    * nodeRhoQi is limited to minRhoQi and Ue to sqrt(maxUe2), Ue is zero at inner nodes.*/
+   template<class BLOCK,bool INTERIOR> inline
+   void calcNodeUe(Real* nodeRhoQi,const Real* nodeJi,const Real* nodeJ,Real* nodeUe,const bool* innerFlag,Real* counterCellMaxUe,
+		   Real minRhoQi,Real maxUe2,bool useHallElectricField,int di,int dj,int dk) {
+      const int i0 = INTERIOR ? 0 : di;
+      const int j0 = INTERIOR ? 0 : dj;
+      const int k0 = INTERIOR ? 0 : dk;
+      for(int k=k0; k<BLOCK::WIDTH_Z; ++k) for(int j=j0; j<BLOCK::WIDTH_Y; ++j) for(int i=i0; i<BLOCK::WIDTH_X; ++i) {
+	 const int n = BLOCK::index(i,j,k);
+	 const int n3 = n*3;
+	 // inner boundary condition for Ue
+	 if(innerFlag[n] == true) {
+	    nodeUe[n3+0] = nodeUe[n3+1] = nodeUe[n3+2] = 0.0;
+	    continue;
+	 }
+	 // check min nodeRhoQi
+	 if(nodeRhoQi[n] < minRhoQi) { nodeRhoQi[n] = minRhoQi; }
+	 // calc Ue = (J - Ji)/rhoqi
+	 for(int l=0;l<3;++l) {
+	    if(fabs(nodeRhoQi[n]) > 0) {
+	       if(useHallElectricField == true) {
+		  nodeUe[n3+l] = -(nodeJ[n3+l] - nodeJi[n3+l])/nodeRhoQi[n];
+	       }
+	       else {
+		  nodeUe[n3+l] = nodeJi[n3+l]/nodeRhoQi[n];
+	       }
+	    }
+	    else {
+	       nodeUe[n3+l] = 0.0;
+	    }
+	 }
+	 // check max Ue
+	 const Real Ue2 = nodeUe[n3+0]*nodeUe[n3+0] + nodeUe[n3+1]*nodeUe[n3+1] + nodeUe[n3+2]*nodeUe[n3+2];
+	 if(Ue2 > maxUe2) {
+	    const Real norm = sqrt(maxUe2/Ue2);
+	    nodeUe[n3+0] *= norm;
+	    nodeUe[n3+1] *= norm;
+	    nodeUe[n3+2] *= norm;
+	    counterCellMaxUe[n]++; // using cell array here to avoid introducing a new node array
+	 }
+      }
+   }
+
+   /** Electric field at nodes, E = -Ue x (B + B0) + eta*J, limited to sqrt(Ecut2) (USE_ECUT).*/
+   template<class BLOCK,bool INTERIOR> inline
+   void calcNodeE(const Real* nodeUe,const Real* nodeB,
+#ifdef USE_B_CONSTANT
+		  const Real* nodeB0,
+#endif
+#ifdef USE_RESISTIVITY
+		  const Real* nodeEta,
+#endif
+		  const Real* nodeJ,Real* nodeE,
+#ifdef USE_ECUT
+		  Real* counterNodeEcut,Real Ecut2,
+#endif
+		  int di,int dj,int dk) {
+      const int i0 = INTERIOR ? 0 : di;
+      const int j0 = INTERIOR ? 0 : dj;
+      const int k0 = INTERIOR ? 0 : dk;
+      for(int k=k0; k<BLOCK::WIDTH_Z; ++k) for(int j=j0; j<BLOCK::WIDTH_Y; ++j) for(int i=i0; i<BLOCK::WIDTH_X; ++i) {
+	 const int n = BLOCK::index(i,j,k);
+	 const int n3 = n*3;
+	 Real Btot[3];
+	 Btot[0] = nodeB[n3+0];
+	 Btot[1] = nodeB[n3+1];
+	 Btot[2] = nodeB[n3+2];
+#ifdef USE_B_CONSTANT
+	 Btot[0] += nodeB0[n3+0];
+	 Btot[1] += nodeB0[n3+1];
+	 Btot[2] += nodeB0[n3+2];
+#endif
+	 nodeE[n3+0] = -(nodeUe[n3+1]*Btot[2] - nodeUe[n3+2]*Btot[1]);
+	 nodeE[n3+1] = -(nodeUe[n3+2]*Btot[0] - nodeUe[n3+0]*Btot[2]);
+	 nodeE[n3+2] = -(nodeUe[n3+0]*Btot[1] - nodeUe[n3+1]*Btot[0]);
+#ifdef USE_RESISTIVITY
+	 nodeE[n3+0] += nodeEta[n]*nodeJ[n3+0];
+	 nodeE[n3+1] += nodeEta[n]*nodeJ[n3+1];
+	 nodeE[n3+2] += nodeEta[n]*nodeJ[n3+2];
+#endif
+#ifdef USE_ECUT
+	 if(Ecut2 > 0) {
+	    const Real E2 = nodeE[n3+0]*nodeE[n3+0] + nodeE[n3+1]*nodeE[n3+1] + nodeE[n3+2]*nodeE[n3+2];
+	    if(E2 > Ecut2) {
+	       const Real scaling = sqrt(Ecut2/E2);
+	       nodeE[n3+0] *= scaling;
+	       nodeE[n3+1] *= scaling;
+	       nodeE[n3+2] *= scaling;
+	       counterNodeEcut[n]++;
+	    }
+	 }
+#endif
+      }
+   }
+
+   /** faceData = curl(nodeData), doFaraday: true = Faraday's law (faceData += dt*curl),
+    * false = Ampere's law (faceData = -curl/mu0). Faces are updated only if do*Face is true.*/
+   template<class BLOCK,bool INTERIOR> inline
+   void faceCurl(const Real* array,Real* faceData,bool doFaraday,Real dt,Real dx,
+#ifdef USE_XMIN_BOUNDARY
+		 const bool* xMinFlag,
+#endif
+		 bool doXFace,bool doYFace,bool doZFace,int di,int dj,int dk) {
+      // nodes around face centres relative to padded node (i,j,k)
+      const int node1 = BLOCK::arrayIndex(0,0,1)*3;
+      const int node3 = BLOCK::arrayIndex(0,1,0)*3;
+      const int node4 = BLOCK::arrayIndex(0,1,1)*3;
+      const int node5 = BLOCK::arrayIndex(1,0,1)*3;
+      const int node6 = BLOCK::arrayIndex(1,0,0)*3;
+      const int node7 = BLOCK::arrayIndex(1,1,0)*3;
+      const int node8 = BLOCK::arrayIndex(1,1,1)*3;
+      const bool doX = INTERIOR ? true : doXFace;
+      const bool doY = INTERIOR ? true : doYFace;
+      const bool doZ = INTERIOR ? true : doZFace;
+      const int i0 = INTERIOR ? 0 : di;
+      const int j0 = INTERIOR ? 0 : dj;
+      const int k0 = INTERIOR ? 0 : dk;
+      for(int k=k0; k<BLOCK::WIDTH_Z; ++k) for(int j=j0; j<BLOCK::WIDTH_Y; ++j) for(int i=i0; i<BLOCK::WIDTH_X; ++i) {
+	 const int n3 = BLOCK::index(i,j,k)*3;
+#ifdef USE_XMIN_BOUNDARY
+	 // no field propagation at x < xmin
+	 if(xMinFlag[BLOCK::index(i,j,k)] == true && doFaraday == true) { continue; }
+#endif
+	 const Real* p = array + BLOCK::arrayIndex(i,j,k)*3;
+	 if(doX == true) {
+	    const Real curlX = 0.5*(+p[node5+2]+p[node6+2]-p[node6+1]-p[node7+1]-p[node7+2]-p[node8+2]+p[node8+1]+p[node5+1])/dx;
+	    if(doFaraday == true) { faceData[n3+0] += dt*curlX; }
+	    else { faceData[n3+0] = -curlX/constants::PERMEABILITY; }
+	 }
+	 if(doY == true) {
+	    const Real curlY = 0.5*(-p[node4+0]-p[node8+0]+p[node8+2]+p[node7+2]+p[node7+0]+p[node3+0]-p[node3+2]-p[node4+2])/dx;
+	    if(doFaraday == true) { faceData[n3+1] += dt*curlY; }
+	    else { faceData[n3+1] = -curlY/constants::PERMEABILITY; }
+	 }
+	 if(doZ == true) {
+	    const Real curlZ = 0.5*(-p[node1+0]-p[node5+0]-p[node5+1]-p[node8+1]+p[node8+0]+p[node4+0]+p[node4+1]+p[node1+1])/dx;
+	    if(doFaraday == true) { faceData[n3+2] += dt*curlZ; }
+	    else { faceData[n3+2] = -curlZ/constants::PERMEABILITY; }
+	 }
+      }
+   }
+
+} // namespace fieldkernels
+
+#endif
@@ -0,0 +1,1070 @@
+/** This file is part of the RHybrid simulation.
+ *
+ *  Copyright 2018- Aalto University
+ *  Copyright 2015- Finnish Meteorological Institute
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** Microbenchmark suite of the field kernels in field_kernels.h. Synthetic ParGrid arrays
+ * are set up for a periodic lattice of blocks where all neighbours exist, and each kernel
+ * is timed over all blocks for 2^3, 4^3 and 8^3 blocks and the given numbers of local
+ * blocks. Stencil kernels are timed as the field solver calls them, fetchData of the block
+ * and its neighbours followed by the kernel, and fetchData is also timed separately.
+ *
+ * Stencil kernels are compared with the kernels of hybrid_propagator.cpp before they were
+ * templated (namespace generic). These are verbatim copies of the old functions and their
+ * fetchData, instantiated for each block width and run against minimal stand-ins of the
+ * ParGrid, Simulation and Hybrid names they use.
+ *
+ * For each kernel the time per cell, cells per second and nominal memory bandwidth are printed.
+ * Nominal bandwidth counts each input and output array once per block, it is not measured
+ * memory traffic: with few blocks all arrays stay in cache.
+ * Build with "make field_kernels_benchmark" using the same Makefile options as the plugin,
+ * only definitions.h and constants.h of Corsair are needed.
+ * Usage: field_kernels_benchmark [repetitions] [blocks ...]*/
+
+#include <cstdlib>
+#include <cmath>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "field_kernels.h"
+
+using namespace std;
+
+// field kernels of hybrid_propagator.cpp before templating
+namespace generic {
+   // stand-ins of a ParGrid where all neighbours of all blocks exist
+   namespace pargrid {
+      typedef uint32_t CellID;
+      const uint32_t ALL_NEIGHBOURS_EXIST = 0x7FFFFFF;
+   }
+
+   struct ParGrid {
+      const pargrid::CellID* nbrLIDs;  // 27 local IDs per block in calcNeighbourTypeID order
+      vector<uint32_t> flags;
+      bool* xMinFlag;
+      uint32_t getNeighbourFlags(pargrid::CellID blockID) const { return flags[blockID]; }
+      const uint32_t* getNeighbourFlags() const { return &flags[0]; }
+      const pargrid::CellID* getCellNeighbourIDs(pargrid::CellID blockID) const { return nbrLIDs + blockID*27; }
+      unsigned int calcNeighbourTypeID(int i,int j,int k) const { return (k+1)*9 + (j+1)*3 + (i+1); }
+      pargrid::CellID invalid() const { return numeric_limits<pargrid::CellID>::max(); }
+      template<typename T> T* getUserDataStatic(unsigned int) { return xMinFlag; }
+   };
+
+   struct Simulation {
+      Real dt;
+   };
+
+   struct SimulationClasses {
+      ParGrid pargrid;
+   };
+
+   struct Hybrid {
+      // neighbour flags are only tested by the boundary paths, which are not benchmarked
+      static const uint32_t X_POS_EXISTS = 1;
+      static const uint32_t X_NEG_EXISTS = 2;
+      static const uint32_t Y_POS_EXISTS = 4;
+      static const uint32_t Y_NEG_EXISTS = 8;
+      static const uint32_t Z_POS_EXISTS = 16;
+      static const uint32_t Z_NEG_EXISTS = 32;
+      static Real dx;
+      static Real maxVw;
+      static Real EfilterNodeGaussCoeffs[4];
+      static unsigned int dataXminFlagID;
+   };
+   Real Hybrid::dx = 1.0;
+   Real Hybrid::maxVw = 0.0;
+   Real Hybrid::EfilterNodeGaussCoeffs[4];
+   unsigned int Hybrid::dataXminFlagID = 0;
+
+   template<typename T> inline T sqr(const T& x) { return x*x; }
+
+   // the old kernels, block is the layout of the instantiated block width
+   template<class BLOCK>
+   struct Kernels {
+      typedef BLOCK block;
+      static void face2Cell(Real* faceData,Real* cellData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID);
+      static void cell2Node(Real* cellData,Real* nodeData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID,const int vectorDim);
+      static void node2Cell(Real* nodeData,Real* cellData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID);
+      static void nodeAvg(Real* nodeDataOld,Real* nodeData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID,const int vectorDim);
+      static void upwindNodeB(Real* cellB,Real* nodeUe,Real* nodeB,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID);
+      static void calcNodeJ(Real* faceB,Real* nodeB,Real* nodeRhoQi,Real* nodeJ,
+#ifdef USE_MAXVW
+			    Real* counterNodeMaxVw,
+#endif
+			    Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID);
+      static void faceCurl(Real* nodeData,Real* faceData,bool doFaraday,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID);
+      static void fetchData(Real* data,Real* array,SimulationClasses& simClasses,pargrid::CellID blockID,int vectorDim);
+   };
+}
+
+// BEGIN copied from hybrid_propagator.cpp, only the function names are qualified
+
+// interpolation from faces to cells
+template<class BLOCK>
+void generic::Kernels<BLOCK>::face2Cell(Real* faceData,Real* cellData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID)
+{
+   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) return;
+   const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
+   Real array[size*3];
+   fetchData(faceData,array,simClasses,blockID,3);
+   for(int k=0; k<block::WIDTH_Z; ++k) for(int j=0; j<block::WIDTH_Y; ++j) for(int i=0; i<block::WIDTH_X; ++i) {
+      const int n = (blockID*block::SIZE+block::index(i,j,k))*3;
+      cellData[n+0] = 0.5*(array[(block::arrayIndex(i+1,j+1,k+1))*3+0] + array[(block::arrayIndex(i+0,j+1,k+1))*3+0]);
+      cellData[n+1] = 0.5*(array[(block::arrayIndex(i+1,j+1,k+1))*3+1] + array[(block::arrayIndex(i+1,j+0,k+1))*3+1]);
+      cellData[n+2] = 0.5*(array[(block::arrayIndex(i+1,j+1,k+1))*3+2] + array[(block::arrayIndex(i+1,j+1,k+0))*3+2]);
+   }
+}
+
+// inteprolation from cells to nodes
+template<class BLOCK>
+void generic::Kernels<BLOCK>::cell2Node(Real* cellData,Real* nodeData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID,const int vectorDim)
+{
+   int di=0;
+   int dj=0;
+   int dk=0;
+   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
+   }
+   
+   const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
+   Real array[size*vectorDim];
+   fetchData(cellData,array,simClasses,blockID,vectorDim);
+
+   for(int k=0+dk; k<block::WIDTH_Z; ++k) for(int j=0+dj; j<block::WIDTH_Y; ++j) for(int i=0+di; i<block::WIDTH_X; ++i) {
+      const int n = (blockID*block::SIZE+block::index(i,j,k))*vectorDim;
+      for(int l=0;l<vectorDim;++l) {
+	 nodeData[n+l] = 0.125*(array[(block::arrayIndex(i+1,j+1,k+1))*vectorDim+l] +
+				array[(block::arrayIndex(i+1,j+1,k+2))*vectorDim+l] +
+				array[(block::arrayIndex(i+1,j+2,k+1))*vectorDim+l] +
+				array[(block::arrayIndex(i+2,j+1,k+1))*vectorDim+l] +
+				array[(block::arrayIndex(i+1,j+2,k+2))*vectorDim+l] +
+				array[(block::arrayIndex(i+2,j+2,k+1))*vectorDim+l] +
+				array[(block::arrayIndex(i+2,j+1,k+2))*vectorDim+l] +
+				array[(block::arrayIndex(i+2,j+2,k+2))*vectorDim+l]);
+      }
+   }
+}
+
+// interpolation from nodes to cells
+template<class BLOCK>
+void generic::Kernels<BLOCK>::node2Cell(Real* nodeData,Real* cellData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID)
+{
+   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) return;
+   const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
+   Real array[size*3];
+   fetchData(nodeData,array,simClasses,blockID,3);
+   for(int k=0; k<block::WIDTH_Z; ++k) for(int j=0; j<block::WIDTH_Y; ++j) for(int i=0; i<block::WIDTH_X; ++i) {
+      const int n = (blockID*block::SIZE+block::index(i,j,k))*3;
+      for(int l=0;l<3;++l) {
+	 cellData[n+l] = 0.125*(array[(block::arrayIndex(i+1,j+1,k+1))*3+l] + 
+				array[(block::arrayIndex(i+0,j+1,k+1))*3+l] +
+				array[(block::arrayIndex(i+0,j+0,k+1))*3+l] +
+				array[(block::arrayIndex(i+1,j+0,k+1))*3+l] +
+				array[(block::arrayIndex(i+1,j+1,k+0))*3+l] +
+				array[(block::arrayIndex(i+1,j+0,k+0))*3+l] +
+				array[(block::arrayIndex(i+0,j+1,k+0))*3+l] +
+				array[(block::arrayIndex(i+0,j+0,k+0))*3+l]);
+      }
+   }
+}
+
+// node data average from all neighbors
+template<class BLOCK>
+void generic::Kernels<BLOCK>::nodeAvg(Real* nodeDataOld,Real* nodeData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID,const int vectorDim)
+{
+   int di=0;
+   int dj=0;
+   int dk=0;
+   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
+   }
+   const unsigned int arraySize = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2)*vectorDim;
+   const Real initVal = numeric_limits<Real>::max();
+   Real array[arraySize] = {initVal};
+   fetchData(nodeDataOld,array,simClasses,blockID,vectorDim);
+   // coefficients
+   const Real C1 = Hybrid::EfilterNodeGaussCoeffs[0]; // node itself
+   const Real C2 = Hybrid::EfilterNodeGaussCoeffs[1]; // direct neighbors (distance = dx)
+   const Real C3 = Hybrid::EfilterNodeGaussCoeffs[2]; // diagonal neighbors (distance = sqrt(2)*dx)
+   const Real C4 = Hybrid::EfilterNodeGaussCoeffs[3]; // diagonal neighbors (distance = sqrt(3)*dx)
+   // loop through all nodes in the simulation domain
+   for(int k=0+dk; k<block::WIDTH_Z; ++k) for(int j=0+dj; j<block::WIDTH_Y; ++j) for(int i=0+di; i<block::WIDTH_X; ++i) {
+      const int n = (blockID*block::SIZE+block::index(i,j,k))*vectorDim;
+      for(int l=0;l<vectorDim;++l) {
+         // electric field component l (x=0,y=1,z=2) at 27 nodes
+         Real nodeEl111 = array[(block::arrayIndex(i+1,j+1,k+1))*vectorDim+l];
+         Real nodeEl110 = array[(block::arrayIndex(i+1,j+1,k+0))*vectorDim+l];
+         Real nodeEl011 = array[(block::arrayIndex(i+0,j+1,k+1))*vectorDim+l];
+         Real nodeEl121 = array[(block::arrayIndex(i+1,j+2,k+1))*vectorDim+l];
+         Real nodeEl211 = array[(block::arrayIndex(i+2,j+1,k+1))*vectorDim+l];
+         Real nodeEl101 = array[(block::arrayIndex(i+1,j+0,k+1))*vectorDim+l];
+         Real nodeEl112 = array[(block::arrayIndex(i+1,j+1,k+2))*vectorDim+l];
+         Real nodeEl010 = array[(block::arrayIndex(i+0,j+1,k+0))*vectorDim+l];
+         Real nodeEl100 = array[(block::arrayIndex(i+1,j+0,k+0))*vectorDim+l];
+         Real nodeEl120 = array[(block::arrayIndex(i+1,j+2,k+0))*vectorDim+l];
+         Real nodeEl210 = array[(block::arrayIndex(i+2,j+1,k+0))*vectorDim+l];
+         Real nodeEl001 = array[(block::arrayIndex(i+0,j+0,k+1))*vectorDim+l];
+         Real nodeEl021 = array[(block::arrayIndex(i+0,j+2,k+1))*vectorDim+l];
+         Real nodeEl221 = array[(block::arrayIndex(i+2,j+2,k+1))*vectorDim+l];
+         Real nodeEl201 = array[(block::arrayIndex(i+2,j+0,k+1))*vectorDim+l];
+         Real nodeEl012 = array[(block::arrayIndex(i+0,j+1,k+2))*vectorDim+l];
+         Real nodeEl122 = array[(block::arrayIndex(i+1,j+2,k+2))*vectorDim+l];
+         Real nodeEl212 = array[(block::arrayIndex(i+2,j+1,k+2))*vectorDim+l];
+         Real nodeEl102 = array[(block::arrayIndex(i+1,j+0,k+2))*vectorDim+l];
+         Real nodeEl002 = array[(block::arrayIndex(i+0,j+0,k+2))*vectorDim+l];
+         Real nodeEl022 = array[(block::arrayIndex(i+0,j+2,k+2))*vectorDim+l];
+         Real nodeEl202 = array[(block::arrayIndex(i+2,j+0,k+2))*vectorDim+l];
+         Real nodeEl222 = array[(block::arrayIndex(i+2,j+2,k+2))*vectorDim+l];
+         Real nodeEl000 = array[(block::arrayIndex(i+0,j+0,k+0))*vectorDim+l];
+         Real nodeEl020 = array[(block::arrayIndex(i+0,j+2,k+0))*vectorDim+l];
+         Real nodeEl200 = array[(block::arrayIndex(i+2,j+0,k+0))*vectorDim+l];
+         Real nodeEl220 = array[(block::arrayIndex(i+2,j+2,k+0))*vectorDim+l];
+         
+         // weight coefficients for each node (if the electric field value is exactly
+         // zero, the node is excluedd as it should be a boudary node)
+         bool zeroFound = false;
+         Real C111 = C1; if(nodeEl111 == initVal) { nodeEl111 = 0.0; C111 = 0.0; zeroFound = true; }
+         Real C110 = C2; if(nodeEl110 == initVal) { nodeEl110 = 0.0; C110 = 0.0; zeroFound = true; }
+         Real C011 = C2; if(nodeEl011 == initVal) { nodeEl011 = 0.0; C011 = 0.0; zeroFound = true; }
+         Real C121 = C2; if(nodeEl121 == initVal) { nodeEl121 = 0.0; C121 = 0.0; zeroFound = true; }
+         Real C211 = C2; if(nodeEl211 == initVal) { nodeEl211 = 0.0; C211 = 0.0; zeroFound = true; }
+         Real C101 = C2; if(nodeEl101 == initVal) { nodeEl101 = 0.0; C101 = 0.0; zeroFound = true; }
+         Real C112 = C2; if(nodeEl112 == initVal) { nodeEl112 = 0.0; C112 = 0.0; zeroFound = true; }
+         Real C010 = C3; if(nodeEl010 == initVal) { nodeEl010 = 0.0; C010 = 0.0; zeroFound = true; }
+         Real C100 = C3; if(nodeEl100 == initVal) { nodeEl100 = 0.0; C100 = 0.0; zeroFound = true; }
+         Real C120 = C3; if(nodeEl120 == initVal) { nodeEl120 = 0.0; C120 = 0.0; zeroFound = true; }
+         Real C210 = C3; if(nodeEl210 == initVal) { nodeEl210 = 0.0; C210 = 0.0; zeroFound = true; }
+         Real C001 = C3; if(nodeEl001 == initVal) { nodeEl001 = 0.0; C001 = 0.0; zeroFound = true; }
+         Real C021 = C3; if(nodeEl021 == initVal) { nodeEl021 = 0.0; C021 = 0.0; zeroFound = true; }
+         Real C221 = C3; if(nodeEl221 == initVal) { nodeEl221 = 0.0; C221 = 0.0; zeroFound = true; }
+         Real C201 = C3; if(nodeEl201 == initVal) { nodeEl201 = 0.0; C201 = 0.0; zeroFound = true; }
+         Real C012 = C3; if(nodeEl012 == initVal) { nodeEl012 = 0.0; C012 = 0.0; zeroFound = true; }
+         Real C122 = C3; if(nodeEl122 == initVal) { nodeEl122 = 0.0; C122 = 0.0; zeroFound = true; }
+         Real C212 = C3; if(nodeEl212 == initVal) { nodeEl212 = 0.0; C212 = 0.0; zeroFound = true; }
+         Real C102 = C3; if(nodeEl102 == initVal) { nodeEl102 = 0.0; C102 = 0.0; zeroFound = true; }
+         Real C002 = C4; if(nodeEl002 == initVal) { nodeEl002 = 0.0; C002 = 0.0; zeroFound = true; }
+         Real C022 = C4; if(nodeEl022 == initVal) { nodeEl022 = 0.0; C022 = 0.0; zeroFound = true; }
+         Real C202 = C4; if(nodeEl202 == initVal) { nodeEl202 = 0.0; C202 = 0.0; zeroFound = true; }
+         Real C222 = C4; if(nodeEl222 == initVal) { nodeEl222 = 0.0; C222 = 0.0; zeroFound = true; }
+         Real C000 = C4; if(nodeEl000 == initVal) { nodeEl000 = 0.0; C000 = 0.0; zeroFound = true; }
+         Real C020 = C4; if(nodeEl020 == initVal) { nodeEl020 = 0.0; C020 = 0.0; zeroFound = true; }
+         Real C200 = C4; if(nodeEl200 == initVal) { nodeEl200 = 0.0; C200 = 0.0; zeroFound = true; }
+         Real C220 = C4; if(nodeEl220 == initVal) { nodeEl220 = 0.0; C220 = 0.0; zeroFound = true; }
+         // renormalize if boundary node found
+         if(zeroFound == true) {
+            const Real Csum = C111+C110+C011+C121+C211+C101+C112+C010+C100+C120+C210+C001+C021+C221+C201+C012+C122+C212+C102+C002+C022+C202+C222+C000+C020+C200+C220;
+            if(Csum > 0.0) {
+               C111 /= Csum;
+               C110 /= Csum;
+               C011 /= Csum;
+               C121 /= Csum;
+               C211 /= Csum;
+               C101 /= Csum;
+               C112 /= Csum;
+               C010 /= Csum;
+               C100 /= Csum;
+               C120 /= Csum;
+               C210 /= Csum;
+               C001 /= Csum;
+               C021 /= Csum;
+               C221 /= Csum;
+               C201 /= Csum;
+               C012 /= Csum;
+               C122 /= Csum;
+               C212 /= Csum;
+               C102 /= Csum;
+               C002 /= Csum;
+               C022 /= Csum;
+               C202 /= Csum;
+               C222 /= Csum;
+               C000 /= Csum;
+               C020 /= Csum;
+               C200 /= Csum;
+               C220 /= Csum;
+            }
+         }
+	 // calculate average
+         nodeData[n+l] =
+           C111*nodeEl111 +
+           C110*nodeEl110 +
+           C011*nodeEl011 +
+           C121*nodeEl121 +
+           C211*nodeEl211 +
+           C101*nodeEl101 +
+           C112*nodeEl112 +
+           C010*nodeEl010 +
+           C100*nodeEl100 +
+           C120*nodeEl120 +
+           C210*nodeEl210 +
+           C001*nodeEl001 +
+           C021*nodeEl021 +
+           C221*nodeEl221 +
+           C201*nodeEl201 +
+           C012*nodeEl012 +
+           C122*nodeEl122 +
+           C212*nodeEl212 +
+           C102*nodeEl102 +
+           C002*nodeEl002 +
+           C022*nodeEl022 +
+           C202*nodeEl202 +
+           C222*nodeEl222 +
+           C000*nodeEl000 +
+           C020*nodeEl020 +
+           C200*nodeEl200 +
+           C220*nodeEl220;
+      }
+   }
+}
+
+// upwind nodeB using cellData and nodeUe
+template<class BLOCK>
+void generic::Kernels<BLOCK>::upwindNodeB(Real* cellB,Real* nodeUe,Real* nodeB,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID) {
+   int di=0;
+   int dj=0;
+   int dk=0;
+   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
+   }
+   const unsigned int tempArraySize = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
+   Real tempArray[tempArraySize*3];
+   fetchData(cellB,tempArray,simClasses,blockID,3);
+   for(int k=0+dk; k<block::WIDTH_Z; ++k) for(int j=0+dj; j<block::WIDTH_Y; ++j) for(int i=0+di; i<block::WIDTH_X; ++i) {
+      const int n = (blockID*block::SIZE+block::index(i,j,k))*3;
+     
+      // upwind displacement vector = (-0.5,0,0) if Ue = 0
+      Real xUpwind = -0.5;
+      Real yUpwind = 0;
+      Real zUpwind = 0;
+      
+      // upwind displacement vector = -0.5*nodeUe/|nodeUe| (dimensionaless, dx=1)
+      const Real Ue = sqrt(sqr(nodeUe[n+0]) + sqr(nodeUe[n+1]) + sqr(nodeUe[n+2]));
+      if(Ue > 0) {
+	 const Real a = -0.5/Ue;
+	 xUpwind = nodeUe[n+0]*a;
+	 yUpwind = nodeUe[n+1]*a;
+	 zUpwind = nodeUe[n+2]*a;
+      }
+      
+      // cell centroid local dimensionless coordinates
+      const Real xCell111 = -0.5; const Real yCell111 = -0.5; const Real zCell111 = -0.5;
+      const Real xCell112 = -0.5; const Real yCell112 = -0.5; const Real zCell112 = +0.5;
+      const Real xCell121 = -0.5; const Real yCell121 = +0.5; const Real zCell121 = -0.5;
+      const Real xCell211 = +0.5; const Real yCell211 = -0.5; const Real zCell211 = -0.5;
+      const Real xCell122 = -0.5; const Real yCell122 = +0.5; const Real zCell122 = +0.5;
+      const Real xCell221 = +0.5; const Real yCell221 = +0.5; const Real zCell221 = -0.5;
+      const Real xCell212 = +0.5; const Real yCell212 = -0.5; const Real zCell212 = +0.5;
+      const Real xCell222 = +0.5; const Real yCell222 = +0.5; const Real zCell222 = +0.5;
+      
+      // weighting factors for the eight cells around the node
+      const Real w111 = 1/sqrt(sqr(xCell111-xUpwind) + sqr(yCell111-yUpwind) + sqr(zCell111-zUpwind));
+      const Real w112 = 1/sqrt(sqr(xCell112-xUpwind) + sqr(yCell112-yUpwind) + sqr(zCell112-zUpwind));
+      const Real w121 = 1/sqrt(sqr(xCell121-xUpwind) + sqr(yCell121-yUpwind) + sqr(zCell121-zUpwind));
+      const Real w211 = 1/sqrt(sqr(xCell211-xUpwind) + sqr(yCell211-yUpwind) + sqr(zCell211-zUpwind));
+      const Real w122 = 1/sqrt(sqr(xCell122-xUpwind) + sqr(yCell122-yUpwind) + sqr(zCell122-zUpwind));
+      const Real w221 = 1/sqrt(sqr(xCell221-xUpwind) + sqr(yCell221-yUpwind) + sqr(zCell221-zUpwind));
+      const Real w212 = 1/sqrt(sqr(xCell212-xUpwind) + sqr(yCell212-yUpwind) + sqr(zCell212-zUpwind));
+      const Real w222 = 1/sqrt(sqr(xCell222-xUpwind) + sqr(yCell222-yUpwind) + sqr(zCell222-zUpwind));
+      const Real wsum = w111+w112+w121+w211+w122+w221+w212+w222;
+
+      if(wsum > 0) {
+	 for(int l=0;l<3;++l) {
+	    nodeB[n+l] = (w111*tempArray[(block::arrayIndex(i+1,j+1,k+1))*3+l] +
+			  w112*tempArray[(block::arrayIndex(i+1,j+1,k+2))*3+l] +
+			  w121*tempArray[(block::arrayIndex(i+1,j+2,k+1))*3+l] +
+			  w211*tempArray[(block::arrayIndex(i+2,j+1,k+1))*3+l] +
+			  w122*tempArray[(block::arrayIndex(i+1,j+2,k+2))*3+l] +
+			  w221*tempArray[(block::arrayIndex(i+2,j+2,k+1))*3+l] +
+			  w212*tempArray[(block::arrayIndex(i+2,j+1,k+2))*3+l] +
+			  w222*tempArray[(block::arrayIndex(i+2,j+2,k+2))*3+l])/wsum;
+	 }
+      }
+      else {
+	 nodeB[n+0] = nodeB[n+1] = nodeB[n+2] = 0.0;
+      }
+   }
+}
+
+// nodeJ = nabla x faceB/mu0
+template<class BLOCK>
+void generic::Kernels<BLOCK>::calcNodeJ(Real* faceB,Real* nodeB,Real* nodeRhoQi,Real* nodeJ,
+#ifdef USE_MAXVW
+Real* counterNodeMaxVw,
+#endif
+Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID)
+{
+   int di=0;
+   int dj=0;
+   int dk=0;
+   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
+   }
+   const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
+   Real Bf[size*3];
+   fetchData(faceB,Bf,simClasses,blockID,3);
+   for(int k=0+dk; k<block::WIDTH_Z; ++k) for(int j=0+dj; j<block::WIDTH_Y; ++j) for(int i=0+di; i<block::WIDTH_X; ++i) {
+      const int n = (blockID*block::SIZE+block::index(i,j,k));
+      const int n3 = n*3;
+      const Real edgeJx1 =
+        - Bf[(block::arrayIndex(i+1,j+1,k+1))*3+2]
+        + Bf[(block::arrayIndex(i+1,j+1,k+1))*3+1]
+        + Bf[(block::arrayIndex(i+1,j+2,k+1))*3+2]
+        - Bf[(block::arrayIndex(i+1,j+1,k+2))*3+1];
+      const Real edgeJx2 =
+        - Bf[(block::arrayIndex(i+2,j+1,k+1))*3+2]
+        + Bf[(block::arrayIndex(i+2,j+1,k+1))*3+1]
+        + Bf[(block::arrayIndex(i+2,j+2,k+1))*3+2]
+        - Bf[(block::arrayIndex(i+2,j+1,k+2))*3+1];
+      const Real edgeJy1 =
+        + Bf[(block::arrayIndex(i+1,j+1,k+1))*3+2]
+        + Bf[(block::arrayIndex(i+1,j+1,k+2))*3+0]
+        - Bf[(block::arrayIndex(i+2,j+1,k+1))*3+2]
+        - Bf[(block::arrayIndex(i+1,j+1,k+1))*3+0]; 
+      const Real edgeJy2 =
+        + Bf[(block::arrayIndex(i+1,j+2,k+1))*3+2]
+        + Bf[(block::arrayIndex(i+1,j+2,k+2))*3+0]
+        - Bf[(block::arrayIndex(i+2,j+2,k+1))*3+2]
+        - Bf[(block::arrayIndex(i+1,j+2,k+1))*3+0];
+      const Real edgeJz1 =
+        - Bf[(block::arrayIndex(i+1,j+1,k+1))*3+1]
+        + Bf[(block::arrayIndex(i+1,j+1,k+1))*3+0]
+        + Bf[(block::arrayIndex(i+2,j+1,k+1))*3+1]
+        - Bf[(block::arrayIndex(i+1,j+2,k+1))*3+0]; 
+      const Real edgeJz2 =
+        - Bf[(block::arrayIndex(i+1,j+1,k+2))*3+1]
+        + Bf[(block::arrayIndex(i+1,j+1,k+2))*3+0]
+        + Bf[(block::arrayIndex(i+2,j+1,k+2))*3+1]
+        - Bf[(block::arrayIndex(i+1,j+2,k+2))*3+0];
+      Real d = 1.0;
+#ifdef USE_MAXVW
+      Real vw = 0.0; // fastest whistler signal p. 28 Alho (2016)
+      const Real ne = nodeRhoQi[n]/constants::CHARGE_ELEMENTARY;
+      const Real Btot = sqrt( sqr(nodeB[n3+0]) + sqr(nodeB[n3+1]) + sqr(nodeB[n3+2]) );
+      if(ne > 0.0 && Hybrid::dx > 0.0) {
+	vw = 2.0*Btot*M_PI/( constants::PERMEABILITY*ne*constants::CHARGE_ELEMENTARY*Hybrid::dx );
+      }
+      if (vw > Hybrid::maxVw && Hybrid::maxVw > 0.0) {
+	d = vw/Hybrid::maxVw;
+	counterNodeMaxVw[n]++;
+      }
+#endif
+      const Real a = 0.5/(Hybrid::dx*constants::PERMEABILITY*d);
+      nodeJ[n3+0] = (edgeJx1 + edgeJx2)*a;
+      nodeJ[n3+1] = (edgeJy1 + edgeJy2)*a;
+      nodeJ[n3+2] = (edgeJz1 + edgeJz2)*a;
+   }
+}
+
+// faceData = curl(nodeData), doFaraday: true = Faraday's law, false = Ampere's law
+template<class BLOCK>
+void generic::Kernels<BLOCK>::faceCurl(Real* nodeData,Real* faceData,bool doFaraday,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID)
+{
+   bool doXFace=true;
+   bool doYFace=true;
+   bool doZFace=true;
+   int di=0;
+   int dj=0;
+   int dk=0;
+   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_POS_EXISTS) == 0) return;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0) { doYFace = doZFace = false; }
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0) { doXFace = doZFace = false; }
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0) { doXFace = doYFace = false; }
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
+      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
+   }
+   
+#ifdef USE_XMIN_BOUNDARY
+   bool* xMinFlag = simClasses.pargrid.getUserDataStatic<bool>(Hybrid::dataXminFlagID);
+   if(xMinFlag == NULL) {cerr << "ERROR: obtained NULL xMinFlag array!" << endl; exit(1);}
+#endif
+
+   const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
+   Real array[size*3];
+   fetchData(nodeData,array,simClasses,blockID,3);
+   
+   for(int k=0+dk; k<block::WIDTH_Z; ++k) for(int j=0+dj; j<block::WIDTH_Y; ++j) for(int i=0+di; i<block::WIDTH_X; ++i) {
+      const int n = (blockID*block::SIZE+block::index(i,j,k));
+      const int n3 = 3*n;
+#ifdef USE_XMIN_BOUNDARY
+      // no field propagation at x < xmin
+      if(xMinFlag[n] == true && doFaraday == true) { continue; }
+#endif
+
+      Real node1x = array[(block::arrayIndex(i+0,j+0,k+1))*3+0];
+      Real node1y = array[(block::arrayIndex(i+0,j+0,k+1))*3+1];
+      //Real node1z = array[(block::arrayIndex(i+0,j+0,k+1))*3+2];
+      
+      Real node3x = array[(block::arrayIndex(i+0,j+1,k+0))*3+0];
+      //Real node3y = array[(block::arrayIndex(i+0,j+1,k+0))*3+1];
+      Real node3z = array[(block::arrayIndex(i+0,j+1,k+0))*3+2];
+      
+      Real node4x = array[(block::arrayIndex(i+0,j+1,k+1))*3+0];
+      Real node4y = array[(block::arrayIndex(i+0,j+1,k+1))*3+1];
+      Real node4z = array[(block::arrayIndex(i+0,j+1,k+1))*3+2];      
+
+      Real node5x = array[(block::arrayIndex(i+1,j+0,k+1))*3+0];
+      Real node5y = array[(block::arrayIndex(i+1,j+0,k+1))*3+1];
+      Real node5z = array[(block::arrayIndex(i+1,j+0,k+1))*3+2];
+
+      //Real node6x = array[(block::arrayIndex(i+1,j+0,k+0))*3+0];
+      Real node6y = array[(block::arrayIndex(i+1,j+0,k+0))*3+1];
+      Real node6z = array[(block::arrayIndex(i+1,j+0,k+0))*3+2];
+      
+      Real node7x = array[(block::arrayIndex(i+1,j+1,k+0))*3+0];
+      Real node7y = array[(block::arrayIndex(i+1,j+1,k+0))*3+1];
+      Real node7z = array[(block::arrayIndex(i+1,j+1,k+0))*3+2];
+      
+      Real node8x = array[(block::arrayIndex(i+1,j+1,k+1))*3+0];
+      Real node8y = array[(block::arrayIndex(i+1,j+1,k+1))*3+1];
+      Real node8z = array[(block::arrayIndex(i+1,j+1,k+1))*3+2];
+      
+      if(doXFace == true) {
+	 Real curlX = 0.5*(+node5z+node6z-node6y-node7y-node7z-node8z+node8y+node5y)/Hybrid::dx;
+	 if(doFaraday == true) {
+	    faceData[n3+0] += sim.dt*curlX; // Faraday's law
+	 }
+	 else {
+	    faceData[n3+0] = -curlX/constants::PERMEABILITY; // Ampere's law
+	 }
+      }      
+      if(doYFace == true) {
+	 Real curlY = 0.5*(-node4x-node8x+node8z+node7z+node7x+node3x-node3z-node4z)/Hybrid::dx;
+	 if(doFaraday == true) {
+	    faceData[n3+1] += sim.dt*curlY;
+	 }
+	 else {
+	    faceData[n3+1] = -curlY/constants::PERMEABILITY;
+	 }
+      }
+      if(doZFace == true) {
+	 Real curlZ = 0.5*(-node1x-node5x-node5y-node8y+node8x+node4x+node4y+node1y)/Hybrid::dx;
+	 if(doFaraday == true) {
+	    faceData[n3+2] += sim.dt*curlZ;
+	 }
+	 else {
+	    faceData[n3+2] = -curlZ/constants::PERMEABILITY;
+	 }
+      }
+   }
+}
+
+// fetch ALL neighours
+template<class BLOCK>
+void generic::Kernels<BLOCK>::fetchData(Real* data,Real* array,SimulationClasses& simClasses,pargrid::CellID blockID,int vectorDim) {
+   pargrid::CellID nbrLID = simClasses.pargrid.invalid();
+   const pargrid::CellID* const nbrs = simClasses.pargrid.getCellNeighbourIDs(blockID);   
+   
+   // THIS BLOCK
+      
+   for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
+      array[block::arrayIndex(i+1,j+1,k+1)*vectorDim+l] = data[(blockID*block::SIZE+block::index(i,j,k))*vectorDim+l];
+   }
+   
+   // FACE NEIGHBOURS
+
+   // -x
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,+0,+0)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(0,j+1,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,j,k))*vectorDim+l];
+      }
+   }
+   // -y
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,-1,+0)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int k=0;k<block::WIDTH_Z;++k) for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(i+1,0,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,block::WIDTH_Y-1,k))*vectorDim+l];
+      }
+   }
+   // -z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,+0,-1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(i+1,j+1,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,j,block::WIDTH_Z-1))*vectorDim+l];
+      }
+   }
+   // +x
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,+0,+0)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(block::WIDTH_X+1,j+1,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,j,k))*vectorDim+l];
+      }
+   }
+   // +y
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,+1,+0)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int k=0;k<block::WIDTH_Z;++k) for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(i+1,block::WIDTH_Y+1,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,0,k))*vectorDim+l];
+      }
+   }
+   // +z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,+0,+1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(i+1,j+1,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,j,0))*vectorDim+l];
+      }
+   }
+      
+   // EDGE NEIGHBOURS
+
+   // -x,-y
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,-1,+0)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int k=0;k<block::WIDTH_Z;++k) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(0,0,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,block::WIDTH_Y-1,k))*vectorDim+l];
+      }
+   }
+   // +x,-y
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,-1,+0)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int k=0;k<block::WIDTH_Z;++k) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(block::WIDTH_X+1,0,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,block::WIDTH_Y-1,k))*vectorDim+l];
+      }
+   }
+   // -x,+y
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,+1,+0)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int k=0;k<block::WIDTH_Z;++k) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(0,block::WIDTH_Y+1,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,0,k))*vectorDim+l];
+      }
+   }
+   // +x,+y
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,+1,+0)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int k=0;k<block::WIDTH_Z;++k) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(block::WIDTH_X+1,block::WIDTH_Y+1,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,0,k))*vectorDim+l];
+      }
+   }
+   // -y,-z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,-1,-1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(i+1,0,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,block::WIDTH_Y-1,block::WIDTH_Z-1))*vectorDim+l];
+      }
+   }
+   // +y,-z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,+1,-1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(i+1,block::WIDTH_Y+1,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,0,block::WIDTH_Z-1))*vectorDim+l];
+      }
+   }
+   // -y,+z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,-1,+1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(i+1,0,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,block::WIDTH_Y-1,0))*vectorDim+l];
+      }
+   }
+   // +y,+z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,+1,+1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(i+1,block::WIDTH_Y+1,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,0,0))*vectorDim+l];
+      }
+   }
+   // -x,-z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,+0,-1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int j=0;j<block::WIDTH_Y;++j) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(0,j+1,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,j,block::WIDTH_Z-1))*vectorDim+l];
+      }
+   }
+   // +x,-z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,+0,-1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int j=0;j<block::WIDTH_Y;++j) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(block::WIDTH_X+1,j+1,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,j,block::WIDTH_Z-1))*vectorDim+l];
+      }
+   }
+   // -x,+z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,+0,+1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int j=0;j<block::WIDTH_Y;++j) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(0,j+1,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,j,0))*vectorDim+l];
+      }
+   }
+   // +x,+z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,+0,+1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int j=0;j<block::WIDTH_Y;++j) for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(block::WIDTH_X+1,j+1,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,j,0))*vectorDim+l];
+      }
+   }
+   
+   // CORNER NEIGHBOURS
+    
+   // -x,-y,-z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,-1,-1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(0,0,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,block::WIDTH_Y-1,block::WIDTH_Z-1))*vectorDim+l];
+      }
+   }
+   // +x,-y,-z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,-1,-1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(block::WIDTH_X+1,0,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,block::WIDTH_Y-1,block::WIDTH_Z-1))*vectorDim+l];
+      }
+   }
+   // -x,+y,-z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,+1,-1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(0,block::WIDTH_Y+1,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,0,block::WIDTH_Z-1))*vectorDim+l];
+      }
+   }
+   // +x,+y,-z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,+1,-1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(block::WIDTH_X+1,block::WIDTH_Y+1,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,0,block::WIDTH_Z-1))*vectorDim+l];
+      }
+   }
+   // -x,-y,+z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,-1,+1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(0,0,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,block::WIDTH_Y-1,0))*vectorDim+l];
+      }
+   }
+   // +x,-y,+z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,-1,+1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(block::WIDTH_X+1,0,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,block::WIDTH_Y-1,0))*vectorDim+l];
+      }
+   }
+   // -x,+y,+z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,+1,+1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(0,block::WIDTH_Y+1,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,0,0))*vectorDim+l];
+      }
+   }
+   // +x,+y,+z
+   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,+1,+1)];
+   if(nbrLID != simClasses.pargrid.invalid()) {
+      for(int l=0;l<vectorDim;++l) {
+	 array[block::arrayIndex(block::WIDTH_X+1,block::WIDTH_Y+1,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,0,0))*vectorDim+l];
+      }
+   }
+}
+
+// END copied from hybrid_propagator.cpp
+
+// synthetic ParGrid arrays of N blocks on a periodic lattice where all neighbours exist
+template<class BLOCK>
+struct BenchmarkGrid {
+   size_t N_blocks;
+   vector<generic::pargrid::CellID> nbrLIDs; // 27 local IDs per block in BLOCK::neighbourIndex order
+   vector<Real> faceB,nodeUe,nodeB,nodeB0,nodeJ,nodeJi,nodeRhoQi,nodeEta,counter;
+   vector<char> innerFlag;
+   vector<Real> out,outGeneric;
+
+   BenchmarkGrid(size_t N) : N_blocks(N),nbrLIDs(N*27),
+     faceB(N*BLOCK::SIZE*3),nodeUe(N*BLOCK::SIZE*3),nodeB(N*BLOCK::SIZE*3),nodeB0(N*BLOCK::SIZE*3),nodeJ(N*BLOCK::SIZE*3),
+     nodeJi(N*BLOCK::SIZE*3),nodeRhoQi(N*BLOCK::SIZE),nodeEta(N*BLOCK::SIZE),counter(N*BLOCK::SIZE,0.0),innerFlag(N*BLOCK::SIZE,0),
+     out(N*BLOCK::SIZE*3,0.0),outGeneric(N*BLOCK::SIZE*3,0.0) {
+      // lattice of nx*ny*nz blocks as close to a cube as N allows
+      size_t nx = 1;
+      for(size_t d=1;d*d*d<=N;++d) if(N % d == 0) nx = d;
+      size_t ny = 1;
+      for(size_t d=1;d*d<=N/nx;++d) if((N/nx) % d == 0) ny = d;
+      const size_t nz = N/(nx*ny);
+      for(size_t b=0;b<N;++b) {
+	 const size_t x = b % nx;
+	 const size_t y = (b/nx) % ny;
+	 const size_t z = b/(nx*ny);
+	 for(int k=-1;k<=1;++k) for(int j=-1;j<=1;++j) for(int i=-1;i<=1;++i) {
+	    const size_t xn = (x+nx+i) % nx;
+	    const size_t yn = (y+ny+j) % ny;
+	    const size_t zn = (z+nz+k) % nz;
+	    nbrLIDs[b*27+BLOCK::neighbourIndex(i,j,k)] = (zn*ny + yn)*nx + xn;
+	 }
+      }
+      srand(1);
+      fillRandom(faceB,1e-9,-0.5);
+      fillRandom(nodeB,1e-9,-0.5);
+      fillRandom(nodeB0,1e-9,-0.5);
+      fillRandom(nodeUe,1e5,-0.5);
+      fillRandom(nodeJ,1e-6,-0.5);
+      fillRandom(nodeJi,1e-6,-0.5);
+      fillRandom(nodeRhoQi,1e-13,1.0);
+      fillRandom(nodeEta,1e3,0.0);
+   }
+   static void fillRandom(vector<Real>& v,Real scale,Real shift) {
+      for(size_t i=0;i<v.size();++i) { v[i] = scale*(rand()/(RAND_MAX+1.0) + shift); }
+   }
+   void fetch(const vector<Real>& data,Real* array,size_t b,int vectorDim) const {
+      fieldkernels::fetchData<BLOCK>(&data[0],array,&nbrLIDs[b*27],numeric_limits<generic::pargrid::CellID>::max(),vectorDim);
+   }
+   static size_t cell(size_t b) { return b*BLOCK::SIZE; }
+
+   // largest difference between generic and templated results relative to the largest generic value
+   Real difference() const {
+      Real maxDiff = 0.0;
+      Real maxValue = 0.0;
+      for(size_t i=0;i<out.size();++i) {
+	 maxDiff = max(maxDiff,fabs(outGeneric[i]-out[i]));
+	 maxValue = max(maxValue,fabs(outGeneric[i]));
+      }
+      return maxValue > 0.0 ? maxDiff/maxValue : maxDiff;
+   }
+};
+
+// best wall time of one pass of a kernel over all blocks in seconds, short
+// passes are repeated so that each timing covers at least minCells cells
+template<class KERNEL>
+double timeKernel(KERNEL kernel,size_t N_blocks,size_t cells,int repetitions) {
+   const size_t minCells = 1 << 18;
+   const size_t passes = max(static_cast<size_t>(1),minCells/cells);
+   double best = numeric_limits<double>::max();
+   for(int r=0;r<repetitions;++r) {
+      const chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+      for(size_t p=0;p<passes;++p) for(size_t b=0;b<N_blocks;++b) { kernel(b); }
+      const double t = chrono::duration<double>(chrono::steady_clock::now()-t0).count();
+      best = min(best,t/passes);
+   }
+   return best;
+}
+
+// nominal memory traffic of a kernel per block: elements read and written once,
+// padded input counted in full, data reused from cache within the block not counted
+struct Traffic {
+   double bytes;
+   Traffic(double readReals,double writeReals,double readBytes=0.0) : bytes((readReals+writeReals)*sizeof(Real)+readBytes) { }
+};
+
+struct Benchmark {
+   int repetitions;
+   void header() const {
+      cout << setw(12) << "kernel" << setw(7) << "block" << setw(8) << "blocks" << setw(10) << "ns/cell"
+	   << setw(11) << "Mcells/s" << setw(9) << "nom GB/s" << setw(9) << "generic" << setw(12) << "difference" << endl;
+   }
+   void report(const string& name,int width,size_t N_blocks,size_t cells,double t,const Traffic& traffic,double tGeneric=-1.0,Real difference=-1.0) const {
+      cout << setw(12) << name << setw(5) << width << "^3" << setw(8) << N_blocks << fixed
+	   << setw(10) << setprecision(2) << 1e9*t/cells << setw(11) << setprecision(1) << 1e-6*cells/t
+	   << setw(9) << setprecision(2) << 1e-9*traffic.bytes*N_blocks/t;
+      if(tGeneric > 0.0) { cout << setw(8) << setprecision(2) << tGeneric/t << "x" << setw(12) << scientific << setprecision(1) << difference; }
+      else { cout << setw(9) << "-" << setw(12) << "-"; }
+      cout << defaultfloat << endl;
+   }
+   // templated kernel only
+   template<class BLOCK,class KERNEL>
+   void run(const string& name,BenchmarkGrid<BLOCK>& grid,const Traffic& traffic,KERNEL kernel) const {
+      const size_t cells = grid.N_blocks*BLOCK::SIZE;
+      report(name,BLOCK::WIDTH_X,grid.N_blocks,cells,timeKernel(kernel,grid.N_blocks,cells,repetitions),traffic);
+   }
+   // templated kernel compared with the kernel before templating
+   template<class BLOCK,class GENERIC,class KERNEL>
+   void run(const string& name,BenchmarkGrid<BLOCK>& grid,const Traffic& traffic,GENERIC generic,KERNEL kernel) const {
+      const size_t cells = grid.N_blocks*BLOCK::SIZE;
+      const double tGeneric = timeKernel(generic,grid.N_blocks,cells,repetitions);
+      const double t = timeKernel(kernel,grid.N_blocks,cells,repetitions);
+      report(name,BLOCK::WIDTH_X,grid.N_blocks,cells,t,traffic,tGeneric,grid.difference());
+   }
+};
+
+template<class BLOCK>
+void runBenchmark(const Benchmark& bench,size_t N_blocks) {
+   BenchmarkGrid<BLOCK> grid(N_blocks);
+   BenchmarkGrid<BLOCK>* g = &grid;
+   typedef generic::Kernels<BLOCK> Generic;
+   const int S = BLOCK::SIZE;
+   const int P = BLOCK::PADDED;
+   const Real C[4] = {0.2,0.1,0.02,0.01};
+   const Real initVal = numeric_limits<Real>::max();
+   const Real dx = 1e5;
+   const Real dt = 0.01;
+#ifdef USE_MAXVW
+   const Real maxVw = 0.0;
+#endif
+#ifdef USE_ECUT
+   const Real Ecut2 = 1.0;
+#endif
+   const Real minRhoQi = 1e-14;
+   const Real maxUe2 = 1e12;
+   Real* out = &grid.out[0];
+   Real* outGeneric = &grid.outGeneric[0];
+
+   // the same grid and parameters for the old kernels
+   generic::Simulation sim;
+   sim.dt = dt;
+   generic::SimulationClasses simClasses;
+   simClasses.pargrid.nbrLIDs = &grid.nbrLIDs[0];
+   simClasses.pargrid.flags.assign(N_blocks,generic::pargrid::ALL_NEIGHBOURS_EXIST);
+   simClasses.pargrid.xMinFlag = reinterpret_cast<bool*>(&grid.innerFlag[0]);
+   generic::Hybrid::dx = dx;
+#ifdef USE_MAXVW
+   generic::Hybrid::maxVw = maxVw;
+#endif
+   for(int i=0;i<4;++i) { generic::Hybrid::EfilterNodeGaussCoeffs[i] = C[i]; }
+
+   // padded array of the field solver on the stack
+   vector<Real> array(P*3);
+   Real* a = &array[0];
+   bench.run("fetchData",grid,Traffic(P*3,P*3),
+	     [&](size_t b) { g->fetch(g->faceB,a,b,3); });
+   bench.run("face2Cell",grid,Traffic(P*3,S*3),
+	     [&](size_t b) { Generic::face2Cell(&g->faceB[0],outGeneric,sim,simClasses,b); },
+	     [&](size_t b) { g->fetch(g->faceB,a,b,3); fieldkernels::face2Cell<BLOCK>(a,out+g->cell(b)*3); });
+   bench.run("cell2Node",grid,Traffic(P*3,S*3),
+	     [&](size_t b) { Generic::cell2Node(&g->nodeB[0],outGeneric,sim,simClasses,b,3); },
+	     [&](size_t b) { g->fetch(g->nodeB,a,b,3); fieldkernels::cell2Node<BLOCK,3,true>(a,out+g->cell(b)*3,0,0,0); });
+   bench.run("node2Cell",grid,Traffic(P*3,S*3),
+	     [&](size_t b) { Generic::node2Cell(&g->nodeB[0],outGeneric,sim,simClasses,b); },
+	     [&](size_t b) { g->fetch(g->nodeB,a,b,3); fieldkernels::node2Cell<BLOCK>(a,out+g->cell(b)*3); });
+   bench.run("nodeAvg",grid,Traffic(P*3,S*3),
+	     [&](size_t b) { Generic::nodeAvg(&g->nodeB[0],outGeneric,sim,simClasses,b,3); },
+	     [&](size_t b) { g->fetch(g->nodeB,a,b,3); fieldkernels::nodeAvg<BLOCK,3,true>(a,out+g->cell(b)*3,C,initVal,0,0,0); });
+   bench.run("upwindNodeB",grid,Traffic(P*3+S*3,S*3),
+	     [&](size_t b) { Generic::upwindNodeB(&g->faceB[0],&g->nodeUe[0],outGeneric,sim,simClasses,b); },
+	     [&](size_t b) { g->fetch(g->faceB,a,b,3); fieldkernels::upwindNodeB<BLOCK,true>(a,&g->nodeUe[g->cell(b)*3],out+g->cell(b)*3,0,0,0); });
+#ifdef USE_MAXVW
+   const Traffic trafficJ(P*3+S*4,S*3);
+#else
+   const Traffic trafficJ(P*3,S*3);
+#endif
+   bench.run("calcNodeJ",grid,trafficJ,
+	     [&](size_t b) {
+		Generic::calcNodeJ(&g->faceB[0],&g->nodeB[0],&g->nodeRhoQi[0],outGeneric,
+#ifdef USE_MAXVW
+				   &g->counter[0],
+#endif
+				   sim,simClasses,b);
+	     },
+	     [&](size_t b) {
+		g->fetch(g->faceB,a,b,3);
+		fieldkernels::calcNodeJ<BLOCK,true>(a,&g->nodeB[g->cell(b)*3],&g->nodeRhoQi[g->cell(b)],out+g->cell(b)*3,
+#ifdef USE_MAXVW
+						    &g->counter[g->cell(b)],maxVw,
+#endif
+						    dx,0,0,0);
+	     });
+   bench.run("calcNodeUe",grid,Traffic(S*7,S*3,S*sizeof(bool)),
+	     [&](size_t b) {
+		fieldkernels::calcNodeUe<BLOCK,true>(&g->nodeRhoQi[g->cell(b)],&g->nodeJi[g->cell(b)*3],&g->nodeJ[g->cell(b)*3],out+g->cell(b)*3,
+						     reinterpret_cast<const bool*>(&g->innerFlag[g->cell(b)]),&g->counter[g->cell(b)],
+						     minRhoQi,maxUe2,true,0,0,0);
+	     });
+   int readE = 6;
+#ifdef USE_B_CONSTANT
+   readE += 3;
+#endif
+#ifdef USE_RESISTIVITY
+   readE += 4;
+#endif
+   bench.run("calcNodeE",grid,Traffic(S*readE,S*3),
+	     [&](size_t b) {
+		fieldkernels::calcNodeE<BLOCK,true>(&g->nodeUe[g->cell(b)*3],&g->nodeB[g->cell(b)*3],
+#ifdef USE_B_CONSTANT
+						    &g->nodeB0[g->cell(b)*3],
+#endif
+#ifdef USE_RESISTIVITY
+						    &g->nodeEta[g->cell(b)],
+#endif
+						    &g->nodeJ[g->cell(b)*3],out+g->cell(b)*3,
+#ifdef USE_ECUT
+						    &g->counter[g->cell(b)],Ecut2,
+#endif
+						    0,0,0);
+	     });
+   // Faraday's law accumulates to faceData, start both from zero
+   fill(grid.out.begin(),grid.out.end(),0.0);
+   fill(grid.outGeneric.begin(),grid.outGeneric.end(),0.0);
+#ifdef USE_XMIN_BOUNDARY
+   const bool* xMinFlag = reinterpret_cast<const bool*>(&grid.innerFlag[0]);
+   const Traffic trafficCurl(P*3+S*3,S*3,S*sizeof(bool));
+#else
+   const Traffic trafficCurl(P*3+S*3,S*3);
+#endif
+   bench.run("faceCurl",grid,trafficCurl,
+	     [&](size_t b) { Generic::faceCurl(&g->nodeB[0],outGeneric,true,sim,simClasses,b); },
+	     [&](size_t b) {
+		g->fetch(g->nodeB,a,b,3);
+		fieldkernels::faceCurl<BLOCK,true>(a,out+g->cell(b)*3,true,dt,dx,
+#ifdef USE_XMIN_BOUNDARY
+						   xMinFlag+g->cell(b),
+#endif
+						   true,true,true,0,0,0);
+	     });
+}
+
+// all kernels for the given number of blocks of each width
+void runBenchmarks(const Benchmark& bench,size_t N_blocks) {
+   runBenchmark<fieldkernels::BlockLayout<2,2,2> >(bench,N_blocks);
+   runBenchmark<fieldkernels::BlockLayout<4,4,4> >(bench,N_blocks);
+   runBenchmark<fieldkernels::BlockLayout<8,8,8> >(bench,N_blocks);
+}
+
+int main(int argn,char* args[]) {
+   Benchmark bench;
+   bench.repetitions = (argn > 1) ? atoi(args[1]) : 10;
+   vector<size_t> blockCounts;
+   for(int i=2;i<argn;++i) { blockCounts.push_back(atol(args[i])); }
+   if(blockCounts.empty() == true) {
+      blockCounts.push_back(8);
+      blockCounts.push_back(64);
+      blockCounts.push_back(512);
+   }
+   if(bench.repetitions < 1) {
+      cerr << "Usage: field_kernels_benchmark [repetitions] [blocks ...]" << endl;
+      return 1;
+   }
+   cout << "Field kernels: best of " << bench.repetitions << " repetitions, " << sizeof(Real) << " byte Real" << endl;
+   cout << "nom GB/s is the nominal traffic of each kernel, its input and output arrays read and written once" << endl;
+   cout << "per block, not measured memory bandwidth. With few blocks all arrays stay in cache." << endl;
+   cout << "Stencil kernels include fetchData. generic is the speedup over the kernels before templating," << endl;
+   cout << "difference the largest relative difference of their results." << endl << endl;
+   bench.header();
+   for(size_t i=0;i<blockCounts.size();++i) {
+      if(blockCounts[i] == 0) { continue; }
+      runBenchmarks(bench,blockCounts[i]);
+   }
+   return 0;
+}
@@ -0,0 +1,432 @@
+/** This file is part of the RHybrid simulation.
+ *
+ *  Copyright 2015- Finnish Meteorological Institute
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <map>
+
+#include "hybrid.h"
+#include "halo_exchange.h"
+
+using namespace std;
+
+// message tags of a batch, each batch has its own communicator
+static const int TAG_IDS     = 0;
+static const int TAG_DATA    = 1;
+static const int TAG_READY   = 2;
+static const int TAG_ACK     = 3;
+static const int TAG_OFFSETS = 4;
+
+bool HaloExchange::sharedMemory = false;
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+MPI_Comm HaloExchange::nodeComm = MPI_COMM_NULL;
+vector<int> HaloExchange::nodeRanks;
+#endif
+
+HaloExchange::HaloExchange() {
+   initialized = false;
+   packedElements = 0;
+   comm = MPI_COMM_NULL;
+   partition = numeric_limits<unsigned int>::max();
+   parity = 0;
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   windowAllocated = false;
+   windowBase = NULL;
+#endif
+}
+
+/** Remove the owner array and free the communicator and shared memory window of the batch.
+ * Collective over all processes.
+ * @param simClasses Generic simulation classes.
+ * @return If true, the batch was finalized successfully.*/
+bool HaloExchange::finalize(SimulationClasses& simClasses) {
+   if(initialized == false) { return true; }
+   bool success = true;
+   if(simClasses.pargrid.removeUserData(ownerID) == false) { success = false; }
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   if(waitAcks() == false) { success = false; }
+   freeWindow();
+#endif
+   MPI_Comm_free(&comm);
+   vector<Real>().swap(sendBuffer);
+   vector<Real>().swap(recvBuffer);
+   initialized = false;
+   return success;
+}
+
+/** Create the owner array and the communicator of the batch. Collective over all processes.
+ * @param simClasses Generic simulation classes.
+ * @param name Name of the batch, the owner array is called name+"Owner".
+ * @param stencilID ParGrid stencil used in exchanges.
+ * @param dataIDs ParGrid IDs of static Real arrays exchanged together.
+ * @return If true, the batch was initialized successfully.*/
+bool HaloExchange::initialize(SimulationClasses& simClasses,const std::string& name,pargrid::StencilID stencilID,
+			      const std::vector<pargrid::DataID>& dataIDs) {
+   initialized = true;
+   this->stencilID = stencilID;
+   this->dataIDs = dataIDs;
+   offsets.resize(dataIDs.size());
+   packedElements = 0;
+   for(size_t a=0; a<dataIDs.size(); ++a) {
+      offsets[a] = packedElements;
+      packedElements += simClasses.pargrid.getUserDataStaticElements(dataIDs[a]);
+   }
+   ownerID = simClasses.pargrid.addUserData<int>(name+"Owner",1);
+   if(ownerID == simClasses.pargrid.invalidDataID()) {
+      simClasses.logger << "(RHYBRID) ERROR: Failed to add " << name << "Owner array to ParGrid!" << endl << write;
+      initialized = false;
+      return initialized;
+   }
+   if(simClasses.pargrid.addDataTransfer(ownerID,stencilID) == false) {
+      simClasses.logger << "(RHYBRID) ERROR: Failed to add " << name << "Owner data transfer!" << endl << write;
+      initialized = false;
+   }
+   // messages of the batch cannot be mixed up with other messages
+   MPI_Comm_dup(simClasses.pargrid.getComm(),&comm);
+   return initialized;
+}
+
+/** Pack local boundary blocks of all arrays and start the exchange. Neighbour lists are
+ * rebuilt first if the grid has been repartitioned.
+ * @param simClasses Generic simulation classes.
+ * @return If true, the exchange was started successfully.*/
+bool HaloExchange::start(SimulationClasses& simClasses) {
+   if(initialized == false) { return initialized; }
+   bool success = true;
+   if(partition != Hybrid::partitionCounter) {
+      if(buildNeighbourLists(simClasses) == false) { success = false; }
+   }
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   // The buffer of this parity was read by on-node receivers two exchanges ago:
+   if(acks[parity].size() > 0) {
+      if(MPI_Waitall(acks[parity].size(),&(acks[parity][0]),MPI_STATUSES_IGNORE) != MPI_SUCCESS) { success = false; }
+      acks[parity].clear();
+   }
+#endif
+   const size_t N_recvs = recvRanks.size();
+   for(size_t r=0; r<N_recvs; ++r) {
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+      if(recvShared[r] != 0) {
+	 MPI_Irecv(NULL,0,MPI_BYTE,recvRanks[r],TAG_READY,comm,&(requests[r]));
+	 continue;
+      }
+#endif
+      MPI_Irecv(&(recvBuffer[0])+static_cast<size_t>(recvOffsets[r])*packedElements,(recvOffsets[r+1]-recvOffsets[r])*packedElements,
+		MPI_Type<Real>(),recvRanks[r],TAG_DATA,comm,&(requests[r]));
+   }
+   Real* buffer = sendBase();
+   for(size_t a=0; a<dataIDs.size(); ++a) {
+      const Real* data = simClasses.pargrid.getUserDataStatic<Real>(dataIDs[a]);
+      const unsigned int N = simClasses.pargrid.getUserDataStaticElements(dataIDs[a]);
+      const unsigned int offset = offsets[a];
+      #ifdef _OPENMP
+	 #pragma omp parallel for schedule(static)
+      #endif
+      for(size_t i=0; i<sendBlocks.size(); ++i) {
+	 const pargrid::CellID b = sendBlocks[i];
+	 for(unsigned int e=0; e<N; ++e) { buffer[i*packedElements+offset+e] = data[b*N+e]; }
+      }
+   }
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   if(windowAllocated == true) { MPI_Win_sync(window); }
+#endif
+   for(size_t s=0; s<sendRanks.size(); ++s) {
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+      if(sendShared[s] != 0) {
+	 // on-node receiver copies from the window when notified, and acknowledges when done
+	 MPI_Isend(NULL,0,MPI_BYTE,sendRanks[s],TAG_READY,comm,&(requests[N_recvs+s]));
+	 acks[parity].push_back(MPI_REQUEST_NULL);
+	 MPI_Irecv(NULL,0,MPI_BYTE,sendRanks[s],TAG_ACK,comm,&(acks[parity].back()));
+	 continue;
+      }
+#endif
+      MPI_Isend(buffer+static_cast<size_t>(sendOffsets[s])*packedElements,(sendOffsets[s+1]-sendOffsets[s])*packedElements,
+		MPI_Type<Real>(),sendRanks[s],TAG_DATA,comm,&(requests[N_recvs+s]));
+   }
+   return success;
+}
+
+/** Wait for the exchange and unpack remote blocks to all arrays.
+ * @param simClasses Generic simulation classes.
+ * @return If true, the exchange completed successfully.*/
+bool HaloExchange::wait(SimulationClasses& simClasses) {
+   if(initialized == false) { return initialized; }
+   bool success = true;
+   if(requests.size() > 0) {
+      if(MPI_Waitall(requests.size(),&(requests[0]),MPI_STATUSES_IGNORE) != MPI_SUCCESS) { success = false; }
+   }
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   if(windowAllocated == true) { MPI_Win_sync(window); }
+#endif
+   // Remote blocks are copied to their ghost slots, also when the source is a peer's shared
+   // window. Field kernels read neighbours through fetchData, which indexes ParGrid arrays
+   // by the neighbour local IDs of ghost blocks. Reading peer windows in place would need a
+   // per-block pointer table in fetchData and in every kernel that calls it.
+   const vector<const Real*>& sources = recvSources[parity];
+   for(size_t a=0; a<dataIDs.size(); ++a) {
+      Real* data = simClasses.pargrid.getUserDataStatic<Real>(dataIDs[a]);
+      const unsigned int N = simClasses.pargrid.getUserDataStaticElements(dataIDs[a]);
+      const unsigned int offset = offsets[a];
+      #ifdef _OPENMP
+	 #pragma omp parallel for schedule(static)
+      #endif
+      for(size_t i=0; i<recvBlocks.size(); ++i) {
+	 const pargrid::CellID b = recvBlocks[i];
+	 const Real* source = sources[i] + offset;
+	 for(unsigned int e=0; e<N; ++e) { data[b*N+e] = source[e]; }
+      }
+   }
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   for(size_t r=0; r<recvRanks.size(); ++r) {
+      if(recvShared[r] == 0) { continue; }
+      acks[parity].push_back(MPI_REQUEST_NULL);
+      MPI_Isend(NULL,0,MPI_BYTE,recvRanks[r],TAG_ACK,comm,&(acks[parity].back()));
+   }
+#endif
+   // Next exchange writes to the other buffer, so that slower receivers can still read this one
+   parity = 1 - parity;
+   return success;
+}
+
+// Send buffer of the current parity
+Real* HaloExchange::sendBase() {
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   if(windowAllocated == true) { return windowBase + static_cast<size_t>(parity)*sendBlocks.size()*packedElements; }
+#endif
+   return &(sendBuffer[0]);
+}
+
+/** Find the owners of remote blocks on the stencil and the local boundary blocks requested
+ * by each neighbour process. Collective over all processes.
+ * @param simClasses Generic simulation classes.
+ * @return If true, all requested blocks were found.*/
+bool HaloExchange::buildNeighbourLists(SimulationClasses& simClasses) {
+   bool success = true;
+   partition = Hybrid::partitionCounter;
+   parity = 0;
+   int N_processes,myRank;
+   MPI_Comm_size(comm,&N_processes);
+   MPI_Comm_rank(comm,&myRank);
+   const pargrid::CellID N_localBlocks = simClasses.pargrid.getNumberOfLocalCells();
+   const pargrid::CellID N_allBlocks = simClasses.pargrid.getNumberOfAllCells();
+   const vector<pargrid::CellID>& globalIDs = simClasses.pargrid.getGlobalIDs();
+
+   // Remote blocks on the stencil get the rank of their owner, others stay negative:
+   int* owner = simClasses.pargrid.getUserDataStatic<int>(ownerID);
+   for(pargrid::CellID b=0; b<N_localBlocks; ++b) { owner[b] = myRank; }
+   for(pargrid::CellID b=N_localBlocks; b<N_allBlocks; ++b) { owner[b] = -1; }
+   if(simClasses.pargrid.startNeighbourExchange(stencilID,ownerID) == false) { success = false; }
+   if(simClasses.pargrid.wait(stencilID,ownerID) == false) { success = false; }
+
+   // Remote blocks are received in the order of owners:
+   vector<pair<int,pargrid::CellID> > remote;
+   for(pargrid::CellID b=N_localBlocks; b<N_allBlocks; ++b) {
+      if(owner[b] >= 0) { remote.push_back(make_pair(owner[b],b)); }
+   }
+   sort(remote.begin(),remote.end());
+   recvRanks.clear();
+   recvOffsets.clear();
+   recvBlocks.resize(remote.size());
+   vector<int> requestCounts(N_processes,0);
+   vector<unsigned long long> requestIDs(remote.size()+1);
+   for(size_t r=0; r<remote.size(); ++r) {
+      if(r == 0 || remote[r].first != remote[r-1].first) {
+	 recvRanks.push_back(remote[r].first);
+	 recvOffsets.push_back(r);
+      }
+      recvBlocks[r] = remote[r].second;
+      requestIDs[r] = globalIDs[remote[r].second];
+      ++requestCounts[remote[r].first];
+   }
+   recvOffsets.push_back(remote.size());
+
+   // Owners get the global IDs of requested blocks:
+   vector<int> sendCounts(N_processes,0);
+   MPI_Alltoall(&(requestCounts[0]),1,MPI_INT,&(sendCounts[0]),1,MPI_INT,comm);
+   sendRanks.clear();
+   sendOffsets.assign(1,0);
+   for(int p=0; p<N_processes; ++p) {
+      if(sendCounts[p] == 0) { continue; }
+      sendRanks.push_back(p);
+      sendOffsets.push_back(sendOffsets.back()+sendCounts[p]);
+   }
+   vector<unsigned long long> sendIDs(sendOffsets.back()+1);
+   requests.resize(sendRanks.size()+recvRanks.size());
+   for(size_t s=0; s<sendRanks.size(); ++s) {
+      MPI_Irecv(&(sendIDs[sendOffsets[s]]),sendOffsets[s+1]-sendOffsets[s],MPI_UNSIGNED_LONG_LONG,sendRanks[s],TAG_IDS,comm,&(requests[s]));
+   }
+   for(size_t r=0; r<recvRanks.size(); ++r) {
+      MPI_Isend(&(requestIDs[recvOffsets[r]]),recvOffsets[r+1]-recvOffsets[r],MPI_UNSIGNED_LONG_LONG,recvRanks[r],TAG_IDS,comm,&(requests[sendRanks.size()+r]));
+   }
+   if(requests.size() > 0) { MPI_Waitall(requests.size(),&(requests[0]),MPI_STATUSES_IGNORE); }
+
+   // Requested blocks are boundary blocks of this process:
+   map<unsigned long long,pargrid::CellID> boundaryIDs;
+   const vector<pargrid::CellID>& boundaryBlocks = simClasses.pargrid.getBoundaryCells(stencilID);
+   for(size_t bb=0; bb<boundaryBlocks.size(); ++bb) { boundaryIDs[globalIDs[boundaryBlocks[bb]]] = boundaryBlocks[bb]; }
+   sendBlocks.resize(sendOffsets.back());
+   for(size_t i=0; i<sendBlocks.size(); ++i) {
+      map<unsigned long long,pargrid::CellID>::const_iterator it = boundaryIDs.find(sendIDs[i]);
+      if(it == boundaryIDs.end()) {
+	 simClasses.logger << "(RHYBRID) ERROR: Requested block " << sendIDs[i] << " is not a boundary block of this process" << endl << write;
+	 sendBlocks[i] = 0;
+	 success = false;
+	 continue;
+      }
+      sendBlocks[i] = it->second;
+   }
+   recvBuffer.resize(recvBlocks.size()*packedElements+1);
+   for(int p=0; p<2; ++p) {
+      recvSources[p].resize(recvBlocks.size());
+      for(size_t i=0; i<recvBlocks.size(); ++i) { recvSources[p][i] = &(recvBuffer[0]) + i*packedElements; }
+   }
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   if(sharedMemory == true) {
+      if(buildWindow() == false) { success = false; }
+      return success;
+   }
+#endif
+   sendBuffer.resize(sendBlocks.size()*packedElements+1);
+   return success;
+}
+
+/** Free the node communicator used by shared memory exchanges.
+ * @return If true, finalization completed successfully.*/
+bool HaloExchange::finalizeSharedMemory() {
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   if(nodeComm != MPI_COMM_NULL) { MPI_Comm_free(&nodeComm); }
+   nodeRanks.clear();
+   sharedMemory = false;
+#endif
+   return true;
+}
+
+/** Create the communicator of processes that share memory with this process. Exchanges
+ * with neighbours on the same node then go through shared memory windows and exchanges
+ * with other neighbours through messages. Must be called by all processes before
+ * batches are initialized.
+ * @param simClasses Generic simulation classes.
+ * @return If true, initialization completed successfully.*/
+bool HaloExchange::initializeSharedMemory(SimulationClasses& simClasses) {
+   sharedMemory = false;
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   MPI_Comm gridComm = simClasses.pargrid.getComm();
+   if(MPI_Comm_split_type(gridComm,MPI_COMM_TYPE_SHARED,0,MPI_INFO_NULL,&nodeComm) != MPI_SUCCESS) {
+      simClasses.logger << "(RHYBRID) ERROR: Failed to create shared memory communicator" << endl << write;
+      return false;
+   }
+   int N_processes,N_nodeProcesses;
+   MPI_Comm_size(gridComm,&N_processes);
+   MPI_Comm_size(nodeComm,&N_nodeProcesses);
+
+   // Rank of each process in nodeComm, processes on other nodes get a negative rank:
+   MPI_Group gridGroup,nodeGroup;
+   MPI_Comm_group(gridComm,&gridGroup);
+   MPI_Comm_group(nodeComm,&nodeGroup);
+   vector<int> gridRanks(N_processes);
+   for(int p=0; p<N_processes; ++p) { gridRanks[p] = p; }
+   nodeRanks.resize(N_processes);
+   MPI_Group_translate_ranks(gridGroup,N_processes,&(gridRanks[0]),nodeGroup,&(nodeRanks[0]));
+   for(int p=0; p<N_processes; ++p) { if(nodeRanks[p] == MPI_UNDEFINED) { nodeRanks[p] = -1; } }
+   MPI_Group_free(&gridGroup);
+   MPI_Group_free(&nodeGroup);
+
+   sharedMemory = (N_nodeProcesses > 1);
+   if(sharedMemory == true) {
+      simClasses.logger << "(RHYBRID) Halo exchanges with " << N_nodeProcesses-1 << " processes on this node through shared memory windows" << endl << write;
+   } else {
+      simClasses.logger << "(RHYBRID) Halo exchanges through messages, no other processes on this node" << endl << write;
+   }
+#endif
+   return true;
+}
+
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+/** Allocate the shared memory window of both send buffers and find the window addresses
+ * of blocks received from on-node neighbours. Collective over all processes.
+ * @return If true, the window was built successfully.*/
+bool HaloExchange::buildWindow() {
+   bool success = waitAcks();
+   freeWindow();
+
+   sendShared.resize(sendRanks.size());
+   recvShared.resize(recvRanks.size());
+   for(size_t s=0; s<sendRanks.size(); ++s) { sendShared[s] = (nodeRanks[sendRanks[s]] >= 0); }
+   for(size_t r=0; r<recvRanks.size(); ++r) { recvShared[r] = (nodeRanks[recvRanks[r]] >= 0); }
+
+   const MPI_Aint windowSize = static_cast<MPI_Aint>(2*sendBlocks.size())*packedElements*sizeof(Real);
+   MPI_Win_allocate_shared(windowSize,sizeof(Real),MPI_INFO_NULL,nodeComm,&windowBase,&window);
+   MPI_Win_lock_all(MPI_MODE_NOCHECK,window);
+   windowAllocated = true;
+
+   // On-node receivers get the offset of their blocks in the sender's buffer and the size of one buffer:
+   vector<unsigned long long> sendInfo(2*sendRanks.size()+1);
+   vector<unsigned long long> recvInfo(2*recvRanks.size()+1);
+   vector<MPI_Request> infoRequests;
+   for(size_t s=0; s<sendRanks.size(); ++s) {
+      if(sendShared[s] == 0) { continue; }
+      sendInfo[2*s+0] = sendOffsets[s];
+      sendInfo[2*s+1] = sendBlocks.size();
+      infoRequests.push_back(MPI_REQUEST_NULL);
+      MPI_Isend(&(sendInfo[2*s]),2,MPI_UNSIGNED_LONG_LONG,sendRanks[s],TAG_OFFSETS,comm,&(infoRequests.back()));
+   }
+   for(size_t r=0; r<recvRanks.size(); ++r) {
+      if(recvShared[r] == 0) { continue; }
+      infoRequests.push_back(MPI_REQUEST_NULL);
+      MPI_Irecv(&(recvInfo[2*r]),2,MPI_UNSIGNED_LONG_LONG,recvRanks[r],TAG_OFFSETS,comm,&(infoRequests.back()));
+   }
+   if(infoRequests.size() > 0) {
+      if(MPI_Waitall(infoRequests.size(),&(infoRequests[0]),MPI_STATUSES_IGNORE) != MPI_SUCCESS) { success = false; }
+   }
+
+   for(size_t r=0; r<recvRanks.size(); ++r) {
+      if(recvShared[r] == 0) { continue; }
+      Real* peerBase = NULL;
+      MPI_Aint size;
+      int dispUnit;
+      MPI_Win_shared_query(window,nodeRanks[recvRanks[r]],&size,&dispUnit,&peerBase);
+      for(unsigned int i=recvOffsets[r]; i<recvOffsets[r+1]; ++i) {
+	 const size_t index = recvInfo[2*r+0] + (i-recvOffsets[r]);
+	 recvSources[0][i] = peerBase + index*packedElements;
+	 recvSources[1][i] = peerBase + (recvInfo[2*r+1]+index)*packedElements;
+      }
+   }
+   return success;
+}
+
+void HaloExchange::freeWindow() {
+   if(windowAllocated == false) { return; }
+   MPI_Win_unlock_all(window);
+   MPI_Win_free(&window);
+   windowBase = NULL;
+   windowAllocated = false;
+}
+
+/** Wait for outstanding acknowledgements of on-node receivers of both buffers.
+ * @return If true, all acknowledgements completed successfully.*/
+bool HaloExchange::waitAcks() {
+   bool success = true;
+   for(int p=0; p<2; ++p) {
+      if(acks[p].size() == 0) { continue; }
+      if(MPI_Waitall(acks[p].size(),&(acks[p][0]),MPI_STATUSES_IGNORE) != MPI_SUCCESS) { success = false; }
+      acks[p].clear();
+   }
+   return success;
+}
+#endif
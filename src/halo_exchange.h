@@ -0,0 +1,97 @@
+/** This file is part of the RHybrid simulation.
+ *
+ *  Copyright 2015- Finnish Meteorological Institute
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HALO_EXCHANGE_H
+#define HALO_EXCHANGE_H
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <mpi.h>
+
+#include <definitions.h>
+#include <simulationclasses.h>
+
+/** Batched neighbour exchange of several static Real arrays on the same stencil.
+ * Local boundary blocks of all arrays are packed into one send buffer per neighbour
+ * process and remote blocks are unpacked from one receive buffer per neighbour, so that
+ * each neighbour process receives a single message per batch instead of one message
+ * per array. The buffers only hold the sent boundary blocks and the received remote
+ * blocks. Neighbour lists are built with one ParGrid exchange of block owners, and
+ * rebuilt when Hybrid::partitionCounter changes.
+ *
+ * With USE_SHARED_MEMORY_EXCHANGE, the send buffer is a double buffered MPI-3 shared
+ * memory window. Neighbours on the same node copy their remote blocks from the window
+ * into their ghost blocks after a zero-byte ready message and acknowledge with another
+ * zero-byte message when they are done, neighbours on other nodes receive the same
+ * buffer as messages.*/
+class HaloExchange {
+ public:
+   HaloExchange();
+
+   bool finalize(SimulationClasses& simClasses);
+   bool initialize(SimulationClasses& simClasses,const std::string& name,pargrid::StencilID stencilID,
+		   const std::vector<pargrid::DataID>& dataIDs);
+   bool start(SimulationClasses& simClasses);
+   bool wait(SimulationClasses& simClasses);
+
+   static bool finalizeSharedMemory();
+   static bool initializeSharedMemory(SimulationClasses& simClasses);
+   static bool sharedMemory;                 /**< If true, some neighbours may be reached through shared memory.*/
+
+ private:
+   bool initialized;
+   pargrid::StencilID stencilID;
+   pargrid::DataID ownerID;                  /**< ParGrid ID of the owner process of each block.*/
+   MPI_Comm comm;                            /**< Duplicate of ParGrid communicator used by this batch.*/
+   unsigned int partition;                   /**< Value of Hybrid::partitionCounter when neighbour lists were built.*/
+   int parity;                               /**< Which one of the two send buffers is used.*/
+   std::vector<pargrid::DataID> dataIDs;     /**< ParGrid IDs of the packed arrays.*/
+   std::vector<unsigned int> offsets;        /**< Offset of each packed array in a packed block.*/
+   unsigned int packedElements;              /**< Number of elements per packed block.*/
+   std::vector<int> sendRanks;               /**< Processes that receive local boundary blocks.*/
+   std::vector<unsigned int> sendOffsets;    /**< Offset of each process' blocks in sendBlocks, size N_sendRanks+1.*/
+   std::vector<pargrid::CellID> sendBlocks;  /**< Local IDs of sent boundary blocks.*/
+   std::vector<int> recvRanks;               /**< Owners of remote blocks.*/
+   std::vector<unsigned int> recvOffsets;    /**< Offset of each owner's blocks in recvBlocks, size N_recvRanks+1.*/
+   std::vector<pargrid::CellID> recvBlocks;  /**< Local IDs of received remote blocks.*/
+   std::vector<const Real*> recvSources[2];  /**< Packed data of each received block for both parities.*/
+   std::vector<Real> sendBuffer;             /**< Packed sent blocks if there is no shared memory window.*/
+   std::vector<Real> recvBuffer;             /**< Packed blocks received as messages.*/
+   std::vector<MPI_Request> requests;        /**< Receives followed by sends of the current exchange.*/
+
+   bool buildNeighbourLists(SimulationClasses& simClasses);
+   Real* sendBase();
+
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   static MPI_Comm nodeComm;                 /**< Communicator of processes sharing memory.*/
+   static std::vector<int> nodeRanks;        /**< Rank in nodeComm of each process, negative if on another node.*/
+   MPI_Win window;                           /**< Shared memory window of both send buffers.*/
+   bool windowAllocated;
+   Real* windowBase;                         /**< Base address of this process' window.*/
+   std::vector<char> sendShared;             /**< If nonzero, send rank is on this node.*/
+   std::vector<char> recvShared;             /**< If nonzero, receive rank is on this node.*/
+   std::vector<MPI_Request> acks[2];         /**< Acknowledgements of on-node receivers for both parities.*/
+
+   bool buildWindow();
+   void freeWindow();
+   bool waitAcks();
+#endif
+};
+
+#endif
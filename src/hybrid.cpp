@@ -26,6 +26,9 @@ using namespace std;
 // face data
 pargrid::DataID Hybrid::dataFaceBID;
 pargrid::DataID Hybrid::dataFaceJID;
+#ifdef USE_B0_INTERPOLATION
+pargrid::DataID Hybrid::dataFaceB0ID;
+#endif
 
 // cell data
 pargrid::DataID Hybrid::dataCellRhoQiID;
@@ -35,6 +38,9 @@ pargrid::DataID Hybrid::dataCellUeID;
 pargrid::DataID Hybrid::dataCellJiID;
 pargrid::DataID Hybrid::dataCellIonosphereID;
 pargrid::DataID Hybrid::dataCellExosphereID;
+#ifdef USE_B_CONSTANT
+pargrid::DataID Hybrid::dataCellB0ID;
+#endif
 
 // node data
 pargrid::DataID Hybrid::dataNodeRhoQiID;
@@ -47,6 +53,9 @@ pargrid::DataID Hybrid::dataNodeJiID;
 #ifdef USE_RESISTIVITY
 pargrid::DataID Hybrid::dataNodeEtaID;
 #endif
+#ifdef USE_B_CONSTANT
+pargrid::DataID Hybrid::dataNodeB0ID;
+#endif
 
 // counters
 pargrid::DataID Hybrid::dataCounterCellMaxUeID;
@@ -59,6 +68,10 @@ pargrid::DataID Hybrid::dataCounterNodeEcutID;
 pargrid::DataID Hybrid::dataCounterNodeMaxVwID;
 #endif
 
+#ifdef USE_FIELD_CACHE
+pargrid::DataID Hybrid::dataFieldCacheID;
+#endif
+
 // stencils
 pargrid::StencilID Hybrid::accumulationStencilID;
 
@@ -92,6 +105,8 @@ uint32_t Hybrid::Z_POS_EXISTS;
 uint32_t Hybrid::Z_NEG_EXISTS;
 
 int Hybrid::logInterval;
+int Hybrid::particleSortInterval;
+uint32_t Hybrid::randomSeed;
 bool Hybrid::includeInnerCellsInFieldLog;
 Real Hybrid::dx;
 Box Hybrid::box;
@@ -116,6 +131,10 @@ Real Hybrid::Ecut2;
 Real Hybrid::maxVw;
 #endif
 bool Hybrid::useHallElectricField;
+bool Hybrid::batchedParticlePush;
+int Hybrid::N_threads;
+unsigned int Hybrid::partitionCounter = 0;
+vector<pargrid::CellID> Hybrid::partitionGlobalIDs;
 Real Hybrid::swMacroParticlesCellPerDt;
 int Hybrid::Efilter;
 Real Hybrid::EfilterNodeGaussSigma;
@@ -145,6 +164,7 @@ Real Hybrid::yDip;
 Real Hybrid::zDip;
 Real Hybrid::thetaDip;
 Real Hybrid::phiDip;
+Real Hybrid::dipRotation[9];
 void (*Hybrid::magneticFieldProfilePtr)(const Real x,const Real y,const Real z,Real B[3]);
 #endif
 // total number of particle populations
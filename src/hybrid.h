@@ -30,6 +30,19 @@
 #define vecsqr(a) (sqr(a[0])+sqr(a[1])+sqr(a[2]))
 #define normvec(a) (sqrt(vecsqr(a)))
 
+#ifdef USE_FIELD_CACHE
+// size of a block in the field cache: padded faceB followed by padded cellUe
+#define FIELD_CACHE_SIZE ((block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2)*6)
+#endif
+
+#ifdef USE_B0_INTERPOLATION
+#ifndef USE_B_CONSTANT
+   #error "USE_B0_INTERPOLATION interpolates the constant magnetic field and requires USE_B_CONSTANT"
+#endif
+// size of a block in the faceB0 array: constant magnetic field at faces of a block and its neighbours
+#define FACE_B0_SIZE ((block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2)*3)
+#endif
+
 #ifdef ION_SPECTRA_ALONG_ORBIT
 #define SPECTRA_FILE_VARIABLES 15
 #define EBINS 10
@@ -64,6 +77,10 @@ struct Hybrid {
    // face data
    static pargrid::DataID dataFaceBID;
    static pargrid::DataID dataFaceJID;
+#ifdef USE_B0_INTERPOLATION
+   // padded (WIDTH+2)^3 constant magnetic field at faces of each block, not exchanged
+   static pargrid::DataID dataFaceB0ID;
+#endif
 
    // cell data
    static pargrid::DataID dataCellRhoQiID;
@@ -73,6 +90,9 @@ struct Hybrid {
    static pargrid::DataID dataCellJiID;
    static pargrid::DataID dataCellIonosphereID;
    static pargrid::DataID dataCellExosphereID;
+#ifdef USE_B_CONSTANT
+   static pargrid::DataID dataCellB0ID;
+#endif
    
    // node data
    static pargrid::DataID dataNodeRhoQiID;
@@ -85,6 +105,9 @@ struct Hybrid {
 #ifdef USE_RESISTIVITY
    static pargrid::DataID dataNodeEtaID;
 #endif
+#ifdef USE_B_CONSTANT
+   static pargrid::DataID dataNodeB0ID;
+#endif
 
    // counters
    static pargrid::DataID dataCounterCellMaxUeID;
@@ -97,6 +120,11 @@ struct Hybrid {
    static pargrid::DataID dataCounterNodeMaxVwID;
 #endif
 
+#ifdef USE_FIELD_CACHE
+   // padded (WIDTH+2)^3 faceB and cellUe arrays of each block for particle field gather
+   static pargrid::DataID dataFieldCacheID;
+#endif
+
    // stencils
    static pargrid::StencilID accumulationStencilID; /**< ParGrid Stencil used to exchange accumulation array(s).*/
    
@@ -130,6 +158,8 @@ struct Hybrid {
    static uint32_t Z_NEG_EXISTS;
 
    static int logInterval;
+   static uint32_t randomSeed;                     /**< Seed of the random streams of injectors.*/
+   static int particleSortInterval;                /**< Interval of sorting particles by cell in timesteps, zero if not sorted.*/
    static bool includeInnerCellsInFieldLog;
    static Real dx;
    static Box box;
@@ -162,6 +192,10 @@ struct Hybrid {
    static Real (*resistivityProfilePtr)(Simulation& sim,SimulationClasses&,const Real x,const Real y,const Real z);
 #endif
    static bool useHallElectricField;
+   static bool batchedParticlePush;
+   static int N_threads;
+   static unsigned int partitionCounter; // incremented by checkPartitioning when local blocks have changed
+   static std::vector<pargrid::CellID> partitionGlobalIDs; // global IDs of local and remote blocks at the last check
    static Real swMacroParticlesCellPerDt;
    static int Efilter;
    static Real EfilterNodeGaussSigma;
@@ -169,6 +203,7 @@ struct Hybrid {
    static Real IMFBx,IMFBy,IMFBz;
 #if defined(USE_B_INITIAL) || defined(USE_B_CONSTANT)
    static Real laminarR2,laminarR3,coeffDip,coeffQuad,dipSurfB,dipSurfR,dipMinR2,dipMomCoeff,xDip,yDip,zDip,thetaDip,phiDip;
+   static Real dipRotation[9]; // R_x(phiDip)*R_y(thetaDip), row major
    static void (*magneticFieldProfilePtr)(const Real x,const Real y,const Real z,Real B[3]);
 #endif
    static unsigned int N_populations;
@@ -24,8 +24,16 @@
 #include "hybrid.h"
 #include "hybrid_propagator.h"
 #include "particle_definition.h"
-#ifdef USE_B_CONSTANT
+#include "field_kernels.h"
+#if defined(USE_BATCHED_EXCHANGE) || defined(USE_SHARED_MEMORY_EXCHANGE)
+#include <map>
+#include <sstream>
+#include "halo_exchange.h"
+#endif
+#ifdef USE_B0_INTERPOLATION
+#include <vector>
 #include "magnetic_field.h"
+#include "random_stream.h"
 #endif
 
 using namespace std;
@@ -36,9 +44,127 @@ static int profPropagFieldID = -1;
 static int profBoundCondsID = -1;
 static int mpiWaitID = -1;
 static int setupGetFieldsID = -1;
+#ifdef USE_FIELD_CACHE
+static int fieldCacheID = -1;
+#endif
+
+// field kernels are instantiated for the block widths of this build
+typedef fieldkernels::BlockLayout<block::WIDTH_X,block::WIDTH_Y,block::WIDTH_Z> FieldBlock;
 
 static bool saveStepHappened=false;
 
+#ifdef USE_BATCHED_EXCHANGE
+// arrays exchanged back to back
+static HaloExchange exchangeCellBJiRhoQi;
+static HaloExchange exchangeCellRhoQiJi;
+static HaloExchange exchangeFaceBNodeE;
+#endif
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+// exchanges of single arrays, on-node neighbours through shared memory windows
+static map<pargrid::DataID,HaloExchange> singleExchanges;
+#endif
+
+#if defined(USE_BATCHED_EXCHANGE) || defined(USE_SHARED_MEMORY_EXCHANGE)
+bool initializeHaloExchanges(SimulationClasses& simClasses) {
+   bool success = true;
+   if(HaloExchange::initializeSharedMemory(simClasses) == false) { success = false; }
+   vector<pargrid::DataID> dataIDs;
+#ifdef USE_BATCHED_EXCHANGE
+   dataIDs.push_back(Hybrid::dataCellBID);
+   dataIDs.push_back(Hybrid::dataCellJiID);
+   dataIDs.push_back(Hybrid::dataCellRhoQiID);
+   if(exchangeCellBJiRhoQi.initialize(simClasses,"exchangeCellBJiRhoQi",pargrid::DEFAULT_STENCIL,dataIDs) == false) { success = false; }
+   dataIDs.clear();
+   dataIDs.push_back(Hybrid::dataCellRhoQiID);
+   dataIDs.push_back(Hybrid::dataCellJiID);
+   if(exchangeCellRhoQiJi.initialize(simClasses,"exchangeCellRhoQiJi",pargrid::DEFAULT_STENCIL,dataIDs) == false) { success = false; }
+   dataIDs.clear();
+   dataIDs.push_back(Hybrid::dataFaceBID);
+   dataIDs.push_back(Hybrid::dataNodeEID);
+   if(exchangeFaceBNodeE.initialize(simClasses,"exchangeFaceBNodeE",pargrid::DEFAULT_STENCIL,dataIDs) == false) { success = false; }
+#endif
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   // initialized on all processes, also on those without other processes on the same node
+   const pargrid::DataID singleIDs[] = {Hybrid::dataFaceBID,Hybrid::dataFaceJID,Hybrid::dataCellRhoQiID,Hybrid::dataCellBID,
+                                        Hybrid::dataCellJID,Hybrid::dataCellUeID,Hybrid::dataCellJiID,
+                                        Hybrid::dataNodeEID,Hybrid::dataNodeBID,Hybrid::dataNodeJID};
+   for(size_t a=0; a<sizeof(singleIDs)/sizeof(singleIDs[0]); ++a) {
+      stringstream name;
+      name << "exchangeSingle" << a;
+      dataIDs.assign(1,singleIDs[a]);
+      if(singleExchanges[singleIDs[a]].initialize(simClasses,name.str(),pargrid::DEFAULT_STENCIL,dataIDs) == false) { success = false; }
+   }
+#endif
+   return success;
+}
+
+bool finalizeHaloExchanges(SimulationClasses& simClasses) {
+   bool success = true;
+#ifdef USE_BATCHED_EXCHANGE
+   if(exchangeCellBJiRhoQi.finalize(simClasses) == false) { success = false; }
+   if(exchangeCellRhoQiJi.finalize(simClasses) == false) { success = false; }
+   if(exchangeFaceBNodeE.finalize(simClasses) == false) { success = false; }
+#endif
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   for(map<pargrid::DataID,HaloExchange>::iterator it=singleExchanges.begin(); it!=singleExchanges.end(); ++it) {
+      if(it->second.finalize(simClasses) == false) { success = false; }
+   }
+   singleExchanges.clear();
+#endif
+   if(HaloExchange::finalizeSharedMemory() == false) { success = false; }
+   return success;
+}
+#endif
+
+// start neighbour exchange of a single array on the default stencil
+static void startExchange(SimulationClasses& simClasses,pargrid::DataID dataID) {
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   singleExchanges[dataID].start(simClasses);
+#else
+   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,dataID);
+#endif
+}
+
+// wait for neighbour exchange of a single array on the default stencil
+static void waitExchange(SimulationClasses& simClasses,pargrid::DataID dataID) {
+#ifdef USE_SHARED_MEMORY_EXCHANGE
+   singleExchanges[dataID].wait(simClasses);
+#else
+   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,dataID);
+#endif
+}
+
+// inner blocks whose stencils do (shallow) or do not (deep) contain exterior blocks
+static vector<pargrid::CellID> deepInnerBlocks;
+static vector<pargrid::CellID> shallowInnerBlocks;
+static unsigned int splitPartition = 0; // value of Hybrid::partitionCounter when the blocks were split
+
+// Split inner blocks into deep blocks, whose 27-block neighbourhoods contain no exterior
+// blocks, and shallow blocks. Neumann boundary conditions only modify exterior blocks,
+// so stencil operations on deep blocks can be computed while the exchanges preceding
+// the boundary conditions are still in flight. These are the cellB/Ji/RhoQi, cellJ and cellUe
+// (without USE_NODE_UE) exchanges and the cellJ exchange of each E filter pass. The other
+// exchanges overlap with all inner blocks. The split is only redone after repartitioning.
+static void splitInnerBlocks(SimulationClasses& simClasses,const vector<pargrid::CellID>& innerBlocks,const vector<pargrid::CellID>& exteriorBlocks) {
+   if(splitPartition == Hybrid::partitionCounter) { return; }
+   splitPartition = Hybrid::partitionCounter;
+   vector<bool> exteriorFlag(simClasses.pargrid.getNumberOfAllCells(),false);
+   for(pargrid::CellID eb=0; eb<exteriorBlocks.size(); ++eb) { exteriorFlag[exteriorBlocks[eb]] = true; }
+   deepInnerBlocks.clear();
+   shallowInnerBlocks.clear();
+   for(pargrid::CellID ib=0; ib<innerBlocks.size(); ++ib) {
+      const pargrid::CellID b = innerBlocks[ib];
+      const pargrid::CellID* const nbrs = simClasses.pargrid.getCellNeighbourIDs(b);
+      bool deep = true;
+      for(int k=-1;k<=1;++k) for(int j=-1;j<=1;++j) for(int i=-1;i<=1;++i) {
+	 const pargrid::CellID nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(i,j,k)];
+	 if(nbrLID == simClasses.pargrid.invalid() || exteriorFlag[nbrLID] == true) { deep = false; }
+      }
+      if(deep == true) { deepInnerBlocks.push_back(b); }
+      else { shallowInnerBlocks.push_back(b); }
+   }
+}
+
 bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleListBase*>& particleLists) {
    bool success = true;
    profile::start("propagateB",totalID);   
@@ -59,6 +185,9 @@ bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleLis
    Real* nodeJi              = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataNodeJiID);
 #ifdef USE_RESISTIVITY
    Real* nodeEta             = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataNodeEtaID);
+#endif
+#ifdef USE_B_CONSTANT
+   Real* nodeB0              = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataNodeB0ID);
 #endif
    Real* counterCellMaxUe    = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataCounterCellMaxUeID);
    Real* counterCellMaxVi    = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataCounterCellMaxViID);
@@ -88,6 +217,9 @@ bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleLis
    if(nodeJi              == NULL) {cerr << "ERROR: obtained NULL nodeJi array!"       << endl; exit(1);}
 #ifdef USE_RESISTIVITY
    if(nodeEta             == NULL) {cerr << "ERROR: obtained NULL nodeEta array!"      << endl; exit(1);}
+#endif
+#ifdef USE_B_CONSTANT
+   if(nodeB0              == NULL) {cerr << "ERROR: obtained NULL nodeB0 array!"       << endl; exit(1);}
 #endif
    if(counterCellMaxUe    == NULL) {cerr << "ERROR: obtained NULL counterCellMaxUe array!"    << endl; exit(1);}
    if(counterCellMaxVi    == NULL) {cerr << "ERROR: obtained NULL counterCellMaxVi array!"    << endl; exit(1);}
@@ -106,6 +238,7 @@ bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleLis
    const vector<pargrid::CellID>& innerBlocks = simClasses.pargrid.getInnerCells(pargrid::DEFAULT_STENCIL);
    const vector<pargrid::CellID>& boundaryBlocks = simClasses.pargrid.getBoundaryCells(pargrid::DEFAULT_STENCIL);
    const vector<pargrid::CellID>& exteriorBlocks = simClasses.pargrid.getExteriorCells();
+   splitInnerBlocks(simClasses,innerBlocks,exteriorBlocks);
 
    // zero diagnostic variables
    if(saveStepHappened == true) {
@@ -125,14 +258,20 @@ bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleLis
    }
    
    // face->cell B
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataFaceBID);
+   startExchange(simClasses,Hybrid::dataFaceBID);
    profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) { face2Cell(faceB,cellB,sim,simClasses,innerBlocks[b]); }
    profile::stop();
    profile::start("MPI waits",mpiWaitID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataFaceBID);
+   waitExchange(simClasses,Hybrid::dataFaceBID);
    profile::stop();
    profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { face2Cell(faceB,cellB,sim,simClasses,boundaryBlocks[b]); }
    profile::stop();
    
@@ -140,13 +279,30 @@ bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleLis
    
    // loop thru ghost cells
    profile::start("BoundaryConds",profBoundCondsID);
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataCellBID);
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataCellJiID);
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataCellRhoQiID);
+#ifdef USE_BATCHED_EXCHANGE
+   exchangeCellBJiRhoQi.start(simClasses);
+#else
+   startExchange(simClasses,Hybrid::dataCellBID);
+   startExchange(simClasses,Hybrid::dataCellJiID);
+   startExchange(simClasses,Hybrid::dataCellRhoQiID);
+#endif
+   profile::stop();
+   // cell->node B of deep inner blocks is not affected by boundary conditions
+   profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
+   for(pargrid::CellID b=0; b<deepInnerBlocks.size(); ++b) { cell2Node(cellB,nodeB,sim,simClasses,deepInnerBlocks[b]); }
+   profile::stop();
+   profile::start("BoundaryConds",profBoundCondsID);
    profile::start("MPI waits",mpiWaitID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataCellBID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataCellJiID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataCellRhoQiID);
+#ifdef USE_BATCHED_EXCHANGE
+   exchangeCellBJiRhoQi.wait(simClasses);
+#else
+   waitExchange(simClasses,Hybrid::dataCellBID);
+   waitExchange(simClasses,Hybrid::dataCellJiID);
+   waitExchange(simClasses,Hybrid::dataCellRhoQiID);
+#endif
    profile::stop();
    neumannCell(cellB,    sim,simClasses,exteriorBlocks,3);
    neumannCell(cellJi,   sim,simClasses,exteriorBlocks,3);
@@ -166,25 +322,52 @@ bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleLis
    Hybrid::averageCounter++;
 #endif
    
-   // cell->node B
+   // cell->node B of the remaining blocks
    profile::start("intpol",profIntpolID);   
-   for(pargrid::CellID b=0; b<simClasses.pargrid.getNumberOfLocalCells(); ++b) { cell2Node(cellB,nodeB,sim,simClasses,b); }
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
+   for(pargrid::CellID b=0; b<shallowInnerBlocks.size(); ++b) { cell2Node(cellB,nodeB,sim,simClasses,shallowInnerBlocks[b]); }
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
+   for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { cell2Node(cellB,nodeB,sim,simClasses,boundaryBlocks[b]); }
    profile::stop();
 
 #ifdef USE_NODE_UE
    // cell -> node RhoQi and Ji
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataCellRhoQiID);
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataCellJiID);
+#ifdef USE_BATCHED_EXCHANGE
+   exchangeCellRhoQiJi.start(simClasses);
+#else
+   startExchange(simClasses,Hybrid::dataCellRhoQiID);
+   startExchange(simClasses,Hybrid::dataCellJiID);
+#endif
    profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) { cell2Node(cellRhoQi,nodeRhoQi,sim,simClasses,innerBlocks[b],1); }
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) { cell2Node(cellJi,nodeJi,sim,simClasses,innerBlocks[b]); }
    profile::stop();
    profile::start("MPI waits",mpiWaitID);   
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataCellRhoQiID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataCellJiID);
+#ifdef USE_BATCHED_EXCHANGE
+   exchangeCellRhoQiJi.wait(simClasses);
+#else
+   waitExchange(simClasses,Hybrid::dataCellRhoQiID);
+   waitExchange(simClasses,Hybrid::dataCellJiID);
+#endif
    profile::stop();
    profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { cell2Node(cellRhoQi,nodeRhoQi,sim,simClasses,boundaryBlocks[b],1); }
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { cell2Node(cellJi,nodeJi,sim,simClasses,boundaryBlocks[b]); }
    profile::stop();
 #endif
@@ -194,8 +377,11 @@ bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleLis
    neumannFace(faceB,sim,simClasses,exteriorBlocks);
    setIMFFace(faceB,sim,simClasses,exteriorBlocks);
    // nodeJ = avg(edgeJ) = avg(curl(faceB)/mu0)
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataFaceBID);
+   startExchange(simClasses,Hybrid::dataFaceBID);
    profile::start("field propag",profPropagFieldID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) {
       calcNodeJ(faceB,nodeB,nodeRhoQi,nodeJ,
 #ifdef USE_MAXVW
@@ -205,9 +391,12 @@ bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleLis
    }
    profile::stop();
    profile::start("MPI waits",mpiWaitID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataFaceBID);
+   waitExchange(simClasses,Hybrid::dataFaceBID);
    profile::stop();
    profile::start("field propag",profPropagFieldID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) {
       calcNodeJ(faceB,nodeB,nodeRhoQi,nodeJ,
 #ifdef USE_MAXVW
@@ -217,68 +406,122 @@ bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleLis
    }
    profile::stop(); 
    // node->cell J
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeJID);
+   startExchange(simClasses,Hybrid::dataNodeJID);
    profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) { node2Cell(nodeJ,cellJ,sim,simClasses,innerBlocks[b]); }
    profile::stop();
    profile::start("MPI waits",mpiWaitID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeJID);
+   waitExchange(simClasses,Hybrid::dataNodeJID);
    profile::stop();
    profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { node2Cell(nodeJ,cellJ,sim,simClasses,boundaryBlocks[b]); }
    profile::stop();
 #else
    // Ampere: faceJ = curl(nodeB)/mu0
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeBID);
+   startExchange(simClasses,Hybrid::dataNodeBID);
    profile::start("field propag",profPropagFieldID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) { faceCurl(nodeB,faceJ,false,sim,simClasses,innerBlocks[b]); }
    profile::stop();
    profile::start("MPI waits",mpiWaitID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeBID);
+   waitExchange(simClasses,Hybrid::dataNodeBID);
    profile::stop();
    profile::start("field propag",profPropagFieldID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { faceCurl(nodeB,faceJ,false,sim,simClasses,boundaryBlocks[b]); }
    profile::stop();
    
    // face->cell J
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataFaceJID);
+   startExchange(simClasses,Hybrid::dataFaceJID);
    profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) { face2Cell(faceJ,cellJ,sim,simClasses,innerBlocks[b]); }
    profile::stop();
    profile::start("MPI waits",mpiWaitID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataFaceJID);
+   waitExchange(simClasses,Hybrid::dataFaceJID);
    profile::stop();
    profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { face2Cell(faceJ,cellJ,sim,simClasses,boundaryBlocks[b]); }
    profile::stop();
 
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataCellJID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataCellJID);
+   startExchange(simClasses,Hybrid::dataCellJID);
+   profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
+   for(pargrid::CellID b=0; b<deepInnerBlocks.size(); ++b) { cell2Node(cellJ,nodeJ,sim,simClasses,deepInnerBlocks[b]); }
+   profile::stop();
+   profile::start("MPI waits",mpiWaitID);
+   waitExchange(simClasses,Hybrid::dataCellJID);
+   profile::stop();
    neumannCell(cellJ,sim,simClasses,exteriorBlocks,3);
    
    // cell->node J
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataCellJID);
+   startExchange(simClasses,Hybrid::dataCellJID);
    profile::start("intpol",profIntpolID);
-   for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) { cell2Node(cellJ,nodeJ,sim,simClasses,innerBlocks[b]); }
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
+   for(pargrid::CellID b=0; b<shallowInnerBlocks.size(); ++b) { cell2Node(cellJ,nodeJ,sim,simClasses,shallowInnerBlocks[b]); }
    profile::stop();
    profile::start("MPI waits",mpiWaitID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataCellJID);
+   waitExchange(simClasses,Hybrid::dataCellJID);
    profile::stop();
    profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { cell2Node(cellJ,nodeJ,sim,simClasses,boundaryBlocks[b]); }
    profile::stop();
 #endif
 
    // calculate cellUe
    profile::start("field propag",profPropagFieldID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<simClasses.pargrid.getNumberOfLocalCells(); ++b) { calcCellUe(cellJ,cellJi,cellRhoQi,cellUe,innerFlag,counterCellMaxUe,sim,simClasses,b); }
    profile::stop();
    
    // loop thru ghost cells
    profile::start("BoundaryConds",profBoundCondsID);
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataCellUeID);
+   startExchange(simClasses,Hybrid::dataCellUeID);
+   profile::stop();
+#ifdef USE_NODE_UE
+   // nodeUe does not depend on cellUe
+   profile::start("field propag",profPropagFieldID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
+   for(pargrid::CellID b=0; b<simClasses.pargrid.getNumberOfLocalCells(); ++b) { calcNodeUe(nodeRhoQi,nodeJi,nodeJ,nodeUe,innerFlagNode,counterCellMaxUe,sim,simClasses,b); }
+   profile::stop();
+#else
+   // cell->node Ue of deep inner blocks is not affected by boundary conditions
+   profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
+   for(pargrid::CellID b=0; b<deepInnerBlocks.size(); ++b) { cell2Node(cellUe,nodeUe,sim,simClasses,deepInnerBlocks[b]); }
+   profile::stop();
+#endif
+   profile::start("BoundaryConds",profBoundCondsID);
    profile::start("MPI waits",mpiWaitID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataCellUeID);
+   waitExchange(simClasses,Hybrid::dataCellUeID);
    profile::stop();
    neumannCell(cellUe,sim,simClasses,exteriorBlocks,3);
    profile::stop();
@@ -300,32 +543,45 @@ bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleLis
    for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { cell2Node(cellRhoQi,nodeRhoQi,sim,simClasses,boundaryBlocks[b],1); }
    for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { cell2Node(cellJi,nodeJi,sim,simClasses,boundaryBlocks[b]); }
    profile::stop();*/
-   profile::start("field propag",profPropagFieldID);
-   for(pargrid::CellID b=0; b<simClasses.pargrid.getNumberOfLocalCells(); ++b) { calcNodeUe(nodeRhoQi,nodeJi,nodeJ,nodeUe,innerFlagNode,counterCellMaxUe,sim,simClasses,b); }
-   profile::stop();
+   // nodeUe was calculated during the cellUe exchange above
 #else
    // cell->node Ue
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataCellUeID);
+   startExchange(simClasses,Hybrid::dataCellUeID);
    profile::start("intpol",profIntpolID);
-   for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) { cell2Node(cellUe,nodeUe,sim,simClasses,innerBlocks[b]); }
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
+   for(pargrid::CellID b=0; b<shallowInnerBlocks.size(); ++b) { cell2Node(cellUe,nodeUe,sim,simClasses,shallowInnerBlocks[b]); }
    profile::stop();
    profile::start("MPI waits",mpiWaitID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataCellUeID);
+   waitExchange(simClasses,Hybrid::dataCellUeID);
    profile::stop();
    profile::start("intpol",profIntpolID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { cell2Node(cellUe,nodeUe,sim,simClasses,boundaryBlocks[b]); }
    profile::stop();
 #endif
    
    // upwind nodeB
    profile::start("field propag",profPropagFieldID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<simClasses.pargrid.getNumberOfLocalCells(); ++b) { upwindNodeB(cellB,nodeUe,nodeB,sim,simClasses,b); }
    profile::stop();
    
    // calculate nodeE
    profile::start("field propag",profPropagFieldID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<simClasses.pargrid.getNumberOfLocalCells(); ++b) {
       calcNodeE(nodeUe,nodeB,
+#ifdef USE_B_CONSTANT
+      nodeB0,
+#endif
 #ifdef USE_RESISTIVITY
       nodeEta,
 #endif
@@ -340,31 +596,49 @@ bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleLis
    // nodeE filter
    for(int i=0;i<Hybrid::Efilter;i++) {
       // node->cell E
-      simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeEID);
+      startExchange(simClasses,Hybrid::dataNodeEID);
       profile::start("intpol",profIntpolID);
+      #ifdef _OPENMP
+         #pragma omp parallel for schedule(static)
+      #endif
       for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) { node2Cell(nodeE,cellJ,sim,simClasses,innerBlocks[b]); }
       profile::stop();
       profile::start("MPI waits",mpiWaitID);
-      simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeEID);
+      waitExchange(simClasses,Hybrid::dataNodeEID);
       profile::stop();
       profile::start("intpol",profIntpolID);
+      #ifdef _OPENMP
+         #pragma omp parallel for schedule(static)
+      #endif
       for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { node2Cell(nodeE,cellJ,sim,simClasses,boundaryBlocks[b]); }
       profile::stop();
-      // Neumann boundary conditions
-      simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataCellJID);
+      // Neumann boundary conditions, cell->node E of deep inner blocks is not affected by them
+      startExchange(simClasses,Hybrid::dataCellJID);
+      profile::start("intpol",profIntpolID);
+      #ifdef _OPENMP
+         #pragma omp parallel for schedule(static)
+      #endif
+      for(pargrid::CellID b=0; b<deepInnerBlocks.size(); ++b) { cell2Node(cellJ,nodeE,sim,simClasses,deepInnerBlocks[b]); }
+      profile::stop();
       profile::start("MPI waits",mpiWaitID);
-      simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataCellJID);
+      waitExchange(simClasses,Hybrid::dataCellJID);
       profile::stop();
       neumannCell(cellJ,sim,simClasses,exteriorBlocks,3); 
       // cell->node E
-      simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataCellJID);
+      startExchange(simClasses,Hybrid::dataCellJID);
       profile::start("intpol",profIntpolID);
-      for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) { cell2Node(cellJ,nodeE,sim,simClasses,innerBlocks[b]); }
+      #ifdef _OPENMP
+         #pragma omp parallel for schedule(static)
+      #endif
+      for(pargrid::CellID b=0; b<shallowInnerBlocks.size(); ++b) { cell2Node(cellJ,nodeE,sim,simClasses,shallowInnerBlocks[b]); }
       profile::stop();
       profile::start("MPI waits",mpiWaitID);
-      simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataCellJID);
+      waitExchange(simClasses,Hybrid::dataCellJID);
       profile::stop();
       profile::start("intpol",profIntpolID);
+      #ifdef _OPENMP
+         #pragma omp parallel for schedule(static)
+      #endif
       for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { cell2Node(cellJ,nodeE,sim,simClasses,boundaryBlocks[b]); }
       profile::stop();
       // zero cellJ
@@ -377,27 +651,48 @@ bool propagateB(Simulation& sim,SimulationClasses& simClasses,vector<ParticleLis
    }
    // nodeE gaussian filter
    if(Hybrid::EfilterNodeGaussSigma > 0) {
-      simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeEID);
-      simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeEID);
-      const size_t N = simClasses.pargrid.getNumberOfAllCells()*simClasses.pargrid.getUserDataStaticElements(Hybrid::dataNodeEID);
+      // inner blocks only read local nodeE, so they are filtered while ghost blocks are exchanged
+      startExchange(simClasses,Hybrid::dataNodeEID);
+      const size_t N_elements = simClasses.pargrid.getUserDataStaticElements(Hybrid::dataNodeEID);
+      const size_t N_local = simClasses.pargrid.getNumberOfLocalCells()*N_elements;
+      const size_t N = simClasses.pargrid.getNumberOfAllCells()*N_elements;
       Real* nodeEOld = new Real[N];
-      *nodeEOld = *nodeE;
-      for(size_t i=0;i<N;++i) { nodeEOld[i] = nodeE[i]; }
+      for(size_t i=0;i<N_local;++i) { nodeEOld[i] = nodeE[i]; }
+      profile::start("intpol",profIntpolID);
+      #ifdef _OPENMP
+         #pragma omp parallel for schedule(static)
+      #endif
       for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) { nodeAvg(nodeEOld,nodeE,sim,simClasses,innerBlocks[b]); }
+      profile::stop();
+      profile::start("MPI waits",mpiWaitID);
+      waitExchange(simClasses,Hybrid::dataNodeEID);
+      profile::stop();
+      for(size_t i=N_local;i<N;++i) { nodeEOld[i] = nodeE[i]; }
+      profile::start("intpol",profIntpolID);
+      #ifdef _OPENMP
+         #pragma omp parallel for schedule(static)
+      #endif
       for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { nodeAvg(nodeEOld,nodeE,sim,simClasses,boundaryBlocks[b]); }
+      profile::stop();
       delete [] nodeEOld;
       nodeEOld = NULL;
    }
 
    // propagate faceB by Faraday's law using nodeE
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeEID);
+   startExchange(simClasses,Hybrid::dataNodeEID);
    profile::start("field propag",profPropagFieldID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) { faceCurl(nodeE,faceB,true,sim,simClasses,innerBlocks[b]); }
    profile::stop();
    profile::start("MPI waits",mpiWaitID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeEID);
+   waitExchange(simClasses,Hybrid::dataNodeEID);
    profile::stop();
    profile::start("field propag",profPropagFieldID);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
    for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) { faceCurl(nodeE,faceB,true,sim,simClasses,boundaryBlocks[b]); }
    profile::stop();
    
@@ -914,19 +1209,36 @@ void setIMFFace(Real* faceB,Simulation& sim,SimulationClasses& simClasses,const
    }
 }
 
+// field kernels index blocks with BlockLayout, check that it matches block::index and block::arrayIndex
+bool checkFieldKernelLayout() {
+   for(int k=0;k<block::WIDTH_Z+2;++k) for(int j=0;j<block::WIDTH_Y+2;++j) for(int i=0;i<block::WIDTH_X+2;++i) {
+      if(FieldBlock::arrayIndex(i,j,k) != block::arrayIndex(i,j,k)) { return false; }
+      if(i < block::WIDTH_X && j < block::WIDTH_Y && k < block::WIDTH_Z && FieldBlock::index(i,j,k) != block::index(i,j,k)) { return false; }
+   }
+   return true;
+}
+
+// loop start offsets of node kernels in blocks without all neighbours: false if the block has no
+// +x/+y/+z neighbour, otherwise only the last layer of nodes is done at the -x/-y/-z domain boundary
+static bool getBoundaryOffsets(SimulationClasses& simClasses,pargrid::CellID blockID,int& di,int& dj,int& dk) {
+   const uint32_t flags = simClasses.pargrid.getNeighbourFlags()[blockID];
+   di = dj = dk = 0;
+   if((flags & Hybrid::X_POS_EXISTS) == 0) return false;
+   if((flags & Hybrid::Y_POS_EXISTS) == 0) return false;
+   if((flags & Hybrid::Z_POS_EXISTS) == 0) return false;
+   if((flags & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
+   if((flags & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
+   if((flags & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
+   return true;
+}
+
 // interpolation from faces to cells
 void face2Cell(Real* faceData,Real* cellData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID)
 {
    if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) return;
-   const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
-   Real array[size*3];
+   Real array[FieldBlock::PADDED*3];
    fetchData(faceData,array,simClasses,blockID,3);
-   for(int k=0; k<block::WIDTH_Z; ++k) for(int j=0; j<block::WIDTH_Y; ++j) for(int i=0; i<block::WIDTH_X; ++i) {
-      const int n = (blockID*block::SIZE+block::index(i,j,k))*3;
-      cellData[n+0] = 0.5*(array[(block::arrayIndex(i+1,j+1,k+1))*3+0] + array[(block::arrayIndex(i+0,j+1,k+1))*3+0]);
-      cellData[n+1] = 0.5*(array[(block::arrayIndex(i+1,j+1,k+1))*3+1] + array[(block::arrayIndex(i+1,j+0,k+1))*3+1]);
-      cellData[n+2] = 0.5*(array[(block::arrayIndex(i+1,j+1,k+1))*3+2] + array[(block::arrayIndex(i+1,j+1,k+0))*3+2]);
-   }
+   fieldkernels::face2Cell<FieldBlock>(array,cellData+blockID*block::SIZE*3);
 }
 
 // inteprolation from cells to nodes
@@ -935,54 +1247,29 @@ void cell2Node(Real* cellData,Real* nodeData,Simulation& sim,SimulationClasses&
    int di=0;
    int dj=0;
    int dk=0;
-   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
-   }
-   
-   const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
-   Real array[size*vectorDim];
+   const bool interior = (simClasses.pargrid.getNeighbourFlags(blockID) == pargrid::ALL_NEIGHBOURS_EXIST);
+   if(interior == false && getBoundaryOffsets(simClasses,blockID,di,dj,dk) == false) return;
+   Real array[FieldBlock::PADDED*3];
    fetchData(cellData,array,simClasses,blockID,vectorDim);
-
-   for(int k=0+dk; k<block::WIDTH_Z; ++k) for(int j=0+dj; j<block::WIDTH_Y; ++j) for(int i=0+di; i<block::WIDTH_X; ++i) {
-      const int n = (blockID*block::SIZE+block::index(i,j,k))*vectorDim;
-      for(int l=0;l<vectorDim;++l) {
-	 nodeData[n+l] = 0.125*(array[(block::arrayIndex(i+1,j+1,k+1))*vectorDim+l] +
-				array[(block::arrayIndex(i+1,j+1,k+2))*vectorDim+l] +
-				array[(block::arrayIndex(i+1,j+2,k+1))*vectorDim+l] +
-				array[(block::arrayIndex(i+2,j+1,k+1))*vectorDim+l] +
-				array[(block::arrayIndex(i+1,j+2,k+2))*vectorDim+l] +
-				array[(block::arrayIndex(i+2,j+2,k+1))*vectorDim+l] +
-				array[(block::arrayIndex(i+2,j+1,k+2))*vectorDim+l] +
-				array[(block::arrayIndex(i+2,j+2,k+2))*vectorDim+l]);
-      }
+   Real* nodeBlock = nodeData + blockID*block::SIZE*vectorDim;
+   if(vectorDim == 3) {
+      if(interior == true) { fieldkernels::cell2Node<FieldBlock,3,true>(array,nodeBlock,di,dj,dk); }
+      else { fieldkernels::cell2Node<FieldBlock,3,false>(array,nodeBlock,di,dj,dk); }
+   }
+   else if(vectorDim == 1) {
+      if(interior == true) { fieldkernels::cell2Node<FieldBlock,1,true>(array,nodeBlock,di,dj,dk); }
+      else { fieldkernels::cell2Node<FieldBlock,1,false>(array,nodeBlock,di,dj,dk); }
    }
+   else { cerr << "ERROR: cell2Node: unsupported vector dimension " << vectorDim << endl; exit(1); }
 }
 
 // interpolation from nodes to cells
 void node2Cell(Real* nodeData,Real* cellData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID)
 {
    if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) return;
-   const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
-   Real array[size*3];
+   Real array[FieldBlock::PADDED*3];
    fetchData(nodeData,array,simClasses,blockID,3);
-   for(int k=0; k<block::WIDTH_Z; ++k) for(int j=0; j<block::WIDTH_Y; ++j) for(int i=0; i<block::WIDTH_X; ++i) {
-      const int n = (blockID*block::SIZE+block::index(i,j,k))*3;
-      for(int l=0;l<3;++l) {
-	 cellData[n+l] = 0.125*(array[(block::arrayIndex(i+1,j+1,k+1))*3+l] + 
-				array[(block::arrayIndex(i+0,j+1,k+1))*3+l] +
-				array[(block::arrayIndex(i+0,j+0,k+1))*3+l] +
-				array[(block::arrayIndex(i+1,j+0,k+1))*3+l] +
-				array[(block::arrayIndex(i+1,j+1,k+0))*3+l] +
-				array[(block::arrayIndex(i+1,j+0,k+0))*3+l] +
-				array[(block::arrayIndex(i+0,j+1,k+0))*3+l] +
-				array[(block::arrayIndex(i+0,j+0,k+0))*3+l]);
-      }
-   }
+   fieldkernels::node2Cell<FieldBlock>(array,cellData+blockID*block::SIZE*3);
 }
 
 // node data average from all neighbors
@@ -991,150 +1278,25 @@ void nodeAvg(Real* nodeDataOld,Real* nodeData,Simulation& sim,SimulationClasses&
    int di=0;
    int dj=0;
    int dk=0;
-   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
-   }
-   const unsigned int arraySize = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2)*vectorDim;
+   const bool interior = (simClasses.pargrid.getNeighbourFlags(blockID) == pargrid::ALL_NEIGHBOURS_EXIST);
+   if(interior == false && getBoundaryOffsets(simClasses,blockID,di,dj,dk) == false) return;
+   const unsigned int arraySize = FieldBlock::PADDED*3;
    const Real initVal = numeric_limits<Real>::max();
+   // only array[0] is initVal, the rest of the elements are zero-initialised
    Real array[arraySize] = {initVal};
    fetchData(nodeDataOld,array,simClasses,blockID,vectorDim);
-   // coefficients
-   const Real C1 = Hybrid::EfilterNodeGaussCoeffs[0]; // node itself
-   const Real C2 = Hybrid::EfilterNodeGaussCoeffs[1]; // direct neighbors (distance = dx)
-   const Real C3 = Hybrid::EfilterNodeGaussCoeffs[2]; // diagonal neighbors (distance = sqrt(2)*dx)
-   const Real C4 = Hybrid::EfilterNodeGaussCoeffs[3]; // diagonal neighbors (distance = sqrt(3)*dx)
-   // loop through all nodes in the simulation domain
-   for(int k=0+dk; k<block::WIDTH_Z; ++k) for(int j=0+dj; j<block::WIDTH_Y; ++j) for(int i=0+di; i<block::WIDTH_X; ++i) {
-      const int n = (blockID*block::SIZE+block::index(i,j,k))*vectorDim;
-      for(int l=0;l<vectorDim;++l) {
-         // electric field component l (x=0,y=1,z=2) at 27 nodes
-         Real nodeEl111 = array[(block::arrayIndex(i+1,j+1,k+1))*vectorDim+l];
-         Real nodeEl110 = array[(block::arrayIndex(i+1,j+1,k+0))*vectorDim+l];
-         Real nodeEl011 = array[(block::arrayIndex(i+0,j+1,k+1))*vectorDim+l];
-         Real nodeEl121 = array[(block::arrayIndex(i+1,j+2,k+1))*vectorDim+l];
-         Real nodeEl211 = array[(block::arrayIndex(i+2,j+1,k+1))*vectorDim+l];
-         Real nodeEl101 = array[(block::arrayIndex(i+1,j+0,k+1))*vectorDim+l];
-         Real nodeEl112 = array[(block::arrayIndex(i+1,j+1,k+2))*vectorDim+l];
-         Real nodeEl010 = array[(block::arrayIndex(i+0,j+1,k+0))*vectorDim+l];
-         Real nodeEl100 = array[(block::arrayIndex(i+1,j+0,k+0))*vectorDim+l];
-         Real nodeEl120 = array[(block::arrayIndex(i+1,j+2,k+0))*vectorDim+l];
-         Real nodeEl210 = array[(block::arrayIndex(i+2,j+1,k+0))*vectorDim+l];
-         Real nodeEl001 = array[(block::arrayIndex(i+0,j+0,k+1))*vectorDim+l];
-         Real nodeEl021 = array[(block::arrayIndex(i+0,j+2,k+1))*vectorDim+l];
-         Real nodeEl221 = array[(block::arrayIndex(i+2,j+2,k+1))*vectorDim+l];
-         Real nodeEl201 = array[(block::arrayIndex(i+2,j+0,k+1))*vectorDim+l];
-         Real nodeEl012 = array[(block::arrayIndex(i+0,j+1,k+2))*vectorDim+l];
-         Real nodeEl122 = array[(block::arrayIndex(i+1,j+2,k+2))*vectorDim+l];
-         Real nodeEl212 = array[(block::arrayIndex(i+2,j+1,k+2))*vectorDim+l];
-         Real nodeEl102 = array[(block::arrayIndex(i+1,j+0,k+2))*vectorDim+l];
-         Real nodeEl002 = array[(block::arrayIndex(i+0,j+0,k+2))*vectorDim+l];
-         Real nodeEl022 = array[(block::arrayIndex(i+0,j+2,k+2))*vectorDim+l];
-         Real nodeEl202 = array[(block::arrayIndex(i+2,j+0,k+2))*vectorDim+l];
-         Real nodeEl222 = array[(block::arrayIndex(i+2,j+2,k+2))*vectorDim+l];
-         Real nodeEl000 = array[(block::arrayIndex(i+0,j+0,k+0))*vectorDim+l];
-         Real nodeEl020 = array[(block::arrayIndex(i+0,j+2,k+0))*vectorDim+l];
-         Real nodeEl200 = array[(block::arrayIndex(i+2,j+0,k+0))*vectorDim+l];
-         Real nodeEl220 = array[(block::arrayIndex(i+2,j+2,k+0))*vectorDim+l];
-         
-         // weight coefficients for each node (if the electric field value is exactly
-         // zero, the node is excluedd as it should be a boudary node)
-         bool zeroFound = false;
-         Real C111 = C1; if(nodeEl111 == initVal) { nodeEl111 = 0.0; C111 = 0.0; zeroFound = true; }
-         Real C110 = C2; if(nodeEl110 == initVal) { nodeEl110 = 0.0; C110 = 0.0; zeroFound = true; }
-         Real C011 = C2; if(nodeEl011 == initVal) { nodeEl011 = 0.0; C011 = 0.0; zeroFound = true; }
-         Real C121 = C2; if(nodeEl121 == initVal) { nodeEl121 = 0.0; C121 = 0.0; zeroFound = true; }
-         Real C211 = C2; if(nodeEl211 == initVal) { nodeEl211 = 0.0; C211 = 0.0; zeroFound = true; }
-         Real C101 = C2; if(nodeEl101 == initVal) { nodeEl101 = 0.0; C101 = 0.0; zeroFound = true; }
-         Real C112 = C2; if(nodeEl112 == initVal) { nodeEl112 = 0.0; C112 = 0.0; zeroFound = true; }
-         Real C010 = C3; if(nodeEl010 == initVal) { nodeEl010 = 0.0; C010 = 0.0; zeroFound = true; }
-         Real C100 = C3; if(nodeEl100 == initVal) { nodeEl100 = 0.0; C100 = 0.0; zeroFound = true; }
-         Real C120 = C3; if(nodeEl120 == initVal) { nodeEl120 = 0.0; C120 = 0.0; zeroFound = true; }
-         Real C210 = C3; if(nodeEl210 == initVal) { nodeEl210 = 0.0; C210 = 0.0; zeroFound = true; }
-         Real C001 = C3; if(nodeEl001 == initVal) { nodeEl001 = 0.0; C001 = 0.0; zeroFound = true; }
-         Real C021 = C3; if(nodeEl021 == initVal) { nodeEl021 = 0.0; C021 = 0.0; zeroFound = true; }
-         Real C221 = C3; if(nodeEl221 == initVal) { nodeEl221 = 0.0; C221 = 0.0; zeroFound = true; }
-         Real C201 = C3; if(nodeEl201 == initVal) { nodeEl201 = 0.0; C201 = 0.0; zeroFound = true; }
-         Real C012 = C3; if(nodeEl012 == initVal) { nodeEl012 = 0.0; C012 = 0.0; zeroFound = true; }
-         Real C122 = C3; if(nodeEl122 == initVal) { nodeEl122 = 0.0; C122 = 0.0; zeroFound = true; }
-         Real C212 = C3; if(nodeEl212 == initVal) { nodeEl212 = 0.0; C212 = 0.0; zeroFound = true; }
-         Real C102 = C3; if(nodeEl102 == initVal) { nodeEl102 = 0.0; C102 = 0.0; zeroFound = true; }
-         Real C002 = C4; if(nodeEl002 == initVal) { nodeEl002 = 0.0; C002 = 0.0; zeroFound = true; }
-         Real C022 = C4; if(nodeEl022 == initVal) { nodeEl022 = 0.0; C022 = 0.0; zeroFound = true; }
-         Real C202 = C4; if(nodeEl202 == initVal) { nodeEl202 = 0.0; C202 = 0.0; zeroFound = true; }
-         Real C222 = C4; if(nodeEl222 == initVal) { nodeEl222 = 0.0; C222 = 0.0; zeroFound = true; }
-         Real C000 = C4; if(nodeEl000 == initVal) { nodeEl000 = 0.0; C000 = 0.0; zeroFound = true; }
-         Real C020 = C4; if(nodeEl020 == initVal) { nodeEl020 = 0.0; C020 = 0.0; zeroFound = true; }
-         Real C200 = C4; if(nodeEl200 == initVal) { nodeEl200 = 0.0; C200 = 0.0; zeroFound = true; }
-         Real C220 = C4; if(nodeEl220 == initVal) { nodeEl220 = 0.0; C220 = 0.0; zeroFound = true; }
-         // renormalize if boundary node found
-         if(zeroFound == true) {
-            const Real Csum = C111+C110+C011+C121+C211+C101+C112+C010+C100+C120+C210+C001+C021+C221+C201+C012+C122+C212+C102+C002+C022+C202+C222+C000+C020+C200+C220;
-            if(Csum > 0.0) {
-               C111 /= Csum;
-               C110 /= Csum;
-               C011 /= Csum;
-               C121 /= Csum;
-               C211 /= Csum;
-               C101 /= Csum;
-               C112 /= Csum;
-               C010 /= Csum;
-               C100 /= Csum;
-               C120 /= Csum;
-               C210 /= Csum;
-               C001 /= Csum;
-               C021 /= Csum;
-               C221 /= Csum;
-               C201 /= Csum;
-               C012 /= Csum;
-               C122 /= Csum;
-               C212 /= Csum;
-               C102 /= Csum;
-               C002 /= Csum;
-               C022 /= Csum;
-               C202 /= Csum;
-               C222 /= Csum;
-               C000 /= Csum;
-               C020 /= Csum;
-               C200 /= Csum;
-               C220 /= Csum;
-            }
-         }
-	 // calculate average
-         nodeData[n+l] =
-           C111*nodeEl111 +
-           C110*nodeEl110 +
-           C011*nodeEl011 +
-           C121*nodeEl121 +
-           C211*nodeEl211 +
-           C101*nodeEl101 +
-           C112*nodeEl112 +
-           C010*nodeEl010 +
-           C100*nodeEl100 +
-           C120*nodeEl120 +
-           C210*nodeEl210 +
-           C001*nodeEl001 +
-           C021*nodeEl021 +
-           C221*nodeEl221 +
-           C201*nodeEl201 +
-           C012*nodeEl012 +
-           C122*nodeEl122 +
-           C212*nodeEl212 +
-           C102*nodeEl102 +
-           C002*nodeEl002 +
-           C022*nodeEl022 +
-           C202*nodeEl202 +
-           C222*nodeEl222 +
-           C000*nodeEl000 +
-           C020*nodeEl020 +
-           C200*nodeEl200 +
-           C220*nodeEl220;
-      }
+   Real* nodeBlock = nodeData + blockID*block::SIZE*vectorDim;
+   // coefficients: node itself, direct neighbors (distance = dx), diagonal neighbors (distance = sqrt(2)*dx and sqrt(3)*dx)
+   const Real* C = Hybrid::EfilterNodeGaussCoeffs;
+   if(vectorDim == 3) {
+      if(interior == true) { fieldkernels::nodeAvg<FieldBlock,3,true>(array,nodeBlock,C,initVal,di,dj,dk); }
+      else { fieldkernels::nodeAvg<FieldBlock,3,false>(array,nodeBlock,C,initVal,di,dj,dk); }
+   }
+   else if(vectorDim == 1) {
+      if(interior == true) { fieldkernels::nodeAvg<FieldBlock,1,true>(array,nodeBlock,C,initVal,di,dj,dk); }
+      else { fieldkernels::nodeAvg<FieldBlock,1,false>(array,nodeBlock,C,initVal,di,dj,dk); }
    }
+   else { cerr << "ERROR: nodeAvg: unsupported vector dimension " << vectorDim << endl; exit(1); }
 }
 
 // upwind nodeB using cellData and nodeUe
@@ -1142,71 +1304,13 @@ void upwindNodeB(Real* cellB,Real* nodeUe,Real* nodeB,Simulation& sim,Simulation
    int di=0;
    int dj=0;
    int dk=0;
-   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
-   }
-   const unsigned int tempArraySize = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
-   Real tempArray[tempArraySize*3];
+   const bool interior = (simClasses.pargrid.getNeighbourFlags(blockID) == pargrid::ALL_NEIGHBOURS_EXIST);
+   if(interior == false && getBoundaryOffsets(simClasses,blockID,di,dj,dk) == false) return;
+   Real tempArray[FieldBlock::PADDED*3];
    fetchData(cellB,tempArray,simClasses,blockID,3);
-   for(int k=0+dk; k<block::WIDTH_Z; ++k) for(int j=0+dj; j<block::WIDTH_Y; ++j) for(int i=0+di; i<block::WIDTH_X; ++i) {
-      const int n = (blockID*block::SIZE+block::index(i,j,k))*3;
-     
-      // upwind displacement vector = (-0.5,0,0) if Ue = 0
-      Real xUpwind = -0.5;
-      Real yUpwind = 0;
-      Real zUpwind = 0;
-      
-      // upwind displacement vector = -0.5*nodeUe/|nodeUe| (dimensionaless, dx=1)
-      const Real Ue = sqrt(sqr(nodeUe[n+0]) + sqr(nodeUe[n+1]) + sqr(nodeUe[n+2]));
-      if(Ue > 0) {
-	 const Real a = -0.5/Ue;
-	 xUpwind = nodeUe[n+0]*a;
-	 yUpwind = nodeUe[n+1]*a;
-	 zUpwind = nodeUe[n+2]*a;
-      }
-      
-      // cell centroid local dimensionless coordinates
-      const Real xCell111 = -0.5; const Real yCell111 = -0.5; const Real zCell111 = -0.5;
-      const Real xCell112 = -0.5; const Real yCell112 = -0.5; const Real zCell112 = +0.5;
-      const Real xCell121 = -0.5; const Real yCell121 = +0.5; const Real zCell121 = -0.5;
-      const Real xCell211 = +0.5; const Real yCell211 = -0.5; const Real zCell211 = -0.5;
-      const Real xCell122 = -0.5; const Real yCell122 = +0.5; const Real zCell122 = +0.5;
-      const Real xCell221 = +0.5; const Real yCell221 = +0.5; const Real zCell221 = -0.5;
-      const Real xCell212 = +0.5; const Real yCell212 = -0.5; const Real zCell212 = +0.5;
-      const Real xCell222 = +0.5; const Real yCell222 = +0.5; const Real zCell222 = +0.5;
-      
-      // weighting factors for the eight cells around the node
-      const Real w111 = 1/sqrt(sqr(xCell111-xUpwind) + sqr(yCell111-yUpwind) + sqr(zCell111-zUpwind));
-      const Real w112 = 1/sqrt(sqr(xCell112-xUpwind) + sqr(yCell112-yUpwind) + sqr(zCell112-zUpwind));
-      const Real w121 = 1/sqrt(sqr(xCell121-xUpwind) + sqr(yCell121-yUpwind) + sqr(zCell121-zUpwind));
-      const Real w211 = 1/sqrt(sqr(xCell211-xUpwind) + sqr(yCell211-yUpwind) + sqr(zCell211-zUpwind));
-      const Real w122 = 1/sqrt(sqr(xCell122-xUpwind) + sqr(yCell122-yUpwind) + sqr(zCell122-zUpwind));
-      const Real w221 = 1/sqrt(sqr(xCell221-xUpwind) + sqr(yCell221-yUpwind) + sqr(zCell221-zUpwind));
-      const Real w212 = 1/sqrt(sqr(xCell212-xUpwind) + sqr(yCell212-yUpwind) + sqr(zCell212-zUpwind));
-      const Real w222 = 1/sqrt(sqr(xCell222-xUpwind) + sqr(yCell222-yUpwind) + sqr(zCell222-zUpwind));
-      const Real wsum = w111+w112+w121+w211+w122+w221+w212+w222;
-
-      if(wsum > 0) {
-	 for(int l=0;l<3;++l) {
-	    nodeB[n+l] = (w111*tempArray[(block::arrayIndex(i+1,j+1,k+1))*3+l] +
-			  w112*tempArray[(block::arrayIndex(i+1,j+1,k+2))*3+l] +
-			  w121*tempArray[(block::arrayIndex(i+1,j+2,k+1))*3+l] +
-			  w211*tempArray[(block::arrayIndex(i+2,j+1,k+1))*3+l] +
-			  w122*tempArray[(block::arrayIndex(i+1,j+2,k+2))*3+l] +
-			  w221*tempArray[(block::arrayIndex(i+2,j+2,k+1))*3+l] +
-			  w212*tempArray[(block::arrayIndex(i+2,j+1,k+2))*3+l] +
-			  w222*tempArray[(block::arrayIndex(i+2,j+2,k+2))*3+l])/wsum;
-	 }
-      }
-      else {
-	 nodeB[n+0] = nodeB[n+1] = nodeB[n+2] = 0.0;
-      }
-   }
+   const size_t offset = blockID*block::SIZE*3;
+   if(interior == true) { fieldkernels::upwindNodeB<FieldBlock,true>(tempArray,nodeUe+offset,nodeB+offset,di,dj,dk); }
+   else { fieldkernels::upwindNodeB<FieldBlock,false>(tempArray,nodeUe+offset,nodeB+offset,di,dj,dk); }
 }
 
 // calculate cellUe
@@ -1251,6 +1355,9 @@ void calcCellUe(Real* cellJ,Real* cellJi,Real* cellRhoQi,Real* cellUe,bool* inne
 
 // E = -Ue x B + eta*J
 void calcNodeE(Real* nodeUe,Real* nodeB,
+#ifdef USE_B_CONSTANT
+Real* nodeB0,
+#endif
 #ifdef USE_RESISTIVITY
 Real* nodeEta,
 #endif
@@ -1263,52 +1370,36 @@ bool* innerFlag,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID bl
    int di=0;
    int dj=0;
    int dk=0;
-   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
-   }
-
+   const bool interior = (simClasses.pargrid.getNeighbourFlags(blockID) == pargrid::ALL_NEIGHBOURS_EXIST);
+   if(interior == false && getBoundaryOffsets(simClasses,blockID,di,dj,dk) == false) return;
+   const size_t n = blockID*block::SIZE;
+   if(interior == true) {
+      fieldkernels::calcNodeE<FieldBlock,true>(nodeUe+n*3,nodeB+n*3,
 #ifdef USE_B_CONSTANT
-   const Real* crd = getBlockCoordinateArray(sim,simClasses);
-   const size_t b3 = 3*blockID;
+					       nodeB0+n*3,
 #endif
-   for(int k=0+dk; k<block::WIDTH_Z; ++k) for(int j=0+dj; j<block::WIDTH_Y; ++j) for(int i=0+di; i<block::WIDTH_X; ++i) {
-      const int n = (blockID*block::SIZE+block::index(i,j,k));
-      const int n3 = n*3;
-      Real Btot[3];
-      Btot[0] = nodeB[n3+0];
-      Btot[1] = nodeB[n3+1];
-      Btot[2] = nodeB[n3+2];
+#ifdef USE_RESISTIVITY
+					       nodeEta+n,
+#endif
+					       nodeJ+n*3,nodeE+n*3,
+#ifdef USE_ECUT
+					       counterNodeEcut+n,Hybrid::Ecut2,
+#endif
+					       di,dj,dk);
+   }
+   else {
+      fieldkernels::calcNodeE<FieldBlock,false>(nodeUe+n*3,nodeB+n*3,
 #ifdef USE_B_CONSTANT
-      const Real xNode = crd[b3+0] + (i+1.0)*Hybrid::dx;
-      const Real yNode = crd[b3+1] + (j+1.0)*Hybrid::dx;
-      const Real zNode = crd[b3+2] + (k+1.0)*Hybrid::dx;
-      addConstantB(xNode,yNode,zNode,Btot);
+						nodeB0+n*3,
 #endif
-      nodeE[n3+0] = -(nodeUe[n3+1]*Btot[2] - nodeUe[n3+2]*Btot[1]);
-      nodeE[n3+1] = -(nodeUe[n3+2]*Btot[0] - nodeUe[n3+0]*Btot[2]);
-      nodeE[n3+2] = -(nodeUe[n3+0]*Btot[1] - nodeUe[n3+1]*Btot[0]);
 #ifdef USE_RESISTIVITY
-      nodeE[n3+0] += nodeEta[n]*nodeJ[n3+0];
-      nodeE[n3+1] += nodeEta[n]*nodeJ[n3+1];
-      nodeE[n3+2] += nodeEta[n]*nodeJ[n3+2];
+						nodeEta+n,
 #endif
+						nodeJ+n*3,nodeE+n*3,
 #ifdef USE_ECUT
-      if(Hybrid::Ecut2 > 0) {
-         const Real E2 = sqr(nodeE[n3+0]) + sqr(nodeE[n3+1]) + sqr(nodeE[n3+2]);
-         if (E2 > Hybrid::Ecut2) {
-            Real scaling = sqrt(Hybrid::Ecut2/E2);
-            nodeE[n3+0] *= scaling;
-            nodeE[n3+1] *= scaling;
-            nodeE[n3+2] *= scaling;
-            counterNodeEcut[n]++;
-         }
-      }
+						counterNodeEcut+n,Hybrid::Ecut2,
 #endif
+						di,dj,dk);
    }
 }
 
@@ -1322,67 +1413,24 @@ Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID)
    int di=0;
    int dj=0;
    int dk=0;
-   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
-   }
-   const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
-   Real Bf[size*3];
+   const bool interior = (simClasses.pargrid.getNeighbourFlags(blockID) == pargrid::ALL_NEIGHBOURS_EXIST);
+   if(interior == false && getBoundaryOffsets(simClasses,blockID,di,dj,dk) == false) return;
+   Real Bf[FieldBlock::PADDED*3];
    fetchData(faceB,Bf,simClasses,blockID,3);
-   for(int k=0+dk; k<block::WIDTH_Z; ++k) for(int j=0+dj; j<block::WIDTH_Y; ++j) for(int i=0+di; i<block::WIDTH_X; ++i) {
-      const int n = (blockID*block::SIZE+block::index(i,j,k));
-      const int n3 = n*3;
-      const Real edgeJx1 =
-        - Bf[(block::arrayIndex(i+1,j+1,k+1))*3+2]
-        + Bf[(block::arrayIndex(i+1,j+1,k+1))*3+1]
-        + Bf[(block::arrayIndex(i+1,j+2,k+1))*3+2]
-        - Bf[(block::arrayIndex(i+1,j+1,k+2))*3+1];
-      const Real edgeJx2 =
-        - Bf[(block::arrayIndex(i+2,j+1,k+1))*3+2]
-        + Bf[(block::arrayIndex(i+2,j+1,k+1))*3+1]
-        + Bf[(block::arrayIndex(i+2,j+2,k+1))*3+2]
-        - Bf[(block::arrayIndex(i+2,j+1,k+2))*3+1];
-      const Real edgeJy1 =
-        + Bf[(block::arrayIndex(i+1,j+1,k+1))*3+2]
-        + Bf[(block::arrayIndex(i+1,j+1,k+2))*3+0]
-        - Bf[(block::arrayIndex(i+2,j+1,k+1))*3+2]
-        - Bf[(block::arrayIndex(i+1,j+1,k+1))*3+0]; 
-      const Real edgeJy2 =
-        + Bf[(block::arrayIndex(i+1,j+2,k+1))*3+2]
-        + Bf[(block::arrayIndex(i+1,j+2,k+2))*3+0]
-        - Bf[(block::arrayIndex(i+2,j+2,k+1))*3+2]
-        - Bf[(block::arrayIndex(i+1,j+2,k+1))*3+0];
-      const Real edgeJz1 =
-        - Bf[(block::arrayIndex(i+1,j+1,k+1))*3+1]
-        + Bf[(block::arrayIndex(i+1,j+1,k+1))*3+0]
-        + Bf[(block::arrayIndex(i+2,j+1,k+1))*3+1]
-        - Bf[(block::arrayIndex(i+1,j+2,k+1))*3+0]; 
-      const Real edgeJz2 =
-        - Bf[(block::arrayIndex(i+1,j+1,k+2))*3+1]
-        + Bf[(block::arrayIndex(i+1,j+1,k+2))*3+0]
-        + Bf[(block::arrayIndex(i+2,j+1,k+2))*3+1]
-        - Bf[(block::arrayIndex(i+1,j+2,k+2))*3+0];
-      Real d = 1.0;
+   const size_t n = blockID*block::SIZE;
+   if(interior == true) {
+      fieldkernels::calcNodeJ<FieldBlock,true>(Bf,nodeB+n*3,nodeRhoQi+n,nodeJ+n*3,
 #ifdef USE_MAXVW
-      Real vw = 0.0; // fastest whistler signal p. 28 Alho (2016)
-      const Real ne = nodeRhoQi[n]/constants::CHARGE_ELEMENTARY;
-      const Real Btot = sqrt( sqr(nodeB[n3+0]) + sqr(nodeB[n3+1]) + sqr(nodeB[n3+2]) );
-      if(ne > 0.0 && Hybrid::dx > 0.0) {
-	vw = 2.0*Btot*M_PI/( constants::PERMEABILITY*ne*constants::CHARGE_ELEMENTARY*Hybrid::dx );
-      }
-      if (vw > Hybrid::maxVw && Hybrid::maxVw > 0.0) {
-	d = vw/Hybrid::maxVw;
-	counterNodeMaxVw[n]++;
-      }
+					       counterNodeMaxVw+n,Hybrid::maxVw,
+#endif
+					       Hybrid::dx,di,dj,dk);
+   }
+   else {
+      fieldkernels::calcNodeJ<FieldBlock,false>(Bf,nodeB+n*3,nodeRhoQi+n,nodeJ+n*3,
+#ifdef USE_MAXVW
+						counterNodeMaxVw+n,Hybrid::maxVw,
 #endif
-      const Real a = 0.5/(Hybrid::dx*constants::PERMEABILITY*d);
-      nodeJ[n3+0] = (edgeJx1 + edgeJx2)*a;
-      nodeJ[n3+1] = (edgeJy1 + edgeJy2)*a;
-      nodeJ[n3+2] = (edgeJz1 + edgeJz2)*a;
+						Hybrid::dx,di,dj,dk);
    }
 }
 
@@ -1391,48 +1439,16 @@ void calcNodeUe(Real* nodeRhoQi,Real* nodeJi,Real* nodeJ,Real* nodeUe,bool* inne
    int di=0;
    int dj=0;
    int dk=0;
-   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
+   const bool interior = (simClasses.pargrid.getNeighbourFlags(blockID) == pargrid::ALL_NEIGHBOURS_EXIST);
+   if(interior == false && getBoundaryOffsets(simClasses,blockID,di,dj,dk) == false) return;
+   const size_t n = blockID*block::SIZE;
+   if(interior == true) {
+      fieldkernels::calcNodeUe<FieldBlock,true>(nodeRhoQi+n,nodeJi+n*3,nodeJ+n*3,nodeUe+n*3,innerFlag+n,counterCellMaxUe+n,
+						Hybrid::minRhoQi,Hybrid::maxUe2,Hybrid::useHallElectricField,di,dj,dk);
    }
-   for(int k=0+dk; k<block::WIDTH_Z; ++k) for(int j=0+dj; j<block::WIDTH_Y; ++j) for(int i=0+di; i<block::WIDTH_X; ++i) {
-      const int n = (blockID*block::SIZE+block::index(i,j,k));
-      const int n3 = n*3;
-      // inner boundary condition for Ue
-      if(innerFlag[n] == true) {
-	 nodeUe[n3+0] = nodeUe[n3+1] = nodeUe[n3+2] = 0.0;
-	 continue;
-      }
-      // check min nodeRhoQi
-      if(nodeRhoQi[n] < Hybrid::minRhoQi) { nodeRhoQi[n] = Hybrid::minRhoQi; }
-      // calc Ue = (J - Ji)/rhoqi
-      for(int l=0;l<3;++l) {
-	 if(fabs(nodeRhoQi[n]) > 0) {
-            if(Hybrid::useHallElectricField == true) {
-               nodeUe[n3+l] = -(nodeJ[n3+l] - nodeJi[n3+l])/nodeRhoQi[n];
-            }
-            else {
-               nodeUe[n3+l] = nodeJi[n3+l]/nodeRhoQi[n];
-            }
-	 }
-	 else {
-	    nodeUe[n3+l] = 0.0;
-	 }
-      }
-      
-      // check max Ue
-      const Real Ue2 = sqr(nodeUe[n3+0]) + sqr(nodeUe[n3+1]) + sqr(nodeUe[n3+2]);
-      if(Ue2 > Hybrid::maxUe2) {
-	 const Real norm = sqrt(Hybrid::maxUe2/Ue2);
-	 nodeUe[n3+0] *= norm;
-	 nodeUe[n3+1] *= norm;
-	 nodeUe[n3+2] *= norm;
-         counterCellMaxUe[n]++; // using cell array here to avoid introducing a new node array
-      }
+   else {
+      fieldkernels::calcNodeUe<FieldBlock,false>(nodeRhoQi+n,nodeJi+n*3,nodeJ+n*3,nodeUe+n*3,innerFlag+n,counterCellMaxUe+n,
+						 Hybrid::minRhoQi,Hybrid::maxUe2,Hybrid::useHallElectricField,di,dj,dk);
    }
 }
 
@@ -1445,90 +1461,37 @@ void faceCurl(Real* nodeData,Real* faceData,bool doFaraday,Simulation& sim,Simul
    int di=0;
    int dj=0;
    int dk=0;
-   if(simClasses.pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_POS_EXISTS) == 0) return;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0) { doYFace = doZFace = false; }
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0) { doXFace = doZFace = false; }
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0) { doXFace = doYFace = false; }
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::X_NEG_EXISTS) == 0 && block::WIDTH_X > 1) di = block::WIDTH_X-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Y_NEG_EXISTS) == 0 && block::WIDTH_Y > 1) dj = block::WIDTH_Y-1;
-      if((simClasses.pargrid.getNeighbourFlags()[blockID] & Hybrid::Z_NEG_EXISTS) == 0 && block::WIDTH_Z > 1) dk = block::WIDTH_Z-1;
+   const bool interior = (simClasses.pargrid.getNeighbourFlags(blockID) == pargrid::ALL_NEIGHBOURS_EXIST);
+   if(interior == false) {
+      if(getBoundaryOffsets(simClasses,blockID,di,dj,dk) == false) return;
+      const uint32_t flags = simClasses.pargrid.getNeighbourFlags()[blockID];
+      if((flags & Hybrid::X_NEG_EXISTS) == 0) { doYFace = doZFace = false; }
+      if((flags & Hybrid::Y_NEG_EXISTS) == 0) { doXFace = doZFace = false; }
+      if((flags & Hybrid::Z_NEG_EXISTS) == 0) { doXFace = doYFace = false; }
    }
    
 #ifdef USE_XMIN_BOUNDARY
    bool* xMinFlag = simClasses.pargrid.getUserDataStatic<bool>(Hybrid::dataXminFlagID);
    if(xMinFlag == NULL) {cerr << "ERROR: obtained NULL xMinFlag array!" << endl; exit(1);}
+   xMinFlag += blockID*block::SIZE;
 #endif
 
-   const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
-   Real array[size*3];
+   Real array[FieldBlock::PADDED*3];
    fetchData(nodeData,array,simClasses,blockID,3);
-   
-   for(int k=0+dk; k<block::WIDTH_Z; ++k) for(int j=0+dj; j<block::WIDTH_Y; ++j) for(int i=0+di; i<block::WIDTH_X; ++i) {
-      const int n = (blockID*block::SIZE+block::index(i,j,k));
-      const int n3 = 3*n;
+   Real* faceBlock = faceData + blockID*block::SIZE*3;
+   if(interior == true) {
+      fieldkernels::faceCurl<FieldBlock,true>(array,faceBlock,doFaraday,sim.dt,Hybrid::dx,
 #ifdef USE_XMIN_BOUNDARY
-      // no field propagation at x < xmin
-      if(xMinFlag[n] == true && doFaraday == true) { continue; }
+					      xMinFlag,
 #endif
-
-      Real node1x = array[(block::arrayIndex(i+0,j+0,k+1))*3+0];
-      Real node1y = array[(block::arrayIndex(i+0,j+0,k+1))*3+1];
-      //Real node1z = array[(block::arrayIndex(i+0,j+0,k+1))*3+2];
-      
-      Real node3x = array[(block::arrayIndex(i+0,j+1,k+0))*3+0];
-      //Real node3y = array[(block::arrayIndex(i+0,j+1,k+0))*3+1];
-      Real node3z = array[(block::arrayIndex(i+0,j+1,k+0))*3+2];
-      
-      Real node4x = array[(block::arrayIndex(i+0,j+1,k+1))*3+0];
-      Real node4y = array[(block::arrayIndex(i+0,j+1,k+1))*3+1];
-      Real node4z = array[(block::arrayIndex(i+0,j+1,k+1))*3+2];      
-
-      Real node5x = array[(block::arrayIndex(i+1,j+0,k+1))*3+0];
-      Real node5y = array[(block::arrayIndex(i+1,j+0,k+1))*3+1];
-      Real node5z = array[(block::arrayIndex(i+1,j+0,k+1))*3+2];
-
-      //Real node6x = array[(block::arrayIndex(i+1,j+0,k+0))*3+0];
-      Real node6y = array[(block::arrayIndex(i+1,j+0,k+0))*3+1];
-      Real node6z = array[(block::arrayIndex(i+1,j+0,k+0))*3+2];
-      
-      Real node7x = array[(block::arrayIndex(i+1,j+1,k+0))*3+0];
-      Real node7y = array[(block::arrayIndex(i+1,j+1,k+0))*3+1];
-      Real node7z = array[(block::arrayIndex(i+1,j+1,k+0))*3+2];
-      
-      Real node8x = array[(block::arrayIndex(i+1,j+1,k+1))*3+0];
-      Real node8y = array[(block::arrayIndex(i+1,j+1,k+1))*3+1];
-      Real node8z = array[(block::arrayIndex(i+1,j+1,k+1))*3+2];
-      
-      if(doXFace == true) {
-	 Real curlX = 0.5*(+node5z+node6z-node6y-node7y-node7z-node8z+node8y+node5y)/Hybrid::dx;
-	 if(doFaraday == true) {
-	    faceData[n3+0] += sim.dt*curlX; // Faraday's law
-	 }
-	 else {
-	    faceData[n3+0] = -curlX/constants::PERMEABILITY; // Ampere's law
-	 }
-      }      
-      if(doYFace == true) {
-	 Real curlY = 0.5*(-node4x-node8x+node8z+node7z+node7x+node3x-node3z-node4z)/Hybrid::dx;
-	 if(doFaraday == true) {
-	    faceData[n3+1] += sim.dt*curlY;
-	 }
-	 else {
-	    faceData[n3+1] = -curlY/constants::PERMEABILITY;
-	 }
-      }
-      if(doZFace == true) {
-	 Real curlZ = 0.5*(-node1x-node5x-node5y-node8y+node8x+node4x+node4y+node1y)/Hybrid::dx;
-	 if(doFaraday == true) {
-	    faceData[n3+2] += sim.dt*curlZ;
-	 }
-	 else {
-	    faceData[n3+2] = -curlZ/constants::PERMEABILITY;
-	 }
-      }
+					      doXFace,doYFace,doZFace,di,dj,dk);
+   }
+   else {
+      fieldkernels::faceCurl<FieldBlock,false>(array,faceBlock,doFaraday,sim.dt,Hybrid::dx,
+#ifdef USE_XMIN_BOUNDARY
+					       xMinFlag,
+#endif
+					       doXFace,doYFace,doZFace,di,dj,dk);
    }
 }
 
@@ -1539,7 +1502,12 @@ void face2r(Real* r,Real* faceData,Simulation& sim,SimulationClasses& simClasses
    const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
    Real array[size*3];
    fetchData(faceData,array,simClasses,blockID,3);
-   
+   face2rLocal(r,array,result);
+}
+
+// interpolation from faces to arbitrary point r using already fetched block data (array from fetchData)
+void face2rLocal(const Real* r,const Real* array,Real* result)
+{
    // dimensionless local coordinates
    const Real x=r[0]/Hybrid::dx;
    const Real y=r[1]/Hybrid::dx;
@@ -1634,16 +1602,15 @@ void cell2r(Real* r,Real* cellData,Simulation& sim,SimulationClasses& simClasses
    const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
    Real array[size*3];
    fetchData(cellData,array,simClasses,blockID,3);
-   
-   // dimensionless local coordinates
-   const Real x=r[0]/Hybrid::dx;
-   const Real y=r[1]/Hybrid::dx;
-   const Real z=r[2]/Hybrid::dx;
+   cell2rLocal(r,array,result);
+}
 
+// zero order interpolation from cells to arbitrary point r using already fetched block data (array from fetchData)
+void cell2rLocal(const Real* r,const Real* array,Real* result) {
    // local indices of the cell the point is in
-   const int i = static_cast<int>(floor(x));
-   const int j = static_cast<int>(floor(y));
-   const int k = static_cast<int>(floor(z));
+   const int i = static_cast<int>(floor(r[0]/Hybrid::dx));
+   const int j = static_cast<int>(floor(r[1]/Hybrid::dx));
+   const int k = static_cast<int>(floor(r[2]/Hybrid::dx));
    
    for(int l=0;l<3;++l) {
       result[l] = array[(block::arrayIndex(i+1,j+1,k+1))*3+l];
@@ -1651,230 +1618,204 @@ void cell2r(Real* r,Real* cellData,Simulation& sim,SimulationClasses& simClasses
 }
 
 // exchange faceB and nodeE
+/** Compare global IDs of local and remote blocks to those of the previous call and
+ * increment Hybrid::partitionCounter if they differ on any process. Collective, called
+ * once per timestep before any per-partition caches are used, so that caches only need
+ * to compare counters and collective rebuilds happen on all processes at the same time.
+ * @param simClasses Generic simulation classes.
+ * @return If true, blocks have changed since the previous call.*/
+bool checkPartitioning(SimulationClasses& simClasses) {
+   const vector<pargrid::CellID>& globalIDs = simClasses.pargrid.getGlobalIDs();
+   int changed = (Hybrid::partitionCounter == 0 || globalIDs != Hybrid::partitionGlobalIDs);
+   MPI_Allreduce(MPI_IN_PLACE,&changed,1,MPI_INT,MPI_LOR,simClasses.pargrid.getComm());
+   if(changed == 0) { return false; }
+   Hybrid::partitionGlobalIDs = globalIDs;
+   ++Hybrid::partitionCounter;
+   return true;
+}
+
 void setupGetFields(Simulation& sim,SimulationClasses& simClasses) {
    profile::start("setupGetFields",setupGetFieldsID);
    Real* faceB = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataFaceBID);
    Real* nodeE = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataNodeEID);
    if(faceB == NULL) {cerr << "ERROR: obtained NULL faceB array!" << endl; exit(1);}
    if(nodeE == NULL) {cerr << "ERROR: obtained NULL nodeE array!" << endl; exit(1);}
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataFaceBID);
-   simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeEID);
+#ifdef USE_BATCHED_EXCHANGE
+   exchangeFaceBNodeE.start(simClasses);
    profile::start("MPI waits",mpiWaitID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataFaceBID);
-   simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeEID);
+   exchangeFaceBNodeE.wait(simClasses);
    profile::stop();
+#else
+   startExchange(simClasses,Hybrid::dataFaceBID);
+   startExchange(simClasses,Hybrid::dataNodeEID);
+   profile::start("MPI waits",mpiWaitID);
+   waitExchange(simClasses,Hybrid::dataFaceBID);
+   waitExchange(simClasses,Hybrid::dataNodeEID);
+   profile::stop();
+#endif
+#ifdef USE_FIELD_CACHE
+   buildFieldCache(sim,simClasses);
+#endif
    profile::stop();
 }
 
-// get E, B and Ue fields at arbitrary point r
-void getFields(Real* r,Real* B,Real* Ue,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID) {
-   Real* faceB  = reinterpret_cast<Real*>(simClasses.pargrid.getUserData(Hybrid::dataFaceBID));
-   //Real* nodeE  = reinterpret_cast<Real*>(simClasses.pargrid.getUserData(Hybrid::dataNodeEID));
-   Real* cellUe = reinterpret_cast<Real*>(simClasses.pargrid.getUserData(Hybrid::dataCellUeID));
-   face2r(r,faceB,sim,simClasses,blockID,B);
-   //node2r(r,nodeE,sim,simClasses,blockID,E);
-   cell2r(r,cellUe,sim,simClasses,blockID,Ue);
+#ifdef USE_FIELD_CACHE
+// fetch faceB and cellUe of each local block and its neighbours into the field cache
+void buildFieldCache(Simulation& sim,SimulationClasses& simClasses) {
+   profile::start("field cache",fieldCacheID);
+   Real* faceB      = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataFaceBID);
+   Real* cellUe     = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataCellUeID);
+   Real* fieldCache = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataFieldCacheID);
+   if(faceB      == NULL) {cerr << "ERROR: obtained NULL faceB array!"      << endl; exit(1);}
+   if(cellUe     == NULL) {cerr << "ERROR: obtained NULL cellUe array!"     << endl; exit(1);}
+   if(fieldCache == NULL) {cerr << "ERROR: obtained NULL fieldCache array!" << endl; exit(1);}
+   const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
+   #ifdef _OPENMP
+      #pragma omp parallel for schedule(static)
+   #endif
+   for(pargrid::CellID b=0; b<simClasses.pargrid.getNumberOfLocalCells(); ++b) {
+      // particles are accelerated only in blocks with all neighbours
+      if(simClasses.pargrid.getNeighbourFlags(b) != pargrid::ALL_NEIGHBOURS_EXIST) { continue; }
+      Real* cache = fieldCache + b*FIELD_CACHE_SIZE;
+      fetchData(faceB,cache,simClasses,b,3);
+      fetchData(cellUe,cache+size*3,simClasses,b,3);
+#ifdef USE_B0_INTERPOLATION
+      addFaceB0(cache,simClasses,b);
+#endif
+   }
+   profile::stop();
 }
+#endif
 
-// fetch ALL neighours
-void fetchData(Real* data,Real* array,SimulationClasses& simClasses,pargrid::CellID blockID,int vectorDim) {
-   pargrid::CellID nbrLID = simClasses.pargrid.invalid();
-   const pargrid::CellID* const nbrs = simClasses.pargrid.getCellNeighbourIDs(blockID);   
-   
-   // THIS BLOCK
-      
-   for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
-      array[block::arrayIndex(i+1,j+1,k+1)*vectorDim+l] = data[(blockID*block::SIZE+block::index(i,j,k))*vectorDim+l];
-   }
-   
-   // FACE NEIGHBOURS
+#ifdef USE_B0_INTERPOLATION
+// add the constant magnetic field to faceB of a block and its neighbours fetched by fetchData,
+// B0 is then interpolated to particle positions together with faceB by face2rLocal
+void addFaceB0(Real* faceBArray,SimulationClasses& simClasses,pargrid::CellID blockID) {
+   const Real* faceB0 = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataFaceB0ID) + blockID*FACE_B0_SIZE;
+   for(int i=0;i<FACE_B0_SIZE;++i) { faceBArray[i] += faceB0[i]; }
+}
 
-   // -x
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,+0,+0)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(0,j+1,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,j,k))*vectorDim+l];
-      }
-   }
-   // -y
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,-1,+0)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int k=0;k<block::WIDTH_Z;++k) for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(i+1,0,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,block::WIDTH_Y-1,k))*vectorDim+l];
-      }
-   }
-   // -z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,+0,-1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(i+1,j+1,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,j,block::WIDTH_Z-1))*vectorDim+l];
-      }
-   }
-   // +x
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,+0,+0)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(block::WIDTH_X+1,j+1,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,j,k))*vectorDim+l];
+// compare B0 interpolated from faceB0 to B0 evaluated at random points, one per cell,
+// of all local blocks where particles are accelerated and write the errors and costs to the log
+static bool reportB0Interpolation(Simulation& sim,SimulationClasses& simClasses) {
+   const Real* faceB0 = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataFaceB0ID);
+   const Real* crd = getBlockCoordinateArray(sim,simClasses);
+   const Real R2 = sqr(Hybrid::R_object);
+   vector<Real> rLocal;
+   vector<pargrid::CellID> blocks;
+   Real u[block::SIZE*3];
+   for(pargrid::CellID b=0; b<simClasses.pargrid.getNumberOfLocalCells(); ++b) {
+      if(simClasses.pargrid.getNeighbourFlags(b) != pargrid::ALL_NEIGHBOURS_EXIST) { continue; }
+      // stream 0 is not used by particle injectors
+      RandomStream random(Hybrid::randomSeed,0,0,simClasses.pargrid.getGlobalIDs()[b]);
+      random.uniform(u,block::SIZE*3);
+      for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) {
+	 const int n3 = block::index(i,j,k)*3;
+	 const Real r[3] = {(i+u[n3+0])*Hybrid::dx,(j+u[n3+1])*Hybrid::dx,(k+u[n3+2])*Hybrid::dx};
+	 // no particles inside the object
+	 if(sqr(crd[3*b+0]+r[0]) + sqr(crd[3*b+1]+r[1]) + sqr(crd[3*b+2]+r[2]) < R2) { continue; }
+	 for(int l=0;l<3;++l) { rLocal.push_back(r[l]); }
+	 blocks.push_back(b);
       }
    }
-   // +y
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,+1,+0)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int k=0;k<block::WIDTH_Z;++k) for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(i+1,block::WIDTH_Y+1,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,0,k))*vectorDim+l];
-      }
+   const size_t N = blocks.size();
+   vector<Real> B_analytic(N*3,0.0);
+   vector<Real> B_interpolated(N*3,0.0);
+   const double t_analytic = MPI_Wtime();
+   for(size_t p=0;p<N;++p) {
+      const size_t b3 = 3*blocks[p];
+      addConstantB(crd[b3+0]+rLocal[3*p+0],crd[b3+1]+rLocal[3*p+1],crd[b3+2]+rLocal[3*p+2],&B_analytic[3*p]);
    }
-   // +z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,+0,+1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(i+1,j+1,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,j,0))*vectorDim+l];
-      }
+   const double t_interpolated = MPI_Wtime();
+   for(size_t p=0;p<N;++p) {
+      face2rLocal(&rLocal[3*p],faceB0+blocks[p]*FACE_B0_SIZE,&B_interpolated[3*p]);
    }
-      
-   // EDGE NEIGHBOURS
+   const double t_end = MPI_Wtime();
 
-   // -x,-y
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,-1,+0)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int k=0;k<block::WIDTH_Z;++k) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(0,0,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,block::WIDTH_Y-1,k))*vectorDim+l];
-      }
-   }
-   // +x,-y
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,-1,+0)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int k=0;k<block::WIDTH_Z;++k) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(block::WIDTH_X+1,0,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,block::WIDTH_Y-1,k))*vectorDim+l];
-      }
-   }
-   // -x,+y
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,+1,+0)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int k=0;k<block::WIDTH_Z;++k) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(0,block::WIDTH_Y+1,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,0,k))*vectorDim+l];
-      }
+   // relative error |B_interpolated - B_analytic|/|B_analytic|
+   double errorMax = 0.0;
+   double sumsLocal[4] = {0.0,0.0,t_interpolated-t_analytic,t_end-t_interpolated};
+   for(size_t p=0;p<N;++p) {
+      const Real* Ba = &B_analytic[3*p];
+      const Real* Bi = &B_interpolated[3*p];
+      const Real normB = normvec(Ba);
+      if(normB <= 0.0) { continue; }
+      const Real dB[3] = {Bi[0]-Ba[0],Bi[1]-Ba[1],Bi[2]-Ba[2]};
+      const double error = normvec(dB)/normB;
+      errorMax = max(errorMax,error);
+      sumsLocal[0] += 1.0;
+      sumsLocal[1] += error*error;
    }
-   // +x,+y
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,+1,+0)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int k=0;k<block::WIDTH_Z;++k) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(block::WIDTH_X+1,block::WIDTH_Y+1,k+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,0,k))*vectorDim+l];
-      }
-   }
-   // -y,-z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,-1,-1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(i+1,0,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,block::WIDTH_Y-1,block::WIDTH_Z-1))*vectorDim+l];
-      }
-   }
-   // +y,-z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,+1,-1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(i+1,block::WIDTH_Y+1,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,0,block::WIDTH_Z-1))*vectorDim+l];
-      }
+   double sumsGlobal[4] = {0.0,0.0,0.0,0.0};
+   double errorMaxGlobal = 0.0;
+   MPI_Reduce(sumsLocal,sumsGlobal,4,MPI_Type<double>(),MPI_SUM,sim.MASTER_RANK,sim.comm);
+   MPI_Reduce(&errorMax,&errorMaxGlobal,1,MPI_Type<double>(),MPI_MAX,sim.MASTER_RANK,sim.comm);
+   if(sim.mpiRank == sim.MASTER_RANK && sumsGlobal[0] > 0.0) {
+      simClasses.logger
+	<< "(RHYBRID) B0 interpolation from faces: " << sumsGlobal[0] << " sample points, relative error max = "
+	<< errorMaxGlobal << ", rms = " << sqrt(sumsGlobal[1]/sumsGlobal[0]) << ", cost "
+	<< 1e9*sumsGlobal[2]/sumsGlobal[0] << " ns/point evaluated, "
+	<< 1e9*sumsGlobal[3]/sumsGlobal[0] << " ns/point interpolated" << endl << write;
    }
-   // -y,+z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,-1,+1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(i+1,0,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,block::WIDTH_Y-1,0))*vectorDim+l];
-      }
-   }
-   // +y,+z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+0,+1,+1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int i=0;i<block::WIDTH_X;++i) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(i+1,block::WIDTH_Y+1,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(i,0,0))*vectorDim+l];
-      }
-   }
-   // -x,-z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,+0,-1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int j=0;j<block::WIDTH_Y;++j) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(0,j+1,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,j,block::WIDTH_Z-1))*vectorDim+l];
-      }
-   }
-   // +x,-z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,+0,-1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int j=0;j<block::WIDTH_Y;++j) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(block::WIDTH_X+1,j+1,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,j,block::WIDTH_Z-1))*vectorDim+l];
-      }
-   }
-   // -x,+z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,+0,+1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int j=0;j<block::WIDTH_Y;++j) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(0,j+1,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,j,0))*vectorDim+l];
-      }
-   }
-   // +x,+z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,+0,+1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int j=0;j<block::WIDTH_Y;++j) for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(block::WIDTH_X+1,j+1,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,j,0))*vectorDim+l];
-      }
-   }
-   
-   // CORNER NEIGHBOURS
-    
-   // -x,-y,-z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,-1,-1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(0,0,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,block::WIDTH_Y-1,block::WIDTH_Z-1))*vectorDim+l];
-      }
-   }
-   // +x,-y,-z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,-1,-1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(block::WIDTH_X+1,0,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,block::WIDTH_Y-1,block::WIDTH_Z-1))*vectorDim+l];
-      }
-   }
-   // -x,+y,-z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,+1,-1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(0,block::WIDTH_Y+1,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,0,block::WIDTH_Z-1))*vectorDim+l];
-      }
-   }
-   // +x,+y,-z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,+1,-1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(block::WIDTH_X+1,block::WIDTH_Y+1,0)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,0,block::WIDTH_Z-1))*vectorDim+l];
-      }
-   }
-   // -x,-y,+z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,-1,+1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(0,0,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,block::WIDTH_Y-1,0))*vectorDim+l];
-      }
-   }
-   // +x,-y,+z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,-1,+1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(block::WIDTH_X+1,0,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,block::WIDTH_Y-1,0))*vectorDim+l];
-      }
+   return true;
+}
+
+// constant magnetic field at the faces of each local block and its neighbours in the
+// layout of fetchData, array index (i,j,k) is the cell (i-1,j-1,k-1) of the block
+bool initializeFaceB0(Simulation& sim,SimulationClasses& simClasses) {
+   Real* faceB0 = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataFaceB0ID);
+   if(faceB0 == NULL) {
+      simClasses.logger << "(RHYBRID) ERROR: obtained NULL faceB0 array!" << endl << write;
+      return false;
    }
-   // -x,+y,+z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(-1,+1,+1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(0,block::WIDTH_Y+1,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(block::WIDTH_X-1,0,0))*vectorDim+l];
+   const Real* crd = getBlockCoordinateArray(sim,simClasses);
+   const Real dx = Hybrid::dx;
+   for(pargrid::CellID b=0; b<simClasses.pargrid.getNumberOfLocalCells(); ++b) {
+      const size_t b3 = 3*b;
+      Real* array = faceB0 + b*FACE_B0_SIZE;
+      for(int k=0;k<block::WIDTH_Z+2;++k) for(int j=0;j<block::WIDTH_Y+2;++j) for(int i=0;i<block::WIDTH_X+2;++i) {
+	 const int n3 = block::arrayIndex(i,j,k)*3;
+	 Real B0[3] = {0.0,0.0,0.0};
+	 // +x face
+	 addConstantB(crd[b3+0]+i*dx,crd[b3+1]+(j-0.5)*dx,crd[b3+2]+(k-0.5)*dx,B0);
+	 array[n3+0] = B0[0];
+	 // +y face
+	 B0[0] = B0[1] = B0[2] = 0.0;
+	 addConstantB(crd[b3+0]+(i-0.5)*dx,crd[b3+1]+j*dx,crd[b3+2]+(k-0.5)*dx,B0);
+	 array[n3+1] = B0[1];
+	 // +z face
+	 B0[0] = B0[1] = B0[2] = 0.0;
+	 addConstantB(crd[b3+0]+(i-0.5)*dx,crd[b3+1]+(j-0.5)*dx,crd[b3+2]+k*dx,B0);
+	 array[n3+2] = B0[2];
       }
    }
-   // +x,+y,+z
-   nbrLID = nbrs[simClasses.pargrid.calcNeighbourTypeID(+1,+1,+1)];
-   if(nbrLID != simClasses.pargrid.invalid()) {
-      for(int l=0;l<vectorDim;++l) {
-	 array[block::arrayIndex(block::WIDTH_X+1,block::WIDTH_Y+1,block::WIDTH_Z+1)*vectorDim+l] = data[(nbrLID*block::SIZE+block::index(0,0,0))*vectorDim+l];
-      }
+   return reportB0Interpolation(sim,simClasses);
+}
+#endif
+
+// get E, B and Ue fields at arbitrary point r
+void getFields(Real* r,Real* B,Real* Ue,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID) {
+   Real* faceB  = reinterpret_cast<Real*>(simClasses.pargrid.getUserData(Hybrid::dataFaceBID));
+   //Real* nodeE  = reinterpret_cast<Real*>(simClasses.pargrid.getUserData(Hybrid::dataNodeEID));
+   Real* cellUe = reinterpret_cast<Real*>(simClasses.pargrid.getUserData(Hybrid::dataCellUeID));
+   face2r(r,faceB,sim,simClasses,blockID,B);
+   //node2r(r,nodeE,sim,simClasses,blockID,E);
+   cell2r(r,cellUe,sim,simClasses,blockID,Ue);
+}
+
+// get B and Ue fields at arbitrary point r using block data fetched once per block (faceB and cellUe arrays from fetchData)
+void getFieldsLocal(const Real* r,const Real* faceBArray,const Real* cellUeArray,Real* B,Real* Ue) {
+   face2rLocal(r,faceBArray,B);
+   cell2rLocal(r,cellUeArray,Ue);
+}
+
+// fetch ALL neighours
+void fetchData(Real* data,Real* array,SimulationClasses& simClasses,pargrid::CellID blockID,int vectorDim) {
+   const pargrid::CellID* const nbrs = simClasses.pargrid.getCellNeighbourIDs(blockID);
+   pargrid::CellID nbrLIDs[27];
+   for(int k=-1;k<=1;++k) for(int j=-1;j<=1;++j) for(int i=-1;i<=1;++i) {
+      if(i == 0 && j == 0 && k == 0) { nbrLIDs[FieldBlock::neighbourIndex(i,j,k)] = blockID; }
+      else { nbrLIDs[FieldBlock::neighbourIndex(i,j,k)] = nbrs[simClasses.pargrid.calcNeighbourTypeID(i,j,k)]; }
    }
+   fieldkernels::fetchData<FieldBlock,pargrid::CellID>(data,array,nbrLIDs,simClasses.pargrid.invalid(),vectorDim);
 }
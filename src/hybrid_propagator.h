@@ -36,6 +36,9 @@ void nodeAvg(Real* nodeDataOld,Real* nodeData,Simulation& sim,SimulationClasses&
 void upwindNodeB(Real* cellB,Real* nodeUe,Real* nodeB,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID);
 void calcCellUe(Real* cellJ,Real* cellJi,Real* cellRhoQi,Real* cellUe,bool* innerFlag,Real* counterCellMaxUe,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID);
 void calcNodeE(Real* nodeUe,Real* nodeB,
+#ifdef USE_B_CONSTANT
+Real* nodeB0,
+#endif
 #ifdef USE_RESISTIVITY
 Real* nodeEta,
 #endif
@@ -52,10 +55,26 @@ Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID);
 void calcNodeUe(Real* nodeRhoQi,Real* nodeJi,Real* nodeJ,Real* nodeUe,bool* innerFlag,Real* counterCellMaxUe,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID);
 void faceCurl(Real* nodeData,Real* faceData,bool doFaraday,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID);
 void face2r(Real* r,Real* faceData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID,Real* result);
+void face2rLocal(const Real* r,const Real* array,Real* result);
 void node2r(Real* r,Real* nodeData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID,Real* result);
 void cell2r(Real* r,Real* cellData,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID,Real* result);
+void cell2rLocal(const Real* r,const Real* array,Real* result);
 void setupGetFields(Simulation& sim,SimulationClasses& simClasses);
+bool checkPartitioning(SimulationClasses& simClasses);
+bool checkFieldKernelLayout();
+#if defined(USE_BATCHED_EXCHANGE) || defined(USE_SHARED_MEMORY_EXCHANGE)
+bool finalizeHaloExchanges(SimulationClasses& simClasses);
+bool initializeHaloExchanges(SimulationClasses& simClasses);
+#endif
+#ifdef USE_FIELD_CACHE
+void buildFieldCache(Simulation& sim,SimulationClasses& simClasses);
+#endif
+#ifdef USE_B0_INTERPOLATION
+void addFaceB0(Real* faceBArray,SimulationClasses& simClasses,pargrid::CellID blockID);
+bool initializeFaceB0(Simulation& sim,SimulationClasses& simClasses);
+#endif
 void getFields(Real* r,Real* B,Real* Ue,Simulation& sim,SimulationClasses& simClasses,pargrid::CellID blockID);
+void getFieldsLocal(const Real* r,const Real* faceBArray,const Real* cellUeArray,Real* B,Real* Ue);
 void fetchData(Real* data,Real* array,SimulationClasses& simClasses,pargrid::CellID blockID,int vectorDim);
 
 #endif
@@ -23,6 +23,26 @@
 
 #if defined(USE_B_INITIAL) || defined(USE_B_CONSTANT)
 
+/** Precompute the dipole rotation matrix R_x(phi)*R_y(theta) from thetaDip and phiDip.
+ * Rotation matrix R_y(theta) (=theta around y):
+ * x'      cos theta     0   sin theta   x
+ * y'   =      0         1      0        y
+ * z'      -sin theta    0   cos theta   z
+ * Rotation matrix R_x(phi) (=phi around x):
+ * x'          1         0      0       x
+ * y'   =      0   cos phi   -sin phi   y
+ * z'          0   sin phi    cos phi   z*/
+inline void setDipoleRotation() {
+   const Real ct = cos(Hybrid::thetaDip*M_PI/180.0);
+   const Real st = sin(Hybrid::thetaDip*M_PI/180.0);
+   const Real cp = cos(Hybrid::phiDip*M_PI/180.0);
+   const Real sp = sin(Hybrid::phiDip*M_PI/180.0);
+   Real* M = Hybrid::dipRotation;
+   M[0] = ct;     M[1] = 0.0; M[2] = st;
+   M[3] = sp*st;  M[4] = cp;  M[5] = -sp*ct;
+   M[6] = -cp*st; M[7] = sp;  M[8] = cp*ct;
+}
+
 inline void constantBx(Real x,Real y,Real z,Real B[3]) {
    B[0] += Hybrid::IMFBx;
 }
@@ -44,24 +64,11 @@ inline void hemisphericDipoleB(Real x,Real y,Real z,Real B[3]) {
    const Real x1 = x - Hybrid::xDip;
    const Real y1 = y - Hybrid::yDip;
    const Real z1 = z - Hybrid::zDip;
-   
-   //Rotation matrix R_y(theta) (=theta around y):
-   // x'      cos theta     0   sin theta   x
-   // y'   =      0         1      0        y
-   // z'      -sin theta    0   cos theta   z
-   //Rotation matrix R_x(phi) (=phi around x):
-   // x'          1         0      0       x
-   // y'   =      0   cos phi   -sin phi   y
-   // z'          0   sin phi    cos phi   z
-   
-   // (x2,y2,z2) = R_y(theta) (x1,y1,z1)   
-   const Real x2 = x1*cos(Hybrid::thetaDip*M_PI/180.0) + z1*sin(Hybrid::thetaDip*M_PI/180.0);
-   const Real y2 = y1;
-   const Real z2 = -x1*sin(Hybrid::thetaDip*M_PI/180.0) + z1*cos(Hybrid::thetaDip*M_PI/180.0);
-   // (x3,y3,z3) = R_x(phi) (x2,y2,z2)
-   const Real x3 = x2;
-   const Real y3 = y2*cos(Hybrid::phiDip*M_PI/180.0) - z2*sin(Hybrid::phiDip*M_PI/180.0);
-   const Real z3 = y2*sin(Hybrid::phiDip*M_PI/180.0) + z2*cos(Hybrid::phiDip*M_PI/180.0);
+   // (x3,y3,z3) = R_x(phi) R_y(theta) (x1,y1,z1)
+   const Real* M = Hybrid::dipRotation;
+   const Real x3 = M[0]*x1 + M[1]*y1 + M[2]*z1;
+   const Real y3 = M[3]*x1 + M[4]*y1 + M[5]*z1;
+   const Real z3 = M[6]*x1 + M[7]*y1 + M[8]*z1;
    const Real rr = sqr(x3) + sqr(y3) + sqr(z3);
    if(rr < Hybrid::dipMinR2) { return; }
    const Real r = sqrt(rr);
@@ -71,14 +78,10 @@ inline void hemisphericDipoleB(Real x,Real y,Real z,Real B[3]) {
    const Real Bx1 = coeff*x3*(Hybrid::coeffDip*z3 + 0.5*Hybrid::coeffQuad*Hybrid::dipSurfR*(5*sqr(z3)/rr - 1));
    const Real By1 = coeff*y3*(Hybrid::coeffDip*z3 + 0.5*Hybrid::coeffQuad*Hybrid::dipSurfR*(5*sqr(z3)/rr - 1));
    const Real Bz1 = coeff*(Hybrid::coeffDip*(sqr(z3) - rr/3.0) + 0.5*Hybrid::coeffQuad*Hybrid::dipSurfR*z*(5*sqr(z3) - 3*rr)/rr);
-   // B2 = R_x(-phi) B1
-   const Real Bx2 = Bx1;
-   const Real By2 =  By1*cos(Hybrid::phiDip*M_PI/180.0) + Bz1*sin(Hybrid::phiDip*M_PI/180.0);
-   const Real Bz2 = -By1*sin(Hybrid::phiDip*M_PI/180.0) + Bz1*cos(Hybrid::phiDip*M_PI/180.0);
-   // B = R_y(-theta) B2
-   B[0] += Bx2*cos(Hybrid::thetaDip*M_PI/180.0) - Bz2*sin(Hybrid::thetaDip*M_PI/180.0);
-   B[1] += By2;
-   B[2] += Bx2*sin(Hybrid::thetaDip*M_PI/180.0) + Bz2*cos(Hybrid::thetaDip*M_PI/180.0);
+   // B = R_y(-theta) R_x(-phi) B1, i.e. the transpose of the rotation
+   B[0] += M[0]*Bx1 + M[3]*By1 + M[6]*Bz1;
+   B[1] += M[1]*Bx1 + M[4]*By1 + M[7]*Bz1;
+   B[2] += M[2]*Bx1 + M[5]*By1 + M[8]*Bz1;
 }
 
 inline void translateDipoleB(Real x,Real y,Real z,Real B[3]) {
@@ -101,24 +104,11 @@ inline void generalDipoleB(Real x,Real y,Real z,Real B[3]) {
    const Real x1 = x - Hybrid::xDip;
    const Real y1 = y - Hybrid::yDip;
    const Real z1 = z - Hybrid::zDip;
-   
-   //Rotation matrix R_y(theta) (=theta around y):
-   // x'      cos theta     0   sin theta   x
-   // y'   =      0         1      0        y
-   // z'      -sin theta    0   cos theta   z
-   //Rotation matrix R_x(phi) (=phi around x):
-   // x'          1         0      0       x
-   // y'   =      0   cos phi   -sin phi   y
-   // z'          0   sin phi    cos phi   z
-   
-   // (x2,y2,z2) = R_y(theta) (x1,y1,z1)   
-   const Real x2 = x1*cos(Hybrid::thetaDip*M_PI/180.0) + z1*sin(Hybrid::thetaDip*M_PI/180.0);
-   const Real y2 = y1;
-   const Real z2 = -x1*sin(Hybrid::thetaDip*M_PI/180.0) + z1*cos(Hybrid::thetaDip*M_PI/180.0);
-   // (x3,y3,z3) = R_x(phi) (x2,y2,z2)
-   const Real x3 = x2;
-   const Real y3 = y2*cos(Hybrid::phiDip*M_PI/180.0) - z2*sin(Hybrid::phiDip*M_PI/180.0);
-   const Real z3 = y2*sin(Hybrid::phiDip*M_PI/180.0) + z2*cos(Hybrid::phiDip*M_PI/180.0);
+   // (x3,y3,z3) = R_x(phi) R_y(theta) (x1,y1,z1)
+   const Real* M = Hybrid::dipRotation;
+   const Real x3 = M[0]*x1 + M[1]*y1 + M[2]*z1;
+   const Real y3 = M[3]*x1 + M[4]*y1 + M[5]*z1;
+   const Real z3 = M[6]*x1 + M[7]*y1 + M[8]*z1;
    const Real rr = sqr(x3) + sqr(y3) + sqr(z3);
    if(rr < Hybrid::dipMinR2) { return; }
    const Real r = sqrt(rr);
@@ -128,14 +118,10 @@ inline void generalDipoleB(Real x,Real y,Real z,Real B[3]) {
    const Real Bx1 = coeff*x3*z3;
    const Real By1 = coeff*y3*z3;
    const Real Bz1 = coeff*(sqr(z3) - rr/3.0);
-   // B2 = R_x(-phi) B1
-   const Real Bx2 = Bx1;
-   const Real By2 =  By1*cos(Hybrid::phiDip*M_PI/180.0) + Bz1*sin(Hybrid::phiDip*M_PI/180.0);
-   const Real Bz2 = -By1*sin(Hybrid::phiDip*M_PI/180.0) + Bz1*cos(Hybrid::phiDip*M_PI/180.0);
-   // B = R_y(-theta) B2
-   B[0] += Bx2*cos(Hybrid::thetaDip*M_PI/180.0) - Bz2*sin(Hybrid::thetaDip*M_PI/180.0);
-   B[1] += By2;
-   B[2] += Bx2*sin(Hybrid::thetaDip*M_PI/180.0) + Bz2*cos(Hybrid::thetaDip*M_PI/180.0);
+   // B = R_y(-theta) R_x(-phi) B1, i.e. the transpose of the rotation
+   B[0] += M[0]*Bx1 + M[3]*By1 + M[6]*Bz1;
+   B[1] += M[1]*Bx1 + M[4]*By1 + M[7]*Bz1;
+   B[2] += M[2]*Bx1 + M[5]*By1 + M[8]*Bz1;
 }
 
 inline void lineDipoleB(Real x,Real y,Real z,Real B[3]) {
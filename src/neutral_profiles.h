@@ -19,6 +19,8 @@
 #ifndef NEUTRAL_PROFILES_H
 #define NEUTRAL_PROFILES_H
 
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <vector>
 #include <simulation.h>
@@ -30,7 +32,7 @@ struct NeutralProfileArgs{
    std::vector<Real> n0,H0,T0,k0;
 };
 
-Real neutralDensityChamberlainH(SimulationClasses& simClasses,Real x,Real y,Real z,Real r0,std::vector<Real> n0,std::vector<Real> H0,Real R_exobase,Real R_shadow) {
+Real neutralDensityChamberlainH(SimulationClasses& simClasses,Real x,Real y,Real z,Real r0,const std::vector<Real>& n0,const std::vector<Real>& H0,Real R_exobase,Real R_shadow) {
    const Real r = sqrt(sqr(x) + sqr(y) + sqr(z));
    if(r < R_exobase) { return 0.0; }
    if(x < 0 && sqr(y) + sqr(z) < sqr(R_shadow)) { return 0.0; }
@@ -43,7 +45,7 @@ Real neutralDensityChamberlainH(SimulationClasses& simClasses,Real x,Real y,Real
    return n;
 }
 
-Real neutralDensityChamberlainT(SimulationClasses& simClasses,Real x,Real y,Real z,Real m,Real r0,std::vector<Real> n0,std::vector<Real> T0,Real R_exobase,Real R_shadow) {
+Real neutralDensityChamberlainT(SimulationClasses& simClasses,Real x,Real y,Real z,Real m,Real r0,const std::vector<Real>& n0,const std::vector<Real>& T0,Real R_exobase,Real R_shadow) {
    const Real r = sqrt(sqr(x) + sqr(y) + sqr(z));
    if(r < R_exobase) { return 0.0; }
    if(x < 0 && sqr(y) + sqr(z) < sqr(R_shadow)) { return 0.0; }
@@ -57,7 +59,7 @@ Real neutralDensityChamberlainT(SimulationClasses& simClasses,Real x,Real y,Real
    return n;
 }
 
-Real neutralDensityExponential(SimulationClasses& simClasses,Real x,Real y,Real z,Real r0,std::vector<Real> n0,std::vector<Real> H0,Real R_exobase,Real R_shadow) {
+Real neutralDensityExponential(SimulationClasses& simClasses,Real x,Real y,Real z,Real r0,const std::vector<Real>& n0,const std::vector<Real>& H0,Real R_exobase,Real R_shadow) {
    const Real r = sqrt(sqr(x) + sqr(y) + sqr(z));
    if(r < R_exobase) { return 0.0; }
    if(x < 0 && sqr(y) + sqr(z) < sqr(R_shadow)) { return 0.0; }
@@ -70,7 +72,7 @@ Real neutralDensityExponential(SimulationClasses& simClasses,Real x,Real y,Real
    return n;
 }
 
-Real neutralDensityPowerLaw(SimulationClasses& simClasses,Real x,Real y,Real z,Real r0,std::vector<Real> n0,std::vector<Real> k0,Real R_exobase,Real R_shadow) {
+Real neutralDensityPowerLaw(SimulationClasses& simClasses,Real x,Real y,Real z,Real r0,const std::vector<Real>& n0,const std::vector<Real>& k0,Real R_exobase,Real R_shadow) {
    const Real r = sqrt(sqr(x) + sqr(y) + sqr(z));
    if(r < R_exobase) { return 0.0; }
    if(x < 0 && sqr(y) + sqr(z) < sqr(R_shadow)) { return 0.0; }
@@ -148,7 +150,7 @@ Real neutralDensityVenusOxygen(SimulationClasses& simClasses,Real x,Real y,Real
    return (1.0 - (sza/M_PI))*n_day + (sza/M_PI)*n_night;
 }
 
-Real getNeutralDensity(SimulationClasses& simClasses,std::string name,Real x,Real y,Real z,NeutralProfileArgs a) {
+Real getNeutralDensity(SimulationClasses& simClasses,const std::string& name,Real x,Real y,Real z,const NeutralProfileArgs& a) {
    if(name.compare("ChamberlainH") == 0) {
       return neutralDensityChamberlainH(simClasses,x,y,z,a.r0,a.n0,a.H0,a.R_exobase,a.R_shadow);
    }
@@ -170,4 +172,90 @@ Real getNeutralDensity(SimulationClasses& simClasses,std::string name,Real x,Rea
    return -1.0;
 }
 
+/** Lookup table of a spherically symmetric neutral profile. The density is tabulated once
+ * in radius and interpolated linearly in log(n), which is exact for a single exponential
+ * component. Exobase and shadow checks are made on cell coordinates, so the table can be
+ * used in place of getNeutralDensity. Profiles that are not spherically symmetric
+ * (VenusHydrogen, VenusOxygen) are evaluated directly.*/
+class NeutralProfileTable {
+ public:
+   NeutralProfileTable(): radial(false),r_table(0.0),invDr(0.0) { }
+   bool initialize(SimulationClasses& simClasses,const std::string& name,const NeutralProfileArgs& a,Real r_min,Real r_max,Real dr);
+   Real density(SimulationClasses& simClasses,Real x,Real y,Real z) const;
+   bool densities(SimulationClasses& simClasses,const Real* blockCrd,Real dx,Real* n) const;
+
+ private:
+   std::string name;
+   NeutralProfileArgs args;
+   bool radial;                        /**< If true, the profile is tabulated.*/
+   Real r_table;                       /**< Radius of the first table entry.*/
+   Real invDr;                         /**< Inverse of table spacing.*/
+   std::vector<Real> logDensity;       /**< Logarithm of tabulated density.*/
+};
+
+/** Build the table over radii [r_min,r_max].
+ * @param simClasses Generic simulation classes.
+ * @param name Name of the neutral profile.
+ * @param a Profile parameters.
+ * @param r_min Smallest radius where density is needed.
+ * @param r_max Largest radius where density is needed.
+ * @param dr Table spacing.
+ * @return If true, the profile parameters are valid.*/
+inline bool NeutralProfileTable::initialize(SimulationClasses& simClasses,const std::string& name,const NeutralProfileArgs& a,Real r_min,Real r_max,Real dr) {
+   this->name = name;
+   args = a;
+   logDensity.clear();
+   radial = (name == "ChamberlainH" || name == "ChamberlainT" || name == "Exponential" || name == "PowerLaw");
+   // check parameters
+   const Real r_check = std::max(std::max(r_min,a.R_exobase),(Real)1.0);
+   if(getNeutralDensity(simClasses,name,r_check,0.0,0.0,a) < 0.0) { return false; }
+   if(radial == false) { return true; }
+   // densities inside the exobase are zero and not tabulated
+   r_table = std::max(r_min,a.R_exobase);
+   if(r_max < r_table || dr <= 0.0) { return true; }
+   const size_t N = static_cast<size_t>(ceil((r_max-r_table)/dr)) + 2;
+   invDr = 1.0/dr;
+   logDensity.resize(N);
+   for(size_t i=0;i<N;++i) {
+      const Real n = getNeutralDensity(simClasses,name,r_table+i*dr,0.0,0.0,a);
+      // log interpolation requires positive densities, fall back to direct evaluation
+      if(n <= 0.0) {
+	 radial = false;
+	 logDensity.clear();
+	 return true;
+      }
+      logDensity[i] = log(n);
+   }
+   return true;
+}
+
+/** Neutral density at the given coordinates.*/
+inline Real NeutralProfileTable::density(SimulationClasses& simClasses,Real x,Real y,Real z) const {
+   if(radial == false) { return getNeutralDensity(simClasses,name,x,y,z,args); }
+   const Real r = sqrt(sqr(x) + sqr(y) + sqr(z));
+   if(r < args.R_exobase) { return 0.0; }
+   if(x < 0 && sqr(y) + sqr(z) < sqr(args.R_shadow)) { return 0.0; }
+   if(logDensity.size() < 2) { return getNeutralDensity(simClasses,name,x,y,z,args); }
+   const Real f = std::max((r-r_table)*invDr,(Real)0.0);
+   const size_t i = std::min(static_cast<size_t>(f),logDensity.size()-2);
+   const Real t = f - i;
+   return exp(logDensity[i] + t*(logDensity[i+1]-logDensity[i]));
+}
+
+/** Neutral densities at cell centres of a block.
+ * @param simClasses Generic simulation classes.
+ * @param blockCrd Coordinates of the lower corner of the block.
+ * @param dx Cell size.
+ * @param n Array of block::SIZE values where densities are written, indexed by block::index.
+ * @return If true, all densities were valid.*/
+inline bool NeutralProfileTable::densities(SimulationClasses& simClasses,const Real* blockCrd,Real dx,Real* n) const {
+   bool success = true;
+   for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) {
+      const int c = block::index(i,j,k);
+      n[c] = density(simClasses,blockCrd[0]+(i+0.5)*dx,blockCrd[1]+(j+0.5)*dx,blockCrd[2]+(k+0.5)*dx);
+      if(n[c] < 0.0) { success = false; }
+   }
+   return success;
+}
+
 #endif
@@ -32,9 +32,6 @@
 #include "hybrid_propagator.h"
 #include "particle_definition.h"
 #include "particle_species.h"
-#ifdef USE_B_CONSTANT
-#include "magnetic_field.h"
-#endif
 
 using namespace std;
 
@@ -229,23 +226,15 @@ bool UserDataOP::writeData(const std::string& spatMeshName,const std::vector<Par
    vector<Real> NPles;
 #ifdef USE_B_CONSTANT
    vector<Real> B0;
-   const Real* crd = getBlockCoordinateArray(*sim,*simClasses);
+   const Real* const cellB0 = simClasses->pargrid.getUserDataStatic<Real>(Hybrid::dataCellB0ID);
 #endif
    for(pargrid::CellID b=0; b<simClasses->pargrid.getNumberOfLocalCells(); ++b) {
-#ifdef USE_B_CONSTANT
-      const size_t b3 = 3*b;
-#endif
       for(int k=0; k<block::WIDTH_Z; ++k) for(int j=0; j<block::WIDTH_Y; ++j) for(int i=0; i<block::WIDTH_X; ++i) {
-	 //const int n = (b*block::SIZE+block::index(i,j,k));
 	 divB.push_back(0.0);
 	 NPles.push_back(0.0);
 #ifdef USE_B_CONSTANT
-	 const Real xCellCenter = crd[b3+0] + (i+0.5)*Hybrid::dx;
-	 const Real yCellCenter = crd[b3+1] + (j+0.5)*Hybrid::dx;
-	 const Real zCellCenter = crd[b3+2] + (k+0.5)*Hybrid::dx;
-	 Real B0_temp[3] = {0.0,0.0,0.0};
-	 addConstantB(xCellCenter,yCellCenter,zCellCenter,B0_temp);
-	 for(int l=0;l<3;l++) { B0.push_back(B0_temp[l]); }
+	 const int n = (b*block::SIZE+block::index(i,j,k));
+	 for(int l=0;l<3;l++) { B0.push_back(cellB0[n*3+l]); }
 #endif
       }
    }
@@ -372,6 +361,18 @@ void UserDataOP::calcCellDiv(Real* faceData,vector<Real>& cellDiv) {
    }
 }
 
+// local index of the cell a particle is in, a single precision position shifted into
+// a neighbour block can round to the block edge and is then counted in the last cell
+static inline int particleCellIndex(const Particle<ParticleReal>& p) {
+   int i = static_cast<int>(floor(p.state[particle::X]/Hybrid::dx));
+   int j = static_cast<int>(floor(p.state[particle::Y]/Hybrid::dx));
+   int k = static_cast<int>(floor(p.state[particle::Z]/Hybrid::dx));
+   i = min(max(i,0),block::WIDTH_X-1);
+   j = min(max(j,0),block::WIDTH_Y-1);
+   k = min(max(k,0),block::WIDTH_Z-1);
+   return block::index(i,j,k);
+}
+
 // calculate number of macro particles in cells
 void UserDataOP::calcCellNPles(vector<Real>& cellNPles,const vector<ParticleListBase*>& particleLists) {
    for(pargrid::CellID b=0; b<simClasses->pargrid.getNumberOfLocalCells(); ++b) {
@@ -380,16 +381,13 @@ void UserDataOP::calcCellNPles(vector<Real>& cellNPles,const vector<ParticleList
 	 pargrid::DataID speciesDataID = pargrid::INVALID_DATAID;
 	 if(particleLists[s]->getParticles(speciesDataID) == false) { continue; }
 	 
-	 pargrid::DataWrapper<Particle<Real> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<Real> >(speciesDataID);
-	 Particle<Real>** particleList = wrapper.data();
-	 Particle<Real>* particles = particleList[b];
+	 pargrid::DataWrapper<Particle<ParticleReal> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<ParticleReal> >(speciesDataID);
+	 Particle<ParticleReal>** particleList = wrapper.data();
+	 Particle<ParticleReal>* particles = particleList[b];
 	 pargrid::ArraySizetype N_particles = wrapper.size(b);
 	 	 
 	 for(size_t p=0; p<N_particles; ++p) {
-	    const int i = static_cast<int>(floor(particles[p].state[particle::X]/Hybrid::dx));
-	    const int j = static_cast<int>(floor(particles[p].state[particle::Y]/Hybrid::dx));
-	    const int k = static_cast<int>(floor(particles[p].state[particle::Z]/Hybrid::dx));
-	    const int n = (b*block::SIZE+block::index(i,j,k));
+	    const int n = (b*block::SIZE+particleCellIndex(particles[p]));
 	    cellNPles[n]++;
 	 }
       }
@@ -404,20 +402,19 @@ void UserDataOP::calcCellParticleBulkParameters(vector<Real>& cellDensity,vector
          // For now skip particles with invalid data id:
          pargrid::DataID speciesDataID = pargrid::INVALID_DATAID;
          if(particleLists[S[i]]->getParticles(speciesDataID) == false) { continue; }
-         pargrid::DataWrapper<Particle<Real> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<Real> >(speciesDataID);
-         Particle<Real>** particleList = wrapper.data();
-         Particle<Real>* particles = particleList[b];
+         pargrid::DataWrapper<Particle<ParticleReal> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<ParticleReal> >(speciesDataID);
+         Particle<ParticleReal>** particleList = wrapper.data();
+         Particle<ParticleReal>* particles = particleList[b];
          pargrid::ArraySizetype N_particles = wrapper.size(b);
+         const Species* species = reinterpret_cast<const Species*>(particleLists[S[i]]->getSpecies());
          for(size_t p=0; p<N_particles; ++p) {
-            const int i = static_cast<int>(floor(particles[p].state[particle::X]/Hybrid::dx));
-            const int j = static_cast<int>(floor(particles[p].state[particle::Y]/Hybrid::dx));
-            const int k = static_cast<int>(floor(particles[p].state[particle::Z]/Hybrid::dx));
-            const int n = (b*block::SIZE+block::index(i,j,k));
+            const int n = (b*block::SIZE+particleCellIndex(particles[p]));
             const int n3 = n*3;
-            cellVelocity[n3+0] += particles[p].state[particle::VX]*particles[p].state[particle::WEIGHT];
-            cellVelocity[n3+1] += particles[p].state[particle::VY]*particles[p].state[particle::WEIGHT];
-            cellVelocity[n3+2] += particles[p].state[particle::VZ]*particles[p].state[particle::WEIGHT];
-            cellDensity[n] += particles[p].state[particle::WEIGHT];
+            const Real w = getParticleWeight(*species,particles[p]);
+            cellVelocity[n3+0] += particles[p].state[particle::VX]*w;
+            cellVelocity[n3+1] += particles[p].state[particle::VY]*w;
+            cellVelocity[n3+2] += particles[p].state[particle::VZ]*w;
+            cellDensity[n] += w;
          }
       }
    }
@@ -440,17 +437,15 @@ void UserDataOP::calcCellParticleBulkParameters(vector<Real>& cellDensity,vector
          // For now skip particles with invalid data id:
          pargrid::DataID speciesDataID = pargrid::INVALID_DATAID;
          if(particleLists[S[i]]->getParticles(speciesDataID) == false) { continue; }
-         pargrid::DataWrapper<Particle<Real> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<Real> >(speciesDataID);
-         Particle<Real>** particleList = wrapper.data();
-         Particle<Real>* particles = particleList[b];
+         pargrid::DataWrapper<Particle<ParticleReal> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<ParticleReal> >(speciesDataID);
+         Particle<ParticleReal>** particleList = wrapper.data();
+         Particle<ParticleReal>* particles = particleList[b];
          pargrid::ArraySizetype N_particles = wrapper.size(b);
+         const Species* species = reinterpret_cast<const Species*>(particleLists[S[i]]->getSpecies());
          for(size_t p=0; p<N_particles; ++p) {
-            const int i = static_cast<int>(floor(particles[p].state[particle::X]/Hybrid::dx));
-            const int j = static_cast<int>(floor(particles[p].state[particle::Y]/Hybrid::dx));
-            const int k = static_cast<int>(floor(particles[p].state[particle::Z]/Hybrid::dx));
-            const int n = (b*block::SIZE+block::index(i,j,k));
+            const int n = (b*block::SIZE+particleCellIndex(particles[p]));
             const int n3 = n*3;
-            cellTemperature[n] += particles[p].state[particle::WEIGHT]*(sqr(particles[p].state[particle::VX] - cellVelocity[n3+0])
+            cellTemperature[n] += getParticleWeight(*species,particles[p])*(sqr(particles[p].state[particle::VX] - cellVelocity[n3+0])
                                                                       + sqr(particles[p].state[particle::VY] - cellVelocity[n3+1])
                                                                       + sqr(particles[p].state[particle::VZ] - cellVelocity[n3+2]));
          }
@@ -499,22 +494,24 @@ void calcParticleLog(Simulation& sim,SimulationClasses& simClasses,vector<Partic
       for(size_t s=0;s<particleLists.size();++s) {
 	 pargrid::DataID speciesDataID = pargrid::INVALID_DATAID;
 	 if(particleLists[s]->getParticles(speciesDataID) == false) { continue; }
-	 pargrid::DataWrapper<Particle<Real> > wrapper = simClasses.pargrid.getUserDataDynamic<Particle<Real> >(speciesDataID);
-	 Particle<Real>** particleList = wrapper.data();
-	 Particle<Real>* particles = particleList[b];
+	 pargrid::DataWrapper<Particle<ParticleReal> > wrapper = simClasses.pargrid.getUserDataDynamic<Particle<ParticleReal> >(speciesDataID);
+	 Particle<ParticleReal>** particleList = wrapper.data();
+	 Particle<ParticleReal>* particles = particleList[b];
 	 pargrid::ArraySizetype N_particles = wrapper.size(b);
 	 plogData[s].N_macroParticles += N_particles;
+	 const Species* species = reinterpret_cast<const Species*>(particleLists[s]->getSpecies());
 	 for(size_t p=0; p<N_particles; ++p) {
-	    plogData[s].N_realParticles += particles[p].state[particle::WEIGHT];
-	    plogData[s].sumVx += particles[p].state[particle::WEIGHT]*particles[p].state[particle::VX];
-	    plogData[s].sumVy += particles[p].state[particle::WEIGHT]*particles[p].state[particle::VY];
-	    plogData[s].sumVz += particles[p].state[particle::WEIGHT]*particles[p].state[particle::VZ];
-	    plogData[s].sumV += particles[p].state[particle::WEIGHT]*sqrt(sqr(particles[p].state[particle::VX]) +
-									  sqr(particles[p].state[particle::VY]) +
-									  sqr(particles[p].state[particle::VZ]));
-	    plogData[s].sumWV2 += particles[p].state[particle::WEIGHT]*(sqr(particles[p].state[particle::VX]) +
-									sqr(particles[p].state[particle::VY]) +
-									sqr(particles[p].state[particle::VZ]));
+	    const Real w = getParticleWeight(*species,particles[p]);
+	    plogData[s].N_realParticles += w;
+	    plogData[s].sumVx += w*particles[p].state[particle::VX];
+	    plogData[s].sumVy += w*particles[p].state[particle::VY];
+	    plogData[s].sumVz += w*particles[p].state[particle::VZ];
+	    plogData[s].sumV += w*sqrt(sqr(particles[p].state[particle::VX]) +
+				       sqr(particles[p].state[particle::VY]) +
+				       sqr(particles[p].state[particle::VZ]));
+	    plogData[s].sumWV2 += w*(sqr(particles[p].state[particle::VX]) +
+				     sqr(particles[p].state[particle::VY]) +
+				     sqr(particles[p].state[particle::VZ]));
 	 }
       }
    }
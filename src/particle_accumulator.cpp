@@ -17,8 +17,15 @@
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "hybrid.h"
 #include "particle_accumulator.h"
+#include "particle_sort.h"
 
 using namespace std;
 
@@ -27,6 +34,7 @@ int Accumulator::N_accumulators = 0;
 Accumulator::Accumulator(): ParticleAccumulatorBase() {
    sim = NULL;
    simClasses = NULL;
+   species = NULL;
    // Increase the total number of Accumulators:
    myOrderNumber = N_accumulators;
    ++N_accumulators;
@@ -40,20 +48,244 @@ Accumulator::~Accumulator() {
    finalize();
 }
 
+// CIC accumulation of one particle to block accumulation arrays
+static inline void accumulateParticleCIC(const Real x,const Real y,const Real z,const Real wq,const Real* v,Real* acc1,Real* acc2) {
+   int i = static_cast<int>(floor(x/Hybrid::dx));
+   int j = static_cast<int>(floor(y/Hybrid::dx));
+   int k = static_cast<int>(floor(z/Hybrid::dx));
+   if(x < (i+0.5)*Hybrid::dx) { --i; }
+   if(y < (j+0.5)*Hybrid::dx) { --j; }
+   if(z < (k+0.5)*Hybrid::dx) { --k; }
+   ++i; ++j; ++k;
+   const Real x0 = (i-1+0.5)*Hybrid::dx;
+   const Real y0 = (j-1+0.5)*Hybrid::dx;
+   const Real z0 = (k-1+0.5)*Hybrid::dx;
+   const Real w_x = (x-x0)/Hybrid::dx;
+   const Real w_y = (y-y0)/Hybrid::dx;
+   const Real w_z = (z-z0)/Hybrid::dx;
+   
+   // CIC weight factors
+   const Real w000 = (1-w_x)*(1-w_y)*(1-w_z) * wq;
+   const Real w100 =    w_x *(1-w_y)*(1-w_z) * wq;
+   const Real w010 = (1-w_x)*   w_y *(1-w_z) * wq;
+   const Real w110 =    w_x *   w_y *(1-w_z) * wq;
+   const Real w001 = (1-w_x)*(1-w_y)*   w_z  * wq;
+   const Real w101 =    w_x *(1-w_y)*   w_z  * wq;
+   const Real w011 = (1-w_x)*   w_y *   w_z  * wq;
+   const Real w111 =    w_x *  w_y  *   w_z  * wq;
+   
+   // indices
+   const int ind000 = block::arrayIndex(i+0,j+0,k+0);
+   const int ind100 = block::arrayIndex(i+1,j+0,k+0);
+   const int ind010 = block::arrayIndex(i+0,j+1,k+0);
+   const int ind110 = block::arrayIndex(i+1,j+1,k+0);
+   const int ind001 = block::arrayIndex(i+0,j+0,k+1);
+   const int ind101 = block::arrayIndex(i+1,j+0,k+1);
+   const int ind011 = block::arrayIndex(i+0,j+1,k+1);
+   const int ind111 = block::arrayIndex(i+1,j+1,k+1);
+   
+   // rhoq
+   acc1[ind000] += w000;
+   acc1[ind100] += w100;
+   acc1[ind010] += w010;
+   acc1[ind110] += w110;
+   acc1[ind001] += w001;
+   acc1[ind101] += w101;
+   acc1[ind011] += w011;
+   acc1[ind111] += w111;
+   
+   // Ji
+   for(int l=0;l<3;++l) {
+      acc2[ind000*3+l] += w000*v[l];
+      acc2[ind100*3+l] += w100*v[l];
+      acc2[ind010*3+l] += w010*v[l];
+      acc2[ind110*3+l] += w110*v[l];
+      acc2[ind001*3+l] += w001*v[l];
+      acc2[ind101*3+l] += w101*v[l];
+      acc2[ind011*3+l] += w011*v[l];
+      acc2[ind111*3+l] += w111*v[l];
+   }
+}
+
+#ifdef USE_FUSED_PUSH_ACCUMULATION
+// number of particles accumulated by accumulateFusedBlock in each local block, index popid-1
+static vector<vector<unsigned int> > fusedParticles;
+
+/** Accumulate particles that stayed inside their block during the push, called by the propagator
+ * right after a block has been pushed. Only the number of accumulated particles is stored. The
+ * particle list removes particles that left a block before it appends particles arriving from
+ * other blocks, so after migration the accumulated particles are the first ones of the block.*/
+void accumulateFusedBlock(SimulationClasses& simClasses,const Species& species,pargrid::CellID blockID,unsigned int N_particles,Particle<ParticleReal>* particles) {
+   if(species.accumulate == false) { return; }
+   const int accBlockSize  = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
+   Real acc1[accBlockSize];
+   Real acc2[accBlockSize*3];
+   for(int i=0;i<accBlockSize;++i)   { acc1[i] = 0.0; }
+   for(int i=0;i<accBlockSize*3;++i) { acc2[i] = 0.0; }
+   const Real q = species.q;
+   const Real xMax = block::WIDTH_X*Hybrid::dx;
+   const Real yMax = block::WIDTH_Y*Hybrid::dx;
+   const Real zMax = block::WIDTH_Z*Hybrid::dx;
+   unsigned int N_fused = 0;
+   for(unsigned int p=0;p<N_particles;++p) {
+      const Real x = particles[p].state[particle::X];
+      const Real y = particles[p].state[particle::Y];
+      const Real z = particles[p].state[particle::Z];
+      // particles leaving the block are accumulated after migration
+      if(x < 0.0 || x >= xMax || y < 0.0 || y >= yMax || z < 0.0 || z >= zMax) { continue; }
+      const Real w = getParticleWeight(species,particles[p]);
+      const Real v[3] = {particles[p].state[particle::VX],particles[p].state[particle::VY],particles[p].state[particle::VZ]};
+      accumulateParticleCIC(x,y,z,w*q,v,acc1,acc2);
+      ++N_fused;
+   }
+   fusedParticles[species.popid-1][blockID] = N_fused;
+   Real* cellJi    = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataCellJiID);
+   Real* cellRhoQi = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataCellRhoQiID);
+   block::addValues3D(simClasses,blockID,acc1,cellRhoQi,1);
+   block::addValues3D(simClasses,blockID,acc2,cellJi,3);
+#ifdef WRITE_POPULATION_AVERAGES
+   const int m = Hybrid::outputPopVarId[species.popid-1];
+   if(m >= 0) {
+      block::addValues3D(simClasses,blockID,acc1,simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataCellAverageDensityID[m]),1);
+      block::addValues3D(simClasses,blockID,acc2,simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataCellAverageVelocityID[m]),3);
+   }
+#endif
+}
+#endif
+
+#ifdef USE_BINNED_ACCUMULATION
+/** CIC accumulation of a block binned by cell. The corner weights of all particles are computed
+ * in a vectorisable loop, particles are counting sorted by their (0,0,0) corner cell and the
+ * contributions of each bin are summed with SIMD reductions, so that acc1 and acc2 are
+ * updated once per occupied cell instead of 32 scatter-adds per particle.*/
+void Accumulator::accumulateBinned(AccumulatorScratch& buffers,const Species& species,unsigned int N_particles,const Particle<ParticleReal>* particles,Real* acc1,Real* acc2) {
+   if(N_particles == 0) { return; }
+   const int accBlockSize  = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
+   const Real q = species.q;
+   const Real dx = Hybrid::dx;
+   const size_t N = N_particles;
+   if(buffers.binCell.size() < N) {
+      buffers.binCell.resize(N);
+      buffers.binW.resize(N*8);
+      buffers.binV.resize(N*3);
+      buffers.binSortedW.resize(N*8);
+      buffers.binSortedV.resize(N*3);
+   }
+   if(buffers.binOffsets.size() != static_cast<size_t>(accBlockSize+1)) { buffers.binOffsets.resize(accBlockSize+1); }
+   int* const cell = buffers.binCell.data();
+   Real* const W = buffers.binW.data();
+   Real* const V = buffers.binV.data();
+   
+   // corner offsets in accumulation arrays relative to the (0,0,0) corner
+   const int ind0 = block::arrayIndex(0,0,0);
+   const int corner[8] = {0,
+                          block::arrayIndex(1,0,0)-ind0,
+                          block::arrayIndex(0,1,0)-ind0,
+                          block::arrayIndex(1,1,0)-ind0,
+                          block::arrayIndex(0,0,1)-ind0,
+                          block::arrayIndex(1,0,1)-ind0,
+                          block::arrayIndex(0,1,1)-ind0,
+                          block::arrayIndex(1,1,1)-ind0};
+   const int strideY = block::arrayIndex(0,1,0)-ind0;
+   const int strideZ = block::arrayIndex(0,0,1)-ind0;
+   
+   // cell indices and CIC weights, same arithmetic as in the particle loop of accumulateCell
+   #pragma omp simd
+   for(size_t p=0;p<N;++p) {
+      const Real x = particles[p].state[particle::X];
+      const Real y = particles[p].state[particle::Y];
+      const Real z = particles[p].state[particle::Z];
+      const Real wq = getParticleWeight(species,particles[p])*q;
+      V[0*N+p] = particles[p].state[particle::VX];
+      V[1*N+p] = particles[p].state[particle::VY];
+      V[2*N+p] = particles[p].state[particle::VZ];
+      int i = static_cast<int>(floor(x/dx));
+      int j = static_cast<int>(floor(y/dx));
+      int k = static_cast<int>(floor(z/dx));
+      i -= (x < (i+0.5)*dx) ? 1 : 0;
+      j -= (y < (j+0.5)*dx) ? 1 : 0;
+      k -= (z < (k+0.5)*dx) ? 1 : 0;
+      ++i; ++j; ++k;
+      const Real w_x = (x-(i-1+0.5)*dx)/dx;
+      const Real w_y = (y-(j-1+0.5)*dx)/dx;
+      const Real w_z = (z-(k-1+0.5)*dx)/dx;
+      cell[p] = ind0 + i + j*strideY + k*strideZ;
+      W[0*N+p] = (1-w_x)*(1-w_y)*(1-w_z) * wq;
+      W[1*N+p] =    w_x *(1-w_y)*(1-w_z) * wq;
+      W[2*N+p] = (1-w_x)*   w_y *(1-w_z) * wq;
+      W[3*N+p] =    w_x *   w_y *(1-w_z) * wq;
+      W[4*N+p] = (1-w_x)*(1-w_y)*   w_z  * wq;
+      W[5*N+p] =    w_x *(1-w_y)*   w_z  * wq;
+      W[6*N+p] = (1-w_x)*   w_y *   w_z  * wq;
+      W[7*N+p] =    w_x *  w_y  *   w_z  * wq;
+   }
+   
+   // counting sort by cell
+   unsigned int* const offsets = buffers.binOffsets.data();
+   for(int c=0;c<=accBlockSize;++c) { offsets[c] = 0; }
+   for(size_t p=0;p<N;++p) { ++offsets[cell[p]+1]; }
+   for(int c=0;c<accBlockSize;++c) { offsets[c+1] += offsets[c]; }
+   Real* const sW = buffers.binSortedW.data();
+   Real* const sV = buffers.binSortedV.data();
+   for(size_t p=0;p<N;++p) {
+      const unsigned int s = offsets[cell[p]]++;
+      for(int c=0;c<8;++c) { sW[c*N+s] = W[c*N+p]; }
+      for(int l=0;l<3;++l) { sV[l*N+s] = V[l*N+p]; }
+   }
+   // offsets[c] is now the end of bin c
+   
+   // reduce each occupied cell bin
+   const Real* const svx = sV + 0*N;
+   const Real* const svy = sV + 1*N;
+   const Real* const svz = sV + 2*N;
+   unsigned int begin = 0;
+   for(int c=0;c<accBlockSize;++c) {
+      const unsigned int end = offsets[c];
+      if(end == begin) { continue; }
+      for(int m=0;m<8;++m) {
+	 const Real* const w = sW + m*N;
+	 Real rhoq = 0.0;
+	 Real jx = 0.0;
+	 Real jy = 0.0;
+	 Real jz = 0.0;
+	 #pragma omp simd reduction(+:rhoq,jx,jy,jz)
+	 for(unsigned int s=begin;s<end;++s) {
+	    rhoq += w[s];
+	    jx += w[s]*svx[s];
+	    jy += w[s]*svy[s];
+	    jz += w[s]*svz[s];
+	 }
+	 const int ind = c + corner[m];
+	 acc1[ind] += rhoq;
+	 acc2[ind*3+0] += jx;
+	 acc2[ind*3+1] += jy;
+	 acc2[ind*3+2] += jz;
+      }
+      begin = end;
+   }
+}
+#endif
+
 #ifdef WRITE_POPULATION_AVERAGES
 void Accumulator::accumulateCell(const Species& species,pargrid::CellID blockID,unsigned int N_particles,
-				 const Particle<Real>* particles,Real* cellRhoQi,Real* cellJi,
+				 const Particle<ParticleReal>* particles,Real* cellRhoQi,Real* cellJi,
 				 Real* nAve,Real* vAve) {
 #else
 void Accumulator::accumulateCell(const Species& species,pargrid::CellID blockID,unsigned int N_particles,
-				 const Particle<Real>* particles,Real* cellRhoQi,Real* cellJi) {
+				 const Particle<ParticleReal>* particles,Real* cellRhoQi,Real* cellJi) {
 #endif
    const int accBlockSize  = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
    Real acc1[accBlockSize];
    Real acc2[accBlockSize*3];
    for(int i=0;i<accBlockSize;++i)   { acc1[i] = 0.0; }
    for(int i=0;i<accBlockSize*3;++i) { acc2[i] = 0.0; }
-   const Real q = species.q;
+#ifdef USE_BINNED_ACCUMULATION
+#ifdef _OPENMP
+   AccumulatorScratch& buffers = scratch[omp_get_thread_num()];
+#else
+   AccumulatorScratch& buffers = scratch[0];
+#endif
+#endif
 
 #ifdef ION_SPECTRA_ALONG_ORBIT
    /*bool* spectraFlag = reinterpret_cast<bool*>(simClasses->pargrid.getUserData(Hybrid::dataSpectraFlagID));
@@ -61,75 +293,24 @@ void Accumulator::accumulateCell(const Species& species,pargrid::CellID blockID,
    Dist* spectra = wrapperSpectra.data()[blockID];*/
 #endif
 
-   #if PROFILE_LEVEL > 1
+#ifndef USE_BINNED_ACCUMULATION
+   const Real q = species.q;
+
+   #if PROFILE_LEVEL > 1 && !defined(_OPENMP)
       profile::start("accumulation",particleAccumulation);
    #endif
    for(unsigned int p=0;p<N_particles;++p) {
       const Real x = particles[p].state[particle::X];
       const Real y = particles[p].state[particle::Y];
       const Real z = particles[p].state[particle::Z];
-      const Real w = particles[p].state[particle::WEIGHT];
+      const Real w = getParticleWeight(species,particles[p]);
       const Real wq = w*q;
       
       Real v[3];
       v[0] = particles[p].state[particle::VX];
       v[1] = particles[p].state[particle::VY];
       v[2] = particles[p].state[particle::VZ];
-      int i = static_cast<int>(floor(x/Hybrid::dx));
-      int j = static_cast<int>(floor(y/Hybrid::dx));
-      int k = static_cast<int>(floor(z/Hybrid::dx));
-      if(x < (i+0.5)*Hybrid::dx) { --i; }
-      if(y < (j+0.5)*Hybrid::dx) { --j; }
-      if(z < (k+0.5)*Hybrid::dx) { --k; }
-      ++i; ++j; ++k;
-      const Real x0 = (i-1+0.5)*Hybrid::dx;
-      const Real y0 = (j-1+0.5)*Hybrid::dx;
-      const Real z0 = (k-1+0.5)*Hybrid::dx;
-      const Real w_x = (x-x0)/Hybrid::dx;
-      const Real w_y = (y-y0)/Hybrid::dx;
-      const Real w_z = (z-z0)/Hybrid::dx;
-      
-      // CIC weight factors
-      const Real w000 = (1-w_x)*(1-w_y)*(1-w_z) * wq;
-      const Real w100 =    w_x *(1-w_y)*(1-w_z) * wq;
-      const Real w010 = (1-w_x)*   w_y *(1-w_z) * wq;
-      const Real w110 =    w_x *   w_y *(1-w_z) * wq;
-      const Real w001 = (1-w_x)*(1-w_y)*   w_z  * wq;
-      const Real w101 =    w_x *(1-w_y)*   w_z  * wq;
-      const Real w011 = (1-w_x)*   w_y *   w_z  * wq;
-      const Real w111 =    w_x *  w_y  *   w_z  * wq;
-      
-      // indices
-      const int ind000 = block::arrayIndex(i+0,j+0,k+0);
-      const int ind100 = block::arrayIndex(i+1,j+0,k+0);
-      const int ind010 = block::arrayIndex(i+0,j+1,k+0);
-      const int ind110 = block::arrayIndex(i+1,j+1,k+0);
-      const int ind001 = block::arrayIndex(i+0,j+0,k+1);
-      const int ind101 = block::arrayIndex(i+1,j+0,k+1);
-      const int ind011 = block::arrayIndex(i+0,j+1,k+1);
-      const int ind111 = block::arrayIndex(i+1,j+1,k+1);
-      
-      // rhoq
-      acc1[ind000] += w000;
-      acc1[ind100] += w100;
-      acc1[ind010] += w010;
-      acc1[ind110] += w110;
-      acc1[ind001] += w001;
-      acc1[ind101] += w101;
-      acc1[ind011] += w011;
-      acc1[ind111] += w111;
-      
-      // Ji
-      for(int l=0;l<3;++l) {
-	 acc2[ind000*3+l] += w000*v[l];
-	 acc2[ind100*3+l] += w100*v[l];
-	 acc2[ind010*3+l] += w010*v[l];
-	 acc2[ind110*3+l] += w110*v[l];
-	 acc2[ind001*3+l] += w001*v[l];
-	 acc2[ind101*3+l] += w101*v[l];
-	 acc2[ind011*3+l] += w011*v[l];
-	 acc2[ind111*3+l] += w111*v[l];
-      }
+      accumulateParticleCIC(x,y,z,wq,v,acc1,acc2);
 #ifdef ION_SPECTRA_ALONG_ORBIT
       /*if(spectraFlag[blockID] == true && Hybrid::recordSpectra == true) {
          spectra[species.popid].f[0] += w;
@@ -137,8 +318,19 @@ void Accumulator::accumulateCell(const Species& species,pargrid::CellID blockID,
 #endif
    }
    
-   #if PROFILE_LEVEL > 1
+   #if PROFILE_LEVEL > 1 && !defined(_OPENMP)
       profile::stop();
+   #endif
+#else
+   #if PROFILE_LEVEL > 1 && !defined(_OPENMP)
+      profile::start("accumulation",particleAccumulation);
+   #endif
+   accumulateBinned(buffers,species,N_particles,particles,acc1,acc2);
+   #if PROFILE_LEVEL > 1 && !defined(_OPENMP)
+      profile::stop();
+   #endif
+#endif
+   #if PROFILE_LEVEL > 1 && !defined(_OPENMP)
       profile::start("data copying",dataCopying);
    #endif
    
@@ -150,14 +342,14 @@ void Accumulator::accumulateCell(const Species& species,pargrid::CellID blockID,
    if(vAve != NULL) { block::addValues3D(*simClasses,blockID,acc2,vAve,3); }
 #endif
    
-   #if PROFILE_LEVEL > 1
+   #if PROFILE_LEVEL > 1 && !defined(_OPENMP)
       profile::stop();
    #endif
 }
 
 /* // NGP accumulator
 void Accumulator::accumulateCell(const Species& species,pargrid::CellID blockID,unsigned int N_particles,
-				 const Particle<Real>* particles,Real* cellRhoQi,Real* cellJi) {
+				 const Particle<ParticleReal>* particles,Real* cellRhoQi,Real* cellJi) {
    const int accBlockSize  = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
    Real acc1[accBlockSize];
    Real acc2[accBlockSize*3];
@@ -172,7 +364,7 @@ void Accumulator::accumulateCell(const Species& species,pargrid::CellID blockID,
       const Real x = particles[p].state[particle::X];
       const Real y = particles[p].state[particle::Y];
       const Real z = particles[p].state[particle::Z];
-      const Real wq = particles[p].state[particle::WEIGHT]*q;
+      const Real wq = getParticleWeight(species,particles[p])*q;
       
       Real v[3];
       v[0] = particles[p].state[particle::VX];
@@ -199,10 +391,38 @@ void Accumulator::accumulateCell(const Species& species,pargrid::CellID blockID,
    #endif
 }*/
 
-bool Accumulator::accumulateBoundaryCells(pargrid::DataID particleDataID,const unsigned int* N_particles) {
-   bool success = true;
-   if(species->accumulate == false) { return success; }
-   pargrid::DataWrapper<Particle<Real> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<Real> >(particleDataID);
+/** Sort blocks into eight colours by the parities of their indices. Blocks of the same colour
+ * do not share any cells of their accumulation arrays (incl. ghost layers), so they can be
+ * accumulated by different threads.
+ * @param sim Generic simulation variables.
+ * @param simClasses Generic simulation classes.
+ * @param blocks Local IDs of the blocks.
+ * @param colouredBlocks Array of eight vectors where the blocks of each colour are appended.
+ * @return If false, blocks are one cell wide in some direction and all blocks were given colour zero,
+ * in which case they must not be processed in parallel.*/
+bool colourBlocks(Simulation& sim,SimulationClasses& simClasses,const vector<pargrid::CellID>& blocks,vector<pargrid::CellID>* colouredBlocks) {
+   const bool colouring = (block::WIDTH_X > 1 && block::WIDTH_Y > 1 && block::WIDTH_Z > 1);
+   const double* crd = getBlockCoordinateArray(sim,simClasses);
+   const Real blockMin[3]  = {Hybrid::box.xmin,Hybrid::box.ymin,Hybrid::box.zmin};
+   const Real blockSize[3] = {block::WIDTH_X*Hybrid::dx,block::WIDTH_Y*Hybrid::dx,block::WIDTH_Z*Hybrid::dx};
+   for(pargrid::CellID b=0; b<blocks.size(); ++b) {
+      const pargrid::CellID block = blocks[b];
+      int colour = 0;
+      if(colouring == true) {
+	 for(int l=0;l<3;++l) {
+	    const long ind = lround((crd[3*block+l]-blockMin[l])/blockSize[l]);
+	    colour |= static_cast<int>(ind & 1) << l;
+	 }
+      }
+      colouredBlocks[colour].push_back(block);
+   }
+   return colouring;
+}
+
+void Accumulator::accumulateBlocks(pargrid::DataID particleDataID,const unsigned int* N_particles,const vector<pargrid::CellID>& blocks) {
+   startParticleProfile();
+   const double t_accumulate = getWallTime();
+   pargrid::DataWrapper<Particle<ParticleReal> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<ParticleReal> >(particleDataID);
    Real* cellJi    = simClasses->pargrid.getUserDataStatic<Real>(Hybrid::dataCellJiID);
    Real* cellRhoQi = simClasses->pargrid.getUserDataStatic<Real>(Hybrid::dataCellRhoQiID);
 #ifdef WRITE_POPULATION_AVERAGES
@@ -214,42 +434,62 @@ bool Accumulator::accumulateBoundaryCells(pargrid::DataID particleDataID,const u
       vAve = simClasses->pargrid.getUserDataStatic<Real>(Hybrid::dataCellAverageVelocityID[m]);
    }
 #endif
-   const vector<pargrid::CellID>& boundaryBlocks = simClasses->pargrid.getBoundaryCells(Hybrid::accumulationStencilID);
-   for(pargrid::CellID b=0; b<boundaryBlocks.size(); ++b) {
-      const pargrid::CellID block = boundaryBlocks[b];
+   const size_t N_threads = getMaxThreads();
+   if(scratch.size() < N_threads) { scratch.resize(N_threads); }
+   
+   // Colours are accumulated in a fixed order, which makes the result independent of the number of threads.
+   vector<pargrid::CellID> colouredBlocks[8];
+   const bool colouring = colourBlocks(*sim,*simClasses,blocks,colouredBlocks);
+   
+   #if PROFILE_LEVEL > 1 && defined(_OPENMP)
+      profile::start("accumulation",particleAccumulation);
+   #endif
+   for(int c=0;c<8;++c) {
+      scheduler.schedule(colouredBlocks[c],N_particles);
+      #ifdef _OPENMP
+         #pragma omp parallel if(colouring)
+      #endif
+      {
+	 const int thread = getThreadNumber();
+	 scheduler.startThread(thread);
+	 size_t b;
+	 while(scheduler.next(thread,b) == true) {
+	    const pargrid::CellID block = colouredBlocks[c][b];
+	    Particle<ParticleReal>* particles = wrapper.data()[block];
+	    unsigned int N = N_particles[block];
+#ifdef USE_FUSED_PUSH_ACCUMULATION
+	    // skip particles already accumulated by the propagator
+	    const unsigned int N_fused = fusedParticles[species->popid-1][block];
+	    particles += N_fused;
+	    N -= N_fused;
+#endif
 #ifdef WRITE_POPULATION_AVERAGES
-      accumulateCell(*species,block,N_particles[block],wrapper.data()[block],cellRhoQi,cellJi,nAve,vAve);
+	    accumulateCell(*species,block,N,particles,cellRhoQi,cellJi,nAve,vAve);
 #else
-      accumulateCell(*species,block,N_particles[block],wrapper.data()[block],cellRhoQi,cellJi);
+	    accumulateCell(*species,block,N,particles,cellRhoQi,cellJi);
 #endif
+	 }
+	 scheduler.stopThread(thread);
+      }
    }
+   #if PROFILE_LEVEL > 1 && defined(_OPENMP)
+      profile::stop();
+   #endif
+   addParticleTime(getWallTime() - t_accumulate);
+   stopParticleProfile();
+}
+
+bool Accumulator::accumulateBoundaryCells(pargrid::DataID particleDataID,const unsigned int* N_particles) {
+   bool success = true;
+   if(species->accumulate == false) { return success; }
+   accumulateBlocks(particleDataID,N_particles,simClasses->pargrid.getBoundaryCells(Hybrid::accumulationStencilID));
    return success;
 }
 
 bool Accumulator::accumulateInnerCells(pargrid::DataID particleDataID,const unsigned int* N_particles) {
    bool success = true;
    if(species->accumulate == false) { return success; }
-   pargrid::DataWrapper<Particle<Real> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<Real> >(particleDataID);
-   Real* cellJi    = simClasses->pargrid.getUserDataStatic<Real>(Hybrid::dataCellJiID);
-   Real* cellRhoQi = simClasses->pargrid.getUserDataStatic<Real>(Hybrid::dataCellRhoQiID);
-#ifdef WRITE_POPULATION_AVERAGES
-   Real* nAve = NULL;
-   Real* vAve = NULL;
-   const int m = Hybrid::outputPopVarId[species->popid-1];
-   if(m >=0 ) {
-      nAve = simClasses->pargrid.getUserDataStatic<Real>(Hybrid::dataCellAverageDensityID[m]);
-      vAve = simClasses->pargrid.getUserDataStatic<Real>(Hybrid::dataCellAverageVelocityID[m]);
-   }
-#endif
-   const vector<pargrid::CellID>& innerBlocks = simClasses->pargrid.getInnerCells(Hybrid::accumulationStencilID);
-   for(pargrid::CellID b=0; b<innerBlocks.size(); ++b) {
-      const pargrid::CellID block = innerBlocks[b];
-#ifdef WRITE_POPULATION_AVERAGES
-      accumulateCell(*species,block,N_particles[block],wrapper.data()[block],cellRhoQi,cellJi,nAve,vAve);
-#else
-      accumulateCell(*species,block,N_particles[block],wrapper.data()[block],cellRhoQi,cellJi);
-#endif
-   }
+   accumulateBlocks(particleDataID,N_particles,simClasses->pargrid.getInnerCells(Hybrid::accumulationStencilID));
    return success;
 }
 
@@ -345,6 +585,11 @@ bool Accumulator::clearAccumulationArrays() {
       for (pargrid::CellID b=0; b<simClasses->pargrid.getNumberOfAllCells()*block::SIZE; ++b)   { cellRhoQi[b] = 0.0; }
       for (pargrid::CellID b=0; b<simClasses->pargrid.getNumberOfAllCells()*block::SIZE*3; ++b) { cellJi[b] = 0.0; }
    }
+#ifdef USE_FUSED_PUSH_ACCUMULATION
+   // called before particles are propagated, the propagator sets the counts of pushed blocks
+   if(fusedParticles.size() < static_cast<size_t>(species->popid)) { fusedParticles.resize(species->popid); }
+   fusedParticles[species->popid-1].assign(simClasses->pargrid.getNumberOfLocalCells(),0);
+#endif
 #ifdef WRITE_POPULATION_AVERAGES
    // zero buffer cells for average accumulation arrays
    const int m = Hybrid::outputPopVarId[species->popid-1];
@@ -377,6 +622,7 @@ bool Accumulator::initialize(Simulation& sim,SimulationClasses& simClasses,Confi
       simClasses.logger << "(RHYBRID ACCUMULATOR) ERROR: ParticleAccumulatorBase initialization failed" << endl << write;
    }
    this->species = reinterpret_cast<const Species*>(plist->getSpecies());
+   scheduler.setName(species->name+" accumulation");
    return success;
 }
 
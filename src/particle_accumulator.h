@@ -20,13 +20,27 @@
 #define PARTICLE_ACCUMULATOR_H
 
 #include <cstdlib>
+#include <vector>
 #include <simulation.h>
 #include <simulationclasses.h>
 #include <base_class_particle_accumulator.h>
 
+#include "block_scheduler.h"
 #include "particle_definition.h"
 #include "particle_species.h"
 
+/** Reusable buffers of one thread of an Accumulator.*/
+struct AccumulatorScratch {
+#ifdef USE_BINNED_ACCUMULATION
+   std::vector<int> binCell;         /**< Accumulation array index of the (0,0,0) CIC corner of each particle.*/
+   std::vector<unsigned int> binOffsets; /**< Offsets of cell bins in sorted particle arrays.*/
+   std::vector<Real> binW;           /**< CIC corner weights times charge of each particle, 8 streams.*/
+   std::vector<Real> binV;           /**< Particle velocities, 3 streams.*/
+   std::vector<Real> binSortedW;     /**< binW sorted by cell.*/
+   std::vector<Real> binSortedV;     /**< binV sorted by cell.*/
+#endif
+};
+
 class Accumulator: public ParticleAccumulatorBase {
  public:
    Accumulator();
@@ -48,6 +62,8 @@ class Accumulator: public ParticleAccumulatorBase {
 				      * accumulatorCounter to determine when MPI transfers should be started.*/
    int myOrderNumber;                /**< Order number of this Accumulator.*/
    const Species* species;
+   std::vector<AccumulatorScratch> scratch; /**< Scratch buffers of each thread.*/
+   BlockScheduler scheduler;         /**< Distributes blocks of one colour to threads.*/
    
    #if PROFILE_LEVEL > 0
       int arrayClearing;
@@ -55,16 +71,25 @@ class Accumulator: public ParticleAccumulatorBase {
       int particleAccumulation;
    #endif
 
+#ifdef USE_BINNED_ACCUMULATION
+   void accumulateBinned(AccumulatorScratch& scratch,const Species& species,unsigned int N_particles,const Particle<ParticleReal>* particles,Real* acc1,Real* acc2);
+#endif
+   void accumulateBlocks(pargrid::DataID particleDataID,const unsigned int* N_particles,const std::vector<pargrid::CellID>& blocks);
 #ifdef WRITE_POPULATION_AVERAGES
    void accumulateCell(const Species& species,pargrid::CellID blockID,unsigned int N_particles,
-		       const Particle<Real>* particles,Real* cellRhoQi,Real* cellJi,
+		       const Particle<ParticleReal>* particles,Real* cellRhoQi,Real* cellJi,
 		       Real* nAve,Real* vAve);
 #else
    void accumulateCell(const Species& species,pargrid::CellID blockID,unsigned int N_particles,
-		       const Particle<Real>* particles,Real* cellRhoQi,Real* cellJi);
+		       const Particle<ParticleReal>* particles,Real* cellRhoQi,Real* cellJi);
 #endif
 };
 
+bool colourBlocks(Simulation& sim,SimulationClasses& simClasses,const std::vector<pargrid::CellID>& blocks,std::vector<pargrid::CellID>* colouredBlocks);
+#ifdef USE_FUSED_PUSH_ACCUMULATION
+void accumulateFusedBlock(SimulationClasses& simClasses,const Species& species,pargrid::CellID blockID,unsigned int N_particles,Particle<ParticleReal>* particles);
+#endif
+
 inline ParticleAccumulatorBase* AccumulatorMaker() {return new Accumulator();}
 
 #endif
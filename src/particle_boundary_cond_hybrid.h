@@ -22,6 +22,7 @@
 #include <base_class_particle_boundary_condition.h>
 
 #include <hybrid.h>
+#include "block_scheduler.h"
 
 template<class SPECIES,class PARTICLE>
 class ParticleBoundaryCondHybrid: public ParticleBoundaryCondBase {
@@ -37,6 +38,9 @@ class ParticleBoundaryCondHybrid: public ParticleBoundaryCondBase {
    
  private:
    SPECIES species;
+   BlockScheduler scheduler;          /**< Distributes blocks to threads.*/
+   std::vector<pargrid::CellID> innerBlocks; /**< Local blocks on the inner boundary.*/
+   std::vector<Real> blockCounter;    /**< Removed weight of each scheduled block, summed in block order.*/
 };
 
 template<class SPECIES,class PARTICLE> inline
@@ -58,66 +62,107 @@ bool ParticleBoundaryCondHybrid<SPECIES,PARTICLE>::apply(pargrid::DataID particl
 							 const std::vector<pargrid::CellID>& exteriorBlocks) {
    pargrid::DataWrapper<PARTICLE> wrapper = simClasses->pargrid.getUserDataDynamic<PARTICLE>(particleDataID);
    
+   // Blocks are processed by threads in the order given by the scheduler. Removed weights
+   // are stored per block and summed to the counters in block order, so that the counters
+   // do not depend on the number of threads.
+   
    // Remove particles on exterior cells:
-   Real t_propag = 0.0;
-   for (pargrid::CellID b=0; b<exteriorBlocks.size(); ++b) {
-      // Measure computation time if we are testing for repartitioning:
-      if (sim->countPropagTime == true) t_propag = MPI_Wtime();
-      
-      const pargrid::CellID blockLID = exteriorBlocks[b];
-      PARTICLE* particles = wrapper.data()[blockLID];
-      for(size_t p=0; p<N_particles[blockLID]; ++p) {
-	 // escape counter
-	 Hybrid::particleCounterEscape[species.popid-1] += particles[p].state[particle::WEIGHT];
-      }
-      N_particles[blockLID] = 0;
-      wrapper.resize(blockLID,0);
-      
-      // Store block injection time:
-      if (sim->countPropagTime == true) {
-	 t_propag = std::max(0.0,MPI_Wtime() - t_propag);
-	 simClasses->pargrid.getCellWeights()[blockLID] += t_propag;
+   blockCounter.resize(exteriorBlocks.size());
+   scheduler.schedule(exteriorBlocks,N_particles);
+   #ifdef _OPENMP
+      #pragma omp parallel
+   #endif
+   {
+      const int thread = getThreadNumber();
+      scheduler.startThread(thread);
+      Real t_propag = 0.0;
+      size_t b;
+      while(scheduler.next(thread,b) == true) {
+	 // Measure computation time if we are testing for repartitioning:
+	 if (sim->countPropagTime == true) t_propag = getWallTime();
+	 
+	 const pargrid::CellID blockLID = exteriorBlocks[b];
+	 PARTICLE* particles = wrapper.data()[blockLID];
+	 Real escape = 0.0;
+	 for(size_t p=0; p<N_particles[blockLID]; ++p) {
+	    // escape counter
+	    escape += getParticleWeight(this->species,particles[p]);
+	 }
+	 blockCounter[b] = escape;
+	 N_particles[blockLID] = 0;
+	 
+	 // Store block injection time:
+	 if (sim->countPropagTime == true) {
+	    t_propag = std::max(0.0,getWallTime() - t_propag);
+	    simClasses->pargrid.getCellWeights()[blockLID] += t_propag;
+	 }
       }
+      scheduler.stopThread(thread);
    }
-
+   // ParGrid dynamic data is resized serially after the parallel region:
+   for(size_t b=0; b<exteriorBlocks.size(); ++b) { wrapper.resize(exteriorBlocks[b],0); }
+   for(size_t b=0; b<blockCounter.size(); ++b) {
+      Hybrid::particleCounterEscape[species.popid-1] += blockCounter[b];
+   }
+   
    // Inner boundary
    bool* innerFlagParticle = simClasses->pargrid.getUserDataStatic<bool>(Hybrid::dataInnerFlagParticleID);
    const double* crd = getBlockCoordinateArray(*sim,*simClasses);
+   innerBlocks.clear();
    for (pargrid::CellID b=0; b<simClasses->pargrid.getNumberOfLocalCells(); ++b) {
-      if (innerFlagParticle[b] == false) { continue; }
-      
-      // Measure computation time if we are testing for repartitioning:
-      if (sim->countPropagTime == true) t_propag = MPI_Wtime();
-      
-      PARTICLE* particles = wrapper.data()[b];
-      const size_t b3 = 3*b;
-      const Real xBlock = crd[b3+0];
-      const Real yBlock = crd[b3+1];
-      const Real zBlock = crd[b3+2];
-      int current = 0;
-      int end = N_particles[b]-1;
-      while (current <= end) {
-	 const Real r2 =  sqr(xBlock + particles[current].state[particle::X]) +
-	   sqr(yBlock + particles[current].state[particle::Y]) +
-	   sqr(zBlock + particles[current].state[particle::Z]);
-	 //if (r2 < Hybrid::R2_particleObstacle) {
-         if (r2 < this->species.R2_obstacle) {
-	    // impact counter
-	    Hybrid::particleCounterImpact[this->species.popid-1] += particles[current].state[particle::WEIGHT];
-	    particles[current] = particles[end];
-	    --end;
-	    continue;
+      if (innerFlagParticle[b] == true) { innerBlocks.push_back(b); }
+   }
+   blockCounter.resize(innerBlocks.size());
+   scheduler.schedule(innerBlocks,N_particles);
+   #ifdef _OPENMP
+      #pragma omp parallel
+   #endif
+   {
+      const int thread = getThreadNumber();
+      scheduler.startThread(thread);
+      Real t_propag = 0.0;
+      size_t i;
+      while(scheduler.next(thread,i) == true) {
+	 const pargrid::CellID b = innerBlocks[i];
+	 // Measure computation time if we are testing for repartitioning:
+	 if (sim->countPropagTime == true) t_propag = getWallTime();
+	 
+	 PARTICLE* particles = wrapper.data()[b];
+	 const size_t b3 = 3*b;
+	 const Real xBlock = crd[b3+0];
+	 const Real yBlock = crd[b3+1];
+	 const Real zBlock = crd[b3+2];
+	 Real impact = 0.0;
+	 int current = 0;
+	 int end = N_particles[b]-1;
+	 while (current <= end) {
+	    const Real r2 =  sqr(xBlock + particles[current].state[particle::X]) +
+	      sqr(yBlock + particles[current].state[particle::Y]) +
+	      sqr(zBlock + particles[current].state[particle::Z]);
+	    //if (r2 < Hybrid::R2_particleObstacle) {
+	    if (r2 < this->species.R2_obstacle) {
+	       // impact counter
+	       impact += getParticleWeight(this->species,particles[current]);
+	       particles[current] = particles[end];
+	       --end;
+	       continue;
+	    }
+	    ++current;
+	 }
+	 blockCounter[i] = impact;
+	 N_particles[b] = current;
+	 
+	 // Store block injection time:
+	 if (sim->countPropagTime == true) {
+	    t_propag = std::max(0.0,getWallTime() - t_propag);
+	    simClasses->pargrid.getCellWeights()[b] += t_propag;
 	 }
-	 ++current;
-      }
-      wrapper.resize(b,current);
-      N_particles[b] = current;
-      
-      // Store block injection time:
-      if (sim->countPropagTime == true) {
-	 t_propag = std::max(0.0,MPI_Wtime() - t_propag);
-	 simClasses->pargrid.getCellWeights()[b] += t_propag;
       }
+      scheduler.stopThread(thread);
+   }
+   for(size_t i=0; i<innerBlocks.size(); ++i) { wrapper.resize(innerBlocks[i],N_particles[innerBlocks[i]]); }
+   for(size_t b=0; b<blockCounter.size(); ++b) {
+      Hybrid::particleCounterImpact[species.popid-1] += blockCounter[b];
    }
 
    return true;
@@ -133,6 +178,7 @@ bool ParticleBoundaryCondHybrid<SPECIES,PARTICLE>::initialize(Simulation& sim,Si
 							      const std::string& regionName,const ParticleListBase* plist) {
    bool success = ParticleBoundaryCondBase::initialize(sim,simClasses,cr,regionName,plist);
    species = *reinterpret_cast<const SPECIES*>(plist->getSpecies());
+   scheduler.setName(species.name+" boundary conditions");
    return success;
 }
 
@@ -19,26 +19,78 @@
 #ifndef PARTICLE_DEFINITION_H
 #define PARTICLE_DEFINITION_H
 
+#include <cstddef>
+#include <stdint.h>
 #include <mpi.h>
+#include <definitions.h>
 
+// With USE_SPECIES_WEIGHT all particles of a species have the same weight, which is
+// stored in Species instead of the particle record.
 namespace particle {
-#ifdef ION_SPECTRA_ALONG_ORBIT
-   enum STATE {X,Y,Z,VX,VY,VZ,WEIGHT,INI_CELLID,INI_TIME,INI_X,INI_Y,INI_Z,INI_VX,INI_VY,INI_VZ,SIZE};
+#ifdef USE_SPECIES_WEIGHT
+ #ifdef ION_SPECTRA_ALONG_ORBIT
+   enum STATE {X,Y,Z,VX,VY,VZ,INI_TIME,INI_X,INI_Y,INI_Z,INI_VX,INI_VY,INI_VZ,SIZE};
+ #else
+   enum STATE {X,Y,Z,VX,VY,VZ,SIZE};
+ #endif
 #else
+ #ifdef ION_SPECTRA_ALONG_ORBIT
+   enum STATE {X,Y,Z,VX,VY,VZ,WEIGHT,INI_TIME,INI_X,INI_Y,INI_Z,INI_VX,INI_VY,INI_VZ,SIZE};
+ #else
    enum STATE {X,Y,Z,VX,VY,VZ,WEIGHT,SIZE};
+ #endif
 #endif
 }
 
+// Floating point type of particle records. Positions are block-local offsets from the block
+// corner, so single precision storage is sufficient. Pushing and accumulation are done in Real.
+#ifdef USE_SINGLE_PRECISION_PARTICLES
+typedef float ParticleReal;
+#else
+typedef Real ParticleReal;
+#endif
+
 template<typename REAL>
 struct Particle {
    REAL state[particle::SIZE];
+#ifdef ION_SPECTRA_ALONG_ORBIT
+   uint64_t iniCellID; /**< Global ID of the injection cell, an integer so that it is exact also in single precision.*/
+#endif
    
    static void getDatatype(MPI_Datatype& datatype);
 };
 
 template<typename REAL> inline
 void Particle<REAL>::getDatatype(MPI_Datatype& datatype) {
+#ifdef ION_SPECTRA_ALONG_ORBIT
+   int blockLengths[2] = {particle::SIZE,1};
+   MPI_Aint displacements[2] = {0,static_cast<MPI_Aint>(offsetof(Particle<REAL>,iniCellID))};
+   MPI_Datatype types[2] = {MPI_Type<REAL>(),MPI_UINT64_T};
+   MPI_Datatype structType;
+   MPI_Type_create_struct(2,blockLengths,displacements,types,&structType);
+   MPI_Type_create_resized(structType,0,sizeof(Particle<REAL>),&datatype);
+   MPI_Type_free(&structType);
+#else
    MPI_Type_contiguous(particle::SIZE,MPI_Type<REAL>(),&datatype);
+#endif
+}
+
+// statistical weight of a particle of the given species
+template<class SPECIES,typename REAL> inline
+Real getParticleWeight(const SPECIES& species,const Particle<REAL>& particle) {
+#ifdef USE_SPECIES_WEIGHT
+   return SPECIES::weights[species.popid-1];
+#else
+   return particle.state[particle::WEIGHT];
+#endif
+}
+
+// set statistical weight of a particle, does nothing if weights are stored in species
+template<typename REAL> inline
+void setParticleWeight(Particle<REAL>& particle,Real w) {
+#ifndef USE_SPECIES_WEIGHT
+   particle.state[particle::WEIGHT] = w;
+#endif
 }
 
 #endif
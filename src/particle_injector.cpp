@@ -18,7 +18,10 @@
  */
 
 #include <climits>
+#include <limits>
 #include <string>
+#include <map>
+#include <algorithm>
 
 #include "particle_injector.h"
 #include "hybrid.h"
@@ -26,56 +29,11 @@
 
 using namespace std;
 
-// probabilistic rounding (used to round non-integer N_macroParticlesPerCellPerDt)
-int probround(SimulationClasses& simClasses,Real x) {
-   if(x <= 0) { return 0; }
-   const int f = static_cast<int>(floor(x));
-   const Real r = simClasses.random.uniform();
-   if(r < x-f) { return f+1; }
-   else { return f; }
-}
-
-// gaussian randomness
-Real gaussrnd(SimulationClasses& simClasses)
-{
-   static Real saved;
-   static bool is_saved = false;
-   Real x,y,r2,fac,result;
-   if (is_saved) {
-      result = saved;
-      is_saved = false;
-   } else {
-      do {
-	 x = 2*simClasses.random.uniform() - 1;
-	 y = 2*simClasses.random.uniform() - 1;
-	 r2 = x*x + y*y;
-      } while (r2 >= 1.0);
-      // On average, this do loop is executed 4/pi = 1.27324 times
-      fac = sqrt(-2.0*log(r2)/r2);
-      result = x*fac;
-      saved = y*fac;
-      is_saved = true;
-   }
-   return result;
-}
-
-// deriv gaussian randomness
-Real derivgaussrnd(Real x0,SimulationClasses& simClasses)
-{
-   Real x,majorant,pdf;
-   const Real invsqrt2 = 1.0/sqrt(2.0);
-   const Real sqrt_halfpi = sqrt(0.5*M_PI);
-   const Real xm = 0.5*(x0 + sqrt(sqr(x0) + 4.0));
-   const Real c = 1.0/(exp(-0.5*x0*x0) + x0*sqrt_halfpi*erfc(-x0*invsqrt2));
-   const Real d = sqr(x0-xm);
-   const Real cxm = c*xm;
-restart:
-   x = xm + gaussrnd(simClasses);
-   if (x < 0) goto restart;
-   majorant = cxm*exp(-0.5*(sqr(x-xm) + d));
-   pdf = c*x*exp(-0.5*sqr(x-x0));
-   if (simClasses.random.uniform()*majorant > pdf) goto restart;
-   return x;
+// Each injector has its own random stream identifier, injectors are created in the same
+// order in all processes so identifiers are the same everywhere.
+static uint32_t newRandomStreamID() {
+   static uint32_t streamCnt = 0;
+   return ++streamCnt;
 }
 
 string radiusToString(Real R) {
@@ -85,6 +43,112 @@ string radiusToString(Real R) {
      to_string((R-Hybrid::R_object)/1e3) + " km + R_object";
 }
 
+// CELL-SPHERE INTERSECTION
+
+// Subdivision depth of shell patches that are partly inside a cell,
+// the patch boundary is resolved to dx/2^SHELL_AREA_DEPTH.
+static const int SHELL_AREA_DEPTH = 8;
+
+// Primitive of R/sqrt(R^2-x^2-y^2) over x and y, i.e. the area of the upper
+// hemisphere z = sqrt(R^2-x^2-y^2) above [0,x]x[0,y] for x^2+y^2 < R^2.
+static Real shellPrimitive(Real R,Real x,Real y) {
+   const Real z = sqrt(R*R - x*x - y*y);
+   return R*(y*asin(x/sqrt(R*R-y*y)) + x*asin(y/sqrt(R*R-x*x)) - R*atan2(x*y,R*z));
+}
+
+// Area of the hemisphere z = sqrt(R^2-x^2-y^2) above rectangle [x0,x1]x[y0,y1] with
+// zMin <= z <= zMax. Rectangles fully inside or outside the z range are evaluated
+// exactly, others are subdivided.
+static Real shellRectangleArea(Real R,Real x0,Real x1,Real y0,Real y1,Real zMin,Real zMax,int depth) {
+   const Real R2 = R*R;
+   const Real xNear = (x0 > 0.0) ? x0 : ((x1 < 0.0) ? -x1 : 0.0);
+   const Real yNear = (y0 > 0.0) ? y0 : ((y1 < 0.0) ? -y1 : 0.0);
+   const Real rhoMin2 = sqr(xNear) + sqr(yNear);
+   const Real rhoMax2 = sqr(max(fabs(x0),fabs(x1))) + sqr(max(fabs(y0),fabs(y1)));
+   if(rhoMin2 >= R2) { return 0.0; }
+   const Real zHigh = sqrt(R2 - rhoMin2);
+   const Real zLow = (rhoMax2 < R2) ? sqrt(R2 - rhoMax2) : 0.0;
+   if(zHigh <= zMin || zLow >= zMax) { return 0.0; }
+   if(rhoMax2 < R2 && zLow >= zMin && zHigh <= zMax) {
+      return shellPrimitive(R,x1,y1) - shellPrimitive(R,x0,y1) - shellPrimitive(R,x1,y0) + shellPrimitive(R,x0,y0);
+   }
+   const Real xMid = 0.5*(x0+x1);
+   const Real yMid = 0.5*(y0+y1);
+   if(depth <= 0) {
+      const Real rho2 = sqr(xMid) + sqr(yMid);
+      if(rho2 >= R2) { return 0.0; }
+      const Real z = sqrt(R2 - rho2);
+      if(z < zMin || z > zMax) { return 0.0; }
+      return R/z*(x1-x0)*(y1-y0);
+   }
+   return
+     shellRectangleArea(R,x0,xMid,y0,yMid,zMin,zMax,depth-1) + shellRectangleArea(R,xMid,x1,y0,yMid,zMin,zMax,depth-1) +
+     shellRectangleArea(R,x0,xMid,yMid,y1,zMin,zMax,depth-1) + shellRectangleArea(R,xMid,x1,yMid,y1,zMin,zMax,depth-1);
+}
+
+// Check if the sphere r = R intersects the cube [cellMin,cellMin+dx].
+static bool shellIntersectsCell(Real R,Real dx,const Real* cellMin) {
+   Real dMin2 = 0.0;
+   Real dMax2 = 0.0;
+   for(int i=0;i<3;++i) {
+      const Real lo = cellMin[i];
+      const Real hi = cellMin[i] + dx;
+      if(lo > 0.0) { dMin2 += sqr(lo); }
+      else if(hi < 0.0) { dMin2 += sqr(hi); }
+      dMax2 += sqr(max(fabs(lo),fabs(hi)));
+   }
+   return dMin2 < R*R && dMax2 > R*R;
+}
+
+// Area of the sphere r = R inside the cube [cellMin,cellMin+dx]. The sphere is projected
+// along the coordinate axis closest to the direction of the cell centre, both branches
+// of the projection are included.
+static Real shellCellArea(Real R,Real dx,const Real* cellMin) {
+   int axis = 0;
+   for(int i=1;i<3;++i) {
+      if(fabs(cellMin[i]+0.5*dx) > fabs(cellMin[axis]+0.5*dx)) { axis = i; }
+   }
+   const Real* u = &cellMin[(axis+1)%3];
+   const Real* v = &cellMin[(axis+2)%3];
+   const Real lo = cellMin[axis];
+   const Real hi = cellMin[axis] + dx;
+   Real area = 0.0;
+   if(hi > 0.0) { area += shellRectangleArea(R,*u,*u+dx,*v,*v+dx,max(lo,(Real)0.0),hi,SHELL_AREA_DEPTH); }
+   if(lo < 0.0) { area += shellRectangleArea(R,*u,*u+dx,*v,*v+dx,max(-hi,(Real)0.0),-lo,SHELL_AREA_DEPTH); }
+   return area;
+}
+
+// Shell areas of cells, shared by all ionospheric populations. Key is (R,dx,global cell index),
+// so populations with the same emission radius only evaluate each cell once.
+struct ShellAreaKey {
+   Real R;
+   Real dx;
+   uint64_t cell;
+   bool operator<(const ShellAreaKey& k) const {
+      if(R != k.R) { return R < k.R; }
+      if(dx != k.dx) { return dx < k.dx; }
+      return cell < k.cell;
+   }
+};
+static map<ShellAreaKey,Real> shellAreaCache;
+
+// Only cells that intersect the shell are cached.
+static Real getShellCellArea(Real R,Real dx,uint64_t cell,const Real* cellMin) {
+   if(shellIntersectsCell(R,dx,cellMin) == false) { return 0.0; }
+   const ShellAreaKey key = {R,dx,cell};
+   map<ShellAreaKey,Real>::const_iterator it = shellAreaCache.find(key);
+   if(it != shellAreaCache.end()) { return it->second; }
+   const Real area = shellCellArea(R,dx,cellMin);
+   shellAreaCache[key] = area;
+   return area;
+}
+
+// INJECTION ON THREADS
+
+void BlockInjection::setName(const std::string& name) {
+   scheduler.setName(name);
+}
+
 // UNIFORM INJECTOR
 
 InjectorUniform::InjectorUniform(): ParticleInjectorBase() {
@@ -105,15 +169,28 @@ bool InjectorUniform::inject(pargrid::DataID speciesDataID,unsigned int* N_parti
    if(initialized == false) { return initialized; }
    bool success = true;
    if(sim->timestep != 1) { return success; }
-   pargrid::DataWrapper<Particle<Real> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<Real> >(speciesDataID);
-   for(pargrid::CellID b=0;b<simClasses->pargrid.getNumberOfLocalCells();++b) {
-      if(injectParticles(b,*species,N_particles,wrapper) == false) { success = false; }
-   }
+   pargrid::DataWrapper<Particle<ParticleReal> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<ParticleReal> >(speciesDataID);
+   blocks.resize(simClasses->pargrid.getNumberOfLocalCells());
+   for(pargrid::CellID b=0;b<blocks.size();++b) { blocks[b] = b; }
+   injection.inject(*this,*sim,*simClasses,blocks,wrapper,N_particles);
    return success;
 }
 
-bool InjectorUniform::injectParticles(pargrid::CellID blockID,const Species& species,unsigned int* N_particles,
-				       pargrid::DataWrapper<Particle<Real> >& wrapper) {
+// number of new particles in each cell of the n:th block
+size_t InjectorUniform::countParticles(size_t n,RandomStream& random,InjectorScratch& scratch) const {
+   scratch.cellCount.resize(block::SIZE);
+   size_t N_inject = 0;
+   for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) {
+      const int c = block::index(i,j,k);
+      scratch.cellCount[c] = random.probround(N_macroParticlesPerCell);
+      N_inject += scratch.cellCount[c];
+   }
+   return N_inject;
+}
+
+void InjectorUniform::writeParticles(size_t n,RandomStream& random,InjectorScratch& scratch,size_t N_inject,
+				     Particle<ParticleReal>* particles) const {
+   const pargrid::CellID blockID = blocks[n];
 #ifdef ION_SPECTRA_ALONG_ORBIT
    const Real* crd = getBlockCoordinateArray(*sim,*simClasses);
    const size_t b3 = 3*blockID;
@@ -121,54 +198,40 @@ bool InjectorUniform::injectParticles(pargrid::CellID blockID,const Species& spe
    const Real yBlock = crd[b3+1];
    const Real zBlock = crd[b3+2];
 #endif
-   vector<Real> xinj,yinj,zinj;
+   // random positions and velocities of all new particles
+   if(scratch.rnd.size() < 6*N_inject) { scratch.rnd.resize(6*N_inject); }
+   const Real* const rndPos = &scratch.rnd[0];
+   const Real* const rndVel = &scratch.rnd[3*N_inject];
+   random.uniform(&scratch.rnd[0],3*N_inject);
+   random.gauss(&scratch.rnd[3*N_inject],3*N_inject);
+   const Real eps = 1.0e-2;
+   size_t s = 0;
    for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) {
       const Real xCell = (i+0.5)*Hybrid::dx;
       const Real yCell = (j+0.5)*Hybrid::dx;
       const Real zCell = (k+0.5)*Hybrid::dx;
-      const int N_injectCell = probround(*simClasses,N_macroParticlesPerCell);
-      if(N_injectCell <= 0) { continue; }
-      for(int s = 0;s<N_injectCell;s++) {
-	 const Real eps = 1.0e-2;
-	 const Real x = xCell + (1.0-eps)*Hybrid::dx*(simClasses->random.uniform()-0.5);
-	 const Real y = yCell + (1.0-eps)*Hybrid::dx*(simClasses->random.uniform()-0.5);
-	 const Real z = zCell + (1.0-eps)*Hybrid::dx*(simClasses->random.uniform()-0.5);
-	 xinj.push_back(x);
-	 yinj.push_back(y);
-	 zinj.push_back(z);
-      }
-   }
-   // Make room for new particles:
-   const int N_inject = static_cast<int>(xinj.size());
-   const pargrid::ArraySizetype oldSize = wrapper.size()[blockID];
-   N_particles[blockID] += N_inject;
-   wrapper.resize(blockID,oldSize+N_inject);
-   Particle<Real>* particles = wrapper.data()[blockID];
-   size_t s = 0;
-   for(size_t p=oldSize; p<oldSize+N_inject; ++p) {
-      particles[p].state[particle::X] = xinj[s];
-      particles[p].state[particle::Y] = yinj[s];
-      particles[p].state[particle::Z] = zinj[s];
-      particles[p].state[particle::VX] = -U + vth*gaussrnd(*simClasses);
-      particles[p].state[particle::VY] = vth*gaussrnd(*simClasses);
-      particles[p].state[particle::VZ] = vth*gaussrnd(*simClasses);
-      particles[p].state[particle::WEIGHT] = w;
+      const int N_injectCell = scratch.cellCount[block::index(i,j,k)];
+      for(int c=0;c<N_injectCell;++c) {
+	 particles[s].state[particle::X] = xCell + (1.0-eps)*Hybrid::dx*(rndPos[3*s+0]-0.5);
+	 particles[s].state[particle::Y] = yCell + (1.0-eps)*Hybrid::dx*(rndPos[3*s+1]-0.5);
+	 particles[s].state[particle::Z] = zCell + (1.0-eps)*Hybrid::dx*(rndPos[3*s+2]-0.5);
+	 particles[s].state[particle::VX] = -U + vth*rndVel[3*s+0];
+	 particles[s].state[particle::VY] = vth*rndVel[3*s+1];
+	 particles[s].state[particle::VZ] = vth*rndVel[3*s+2];
+	 setParticleWeight(particles[s],w);
 #ifdef ION_SPECTRA_ALONG_ORBIT
-      particles[p].state[particle::INI_CELLID] = simClasses->pargrid.getGlobalIDs()[blockID];
-      particles[p].state[particle::INI_X] = xBlock + particles[p].state[particle::X];
-      particles[p].state[particle::INI_Y] = yBlock + particles[p].state[particle::Y];
-      particles[p].state[particle::INI_Z] = zBlock + particles[p].state[particle::Z];
-      particles[p].state[particle::INI_VX] =  particles[p].state[particle::VX];
-      particles[p].state[particle::INI_VY] =  particles[p].state[particle::VY];
-      particles[p].state[particle::INI_VZ] =  particles[p].state[particle::VZ];
-      particles[p].state[particle::INI_TIME] = sim->t;
+	 particles[s].iniCellID = simClasses->pargrid.getGlobalIDs()[blockID];
+	 particles[s].state[particle::INI_X] = xBlock + particles[s].state[particle::X];
+	 particles[s].state[particle::INI_Y] = yBlock + particles[s].state[particle::Y];
+	 particles[s].state[particle::INI_Z] = zBlock + particles[s].state[particle::Z];
+	 particles[s].state[particle::INI_VX] =  particles[s].state[particle::VX];
+	 particles[s].state[particle::INI_VY] =  particles[s].state[particle::VY];
+	 particles[s].state[particle::INI_VZ] =  particles[s].state[particle::VZ];
+	 particles[s].state[particle::INI_TIME] = sim->t;
 #endif
-      // inject counter
-      Hybrid::particleCounterInject[species.popid-1] += w;
-      Hybrid::particleCounterInjectMacroparticles[species.popid-1] += 1;
-      ++s;
+	 ++s;
+      }
    }
-   return true;
 }
 
 bool InjectorUniform::addConfigFileItems(ConfigReader& cr,const std::string& configRegionName) {
@@ -183,6 +246,8 @@ bool InjectorUniform::initialize(Simulation& sim,SimulationClasses& simClasses,C
 				   const std::string& configRegionName,const ParticleListBase* plist) {
    initialized = ParticleInjectorBase::initialize(sim,simClasses,cr,configRegionName,plist);
    this->species = reinterpret_cast<const Species*>(plist->getSpecies());
+   randomStreamID = newRandomStreamID();
+   injection.setName(species->name+" injection");
    Real T=0;
    cr.parse();
    cr.get(configRegionName+".speed",U);
@@ -196,6 +261,9 @@ bool InjectorUniform::initialize(Simulation& sim,SimulationClasses& simClasses,C
    else {
       N_macroParticlesPerCell = n = w = 0.0;
    }
+#ifdef USE_SPECIES_WEIGHT
+   if(Species::setWeight(simClasses,species->popid,w) == false) { initialized = false; }
+#endif
    if(T > 0) { vth = sqrt(constants::BOLTZMANN*T/species->m); }
    else { vth = 0.0; }
    simClasses.logger
@@ -230,22 +298,32 @@ bool InjectorSolarWind::inject(pargrid::DataID speciesDataID,unsigned int* N_par
    bool success = true;
    if(sim->timestep <= 0) { return success; }
    
-   pargrid::DataWrapper<Particle<Real> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<Real> >(speciesDataID);
+   pargrid::DataWrapper<Particle<ParticleReal> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<ParticleReal> >(speciesDataID);
    
+   blocks.clear();
    for(pargrid::CellID b=0; b<simClasses->pargrid.getNumberOfLocalCells(); ++b) {
       if( (simClasses->pargrid.getNeighbourFlags(b) & Hybrid::X_POS_EXISTS) == 0 &&
 	  (simClasses->pargrid.getNeighbourFlags(b) & Hybrid::Y_POS_EXISTS) != 0 &&
 	  (simClasses->pargrid.getNeighbourFlags(b) & Hybrid::Y_NEG_EXISTS) != 0 &&
 	  (simClasses->pargrid.getNeighbourFlags(b) & Hybrid::Z_POS_EXISTS) != 0 &&
 	  (simClasses->pargrid.getNeighbourFlags(b) & Hybrid::Z_NEG_EXISTS) != 0) {
-	 if(injectParticles(b,*species,N_particles,wrapper) == false) { success = false; }
+	 blocks.push_back(b);
       }
    }
+   injection.inject(*this,*sim,*simClasses,blocks,wrapper,N_particles);
    return success;
 }
 
-bool InjectorSolarWind::injectParticles(pargrid::CellID blockID,const Species& species,unsigned int* N_particles,
-				       pargrid::DataWrapper<Particle<Real> >& wrapper) {
+// number of new particles in the n:th block
+size_t InjectorSolarWind::countParticles(size_t n,RandomStream& random,InjectorScratch& scratch) const {
+   const int N_inject = random.probround(N_macroParticlesPerCellPerDt);
+   if(N_inject <= 0) { return 0; }
+   return N_inject;
+}
+
+void InjectorSolarWind::writeParticles(size_t n,RandomStream& random,InjectorScratch& scratch,size_t N_inject,
+				       Particle<ParticleReal>* particles) const {
+   const pargrid::CellID blockID = blocks[n];
 #ifdef ION_SPECTRA_ALONG_ORBIT
    const Real* crd = getBlockCoordinateArray(*sim,*simClasses);
    const size_t b3 = 3*blockID;
@@ -255,37 +333,31 @@ bool InjectorSolarWind::injectParticles(pargrid::CellID blockID,const Species& s
 #endif
    Real blockSize[3];
    getBlockSize(*simClasses,*sim,blockID,blockSize);
-   // probround
-   const int N_inject = probround(*simClasses,N_macroParticlesPerCellPerDt);
-   if(N_inject <= 0) { return true; }
-   // Make room for new particles:
-   const pargrid::ArraySizetype oldSize = wrapper.size()[blockID];
-   N_particles[blockID] += N_inject;
-   wrapper.resize(blockID,oldSize+N_inject);
-   Particle<Real>* particles = wrapper.data()[blockID];
-   for(size_t p=oldSize; p<oldSize+N_inject; ++p) {
-      particles[p].state[particle::X] = 0;
-      particles[p].state[particle::Y] = simClasses->random.uniform()*blockSize[1];
-      particles[p].state[particle::Z] = simClasses->random.uniform()*blockSize[2];
-      particles[p].state[particle::VX] = -vth*derivgaussrnd(U/vth,*simClasses);
-      particles[p].state[particle::VY] = vth*gaussrnd(*simClasses);
-      particles[p].state[particle::VZ] = vth*gaussrnd(*simClasses);
-      particles[p].state[particle::WEIGHT] = w;
+   // positions (y,z), flux weighted vx and gaussian (vy,vz) for all new particles
+   std::vector<Real>& rnd = scratch.rnd;
+   if(rnd.size() < 5*N_inject) { rnd.resize(5*N_inject); }
+   random.uniform(&rnd[0],2*N_inject);
+   random.derivgauss(U/vth,&rnd[2*N_inject],N_inject);
+   random.gauss(&rnd[3*N_inject],2*N_inject);
+   for(size_t s=0; s<N_inject; ++s) {
+      particles[s].state[particle::X] = 0;
+      particles[s].state[particle::Y] = rnd[2*s+0]*blockSize[1];
+      particles[s].state[particle::Z] = rnd[2*s+1]*blockSize[2];
+      particles[s].state[particle::VX] = -vth*rnd[2*N_inject+s];
+      particles[s].state[particle::VY] = vth*rnd[3*N_inject+2*s+0];
+      particles[s].state[particle::VZ] = vth*rnd[3*N_inject+2*s+1];
+      setParticleWeight(particles[s],w);
 #ifdef ION_SPECTRA_ALONG_ORBIT
-      particles[p].state[particle::INI_CELLID] = simClasses->pargrid.getGlobalIDs()[blockID];
-      particles[p].state[particle::INI_X] = xBlock + particles[p].state[particle::X];
-      particles[p].state[particle::INI_Y] = yBlock + particles[p].state[particle::Y];
-      particles[p].state[particle::INI_Z] = zBlock + particles[p].state[particle::Z];
-      particles[p].state[particle::INI_VX] =  particles[p].state[particle::VX];
-      particles[p].state[particle::INI_VY] =  particles[p].state[particle::VY];
-      particles[p].state[particle::INI_VZ] =  particles[p].state[particle::VZ];
-      particles[p].state[particle::INI_TIME] = sim->t;
+      particles[s].iniCellID = simClasses->pargrid.getGlobalIDs()[blockID];
+      particles[s].state[particle::INI_X] = xBlock + particles[s].state[particle::X];
+      particles[s].state[particle::INI_Y] = yBlock + particles[s].state[particle::Y];
+      particles[s].state[particle::INI_Z] = zBlock + particles[s].state[particle::Z];
+      particles[s].state[particle::INI_VX] =  particles[s].state[particle::VX];
+      particles[s].state[particle::INI_VY] =  particles[s].state[particle::VY];
+      particles[s].state[particle::INI_VZ] =  particles[s].state[particle::VZ];
+      particles[s].state[particle::INI_TIME] = sim->t;
 #endif
-      // inject counter
-      Hybrid::particleCounterInject[species.popid-1] += w;
-      Hybrid::particleCounterInjectMacroparticles[species.popid-1] += 1;
    }
-   return true;
 }
 
 bool InjectorSolarWind::addConfigFileItems(ConfigReader& cr,const std::string& configRegionName) {
@@ -300,6 +372,8 @@ bool InjectorSolarWind::initialize(Simulation& sim,SimulationClasses& simClasses
 				   const std::string& configRegionName,const ParticleListBase* plist) {
    initialized = ParticleInjectorBase::initialize(sim,simClasses,cr,configRegionName,plist);
    this->species = reinterpret_cast<const Species*>(plist->getSpecies());
+   randomStreamID = newRandomStreamID();
+   injection.setName(species->name+" injection");
    
    Real T=0;
    cr.parse();
@@ -315,6 +389,9 @@ bool InjectorSolarWind::initialize(Simulation& sim,SimulationClasses& simClasses
    else {
       N_macroParticlesPerCellPerDt = N_macroParticlesPerCell = n = w = 0.0;
    }
+#ifdef USE_SPECIES_WEIGHT
+   if(Species::setWeight(simClasses,species->popid,w) == false) { initialized = false; }
+#endif
    if(T > 0) { vth = sqrt(constants::BOLTZMANN*T/species->m); }
    else { vth = 0.0; }
    int N_yz_cells = (sim.y_blocks-2)*(sim.z_blocks-2)*block::WIDTH_Y*block::WIDTH_Z; // blocks != 1 do not work in hybrid
@@ -344,6 +421,36 @@ bool InjectorSolarWind::initialize(Simulation& sim,SimulationClasses& simClasses
    return initialized;
 }
 
+// SPARSE INJECTION SOURCES
+
+/** Build the source index from per-cell injection rates of one population.
+ * @param simClasses Generic simulation classes.
+ * @param cellRates Per-cell rates of all populations, N_populations values per cell.
+ * @param N_populations Number of populations in cellRates.
+ * @param population Index of the population.*/
+void InjectionSources::build(SimulationClasses& simClasses,const Real* cellRates,unsigned int N_populations,unsigned int population) {
+   partition = Hybrid::partitionCounter;
+   blocks.clear();
+   offsets.clear();
+   centers.clear();
+   rates.clear();
+   offsets.push_back(0);
+   for(pargrid::CellID b=0;b<simClasses.pargrid.getNumberOfLocalCells();++b) {
+      for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) {
+	 const size_t n = (b*block::SIZE+block::index(i,j,k))*N_populations + population;
+	 if(cellRates[n] <= 0.0) { continue; }
+	 centers.push_back((i+0.5)*Hybrid::dx);
+	 centers.push_back((j+0.5)*Hybrid::dx);
+	 centers.push_back((k+0.5)*Hybrid::dx);
+	 rates.push_back(cellRates[n]);
+      }
+      if(rates.size() > offsets.back()) {
+	 blocks.push_back(b);
+	 offsets.push_back(rates.size());
+      }
+   }
+}
+
 // IONOSPHERE EMISSION INJECTOR
 
 InjectorIonosphere::InjectorIonosphere(): ParticleInjectorBase() { 
@@ -366,83 +473,86 @@ bool InjectorIonosphere::inject(pargrid::DataID speciesDataID,unsigned int* N_pa
    if(initialized == false) { return initialized; }
    bool success = true;
    if(sim->timestep <= 0) { return success; }
-   pargrid::DataWrapper<Particle<Real> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<Real> >(speciesDataID);
-   for(pargrid::CellID b=0;b<simClasses->pargrid.getNumberOfLocalCells();++b) {
-      if(injectParticles(b,*species,N_particles,wrapper) == false) { success = false; }
+   pargrid::DataWrapper<Particle<ParticleReal> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<ParticleReal> >(speciesDataID);
+   // rates move with their blocks in repartitioning, only the index of local blocks is rebuilt
+   if(sources.partition != Hybrid::partitionCounter) {
+      const Real* cellIonosphere = simClasses->pargrid.getUserDataStatic<Real>(Hybrid::dataCellIonosphereID);
+      sources.build(*simClasses,cellIonosphere,Hybrid::N_ionospherePopulations,N_ionoPop);
    }
+   injection.inject(*this,*sim,*simClasses,sources.blocks,wrapper,N_particles);
    return success;
 }
 
-bool InjectorIonosphere::injectParticles(pargrid::CellID blockID,const Species& species,unsigned int* N_particles,
-				       pargrid::DataWrapper<Particle<Real> >& wrapper) {
+// number of new particles in each source cell of the given source block
+size_t InjectorIonosphere::countParticles(size_t sourceBlock,RandomStream& random,InjectorScratch& scratch) const {
+   const size_t firstSource = sources.offsets[sourceBlock];
+   const size_t N_sources = sources.offsets[sourceBlock+1] - firstSource;
+   const Real* rates = &sources.rates[firstSource];
+   if(scratch.cellCount.size() < N_sources) { scratch.cellCount.resize(N_sources); }
+   size_t N_inject = 0;
+   for(size_t c=0;c<N_sources;++c) {
+      scratch.cellCount[c] = random.probround(rates[c]);
+      N_inject += scratch.cellCount[c];
+   }
+   return N_inject;
+}
+
+void InjectorIonosphere::writeParticles(size_t sourceBlock,RandomStream& random,InjectorScratch& scratch,size_t N_inject,
+					  Particle<ParticleReal>* particles) const {
+   const pargrid::CellID blockID = sources.blocks[sourceBlock];
+   const size_t firstSource = sources.offsets[sourceBlock];
+   const size_t N_sources = sources.offsets[sourceBlock+1] - firstSource;
    const Real* crd = getBlockCoordinateArray(*sim,*simClasses);
    const size_t b3 = 3*blockID;
    const Real xBlock = crd[b3+0];
    const Real yBlock = crd[b3+1];
    const Real zBlock = crd[b3+2];
-   Real* cellIonosphere = simClasses->pargrid.getUserDataStatic<Real>(Hybrid::dataCellIonosphereID);
-   vector<Real> xinj,yinj,zinj;
-   for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) {
-      const int n = (blockID*block::SIZE+block::index(i,j,k));
-      const size_t nIono = n*Hybrid::N_ionospherePopulations + N_ionoPop;
-      const int N_injectCell = probround(*simClasses,cellIonosphere[nIono]);
-      if(N_injectCell <= 0) { return true; }
-      const Real xCell = (i+0.5)*Hybrid::dx;
-      const Real yCell = (j+0.5)*Hybrid::dx;
-      const Real zCell = (k+0.5)*Hybrid::dx;
-      for(int s = 0;s<N_injectCell;s++) {
-	 const Real eps = 1.0e-2;
-	 const Real x = xCell + (1.0-eps)*Hybrid::dx*(simClasses->random.uniform()-0.5);
-	 const Real y = yCell + (1.0-eps)*Hybrid::dx*(simClasses->random.uniform()-0.5);
-	 const Real z = zCell + (1.0-eps)*Hybrid::dx*(simClasses->random.uniform()-0.5);
-	 xinj.push_back(x);
-	 yinj.push_back(y);
-	 zinj.push_back(z);
-      }
-   }   
-   // make room for new particles:
-   const int N_inject = static_cast<int>(xinj.size());
-   const pargrid::ArraySizetype oldSize = wrapper.size()[blockID];
-   N_particles[blockID] += N_inject;
-   wrapper.resize(blockID,oldSize+N_inject);
-   Particle<Real>* particles = wrapper.data()[blockID];
+   // random positions and velocities of all new particles
+   if(scratch.rnd.size() < 6*N_inject) { scratch.rnd.resize(6*N_inject); }
+   const Real* const rndPos = &scratch.rnd[0];
+   const Real* const rndVel = &scratch.rnd[3*N_inject];
+   random.uniform(&scratch.rnd[0],3*N_inject);
+   random.gauss(&scratch.rnd[3*N_inject],3*N_inject);
+   const Real eps = 1.0e-2;
    size_t s = 0;
-   for(size_t p=oldSize; p<oldSize+N_inject; ++p) {
-      particles[p].state[particle::X] = xinj[s];
-      particles[p].state[particle::Y] = yinj[s];
-      particles[p].state[particle::Z] = zinj[s];
-      const Real x = xBlock + xinj[s];
-      const Real y = yBlock + yinj[s];
-      const Real z = zBlock + zinj[s];
-      Real vx = vth*gaussrnd(*simClasses);
-      Real vy = vth*gaussrnd(*simClasses);
-      Real vz = vth*gaussrnd(*simClasses);
-      // make sure that velocity is upwards
-      if (vx*x + vy*y + vz*z < 0) {
-         vx = -vx;
-         vy = -vy;
-         vz = -vz;
-      }
-      particles[p].state[particle::VX] = vx;
-      particles[p].state[particle::VY] = vy;
-      particles[p].state[particle::VZ] = vz;
-      particles[p].state[particle::WEIGHT] = w;
+   const Real* centers = &sources.centers[3*firstSource];
+   for(size_t c=0;c<N_sources;++c) {
+      const Real xCell = centers[3*c+0];
+      const Real yCell = centers[3*c+1];
+      const Real zCell = centers[3*c+2];
+      for(int p=0;p<scratch.cellCount[c];++p) {
+	 particles[s].state[particle::X] = xCell + (1.0-eps)*Hybrid::dx*(rndPos[3*s+0]-0.5);
+	 particles[s].state[particle::Y] = yCell + (1.0-eps)*Hybrid::dx*(rndPos[3*s+1]-0.5);
+	 particles[s].state[particle::Z] = zCell + (1.0-eps)*Hybrid::dx*(rndPos[3*s+2]-0.5);
+	 Real vx = vth*rndVel[3*s+0];
+	 Real vy = vth*rndVel[3*s+1];
+	 Real vz = vth*rndVel[3*s+2];
+	 // make sure that velocity is upwards
+	 const Real x = xBlock + particles[s].state[particle::X];
+	 const Real y = yBlock + particles[s].state[particle::Y];
+	 const Real z = zBlock + particles[s].state[particle::Z];
+	 if (vx*x + vy*y + vz*z < 0) {
+	    vx = -vx;
+	    vy = -vy;
+	    vz = -vz;
+	 }
+	 particles[s].state[particle::VX] = vx;
+	 particles[s].state[particle::VY] = vy;
+	 particles[s].state[particle::VZ] = vz;
+	 setParticleWeight(particles[s],w);
 #ifdef ION_SPECTRA_ALONG_ORBIT
-      particles[p].state[particle::INI_CELLID] = simClasses->pargrid.getGlobalIDs()[blockID];
-      particles[p].state[particle::INI_X] = xBlock + particles[p].state[particle::X];
-      particles[p].state[particle::INI_Y] = yBlock + particles[p].state[particle::Y];
-      particles[p].state[particle::INI_Z] = zBlock + particles[p].state[particle::Z];
-      particles[p].state[particle::INI_VX] =  particles[p].state[particle::VX];
-      particles[p].state[particle::INI_VY] =  particles[p].state[particle::VY];
-      particles[p].state[particle::INI_VZ] =  particles[p].state[particle::VZ];
-      particles[p].state[particle::INI_TIME] = sim->t;
+	 particles[s].iniCellID = simClasses->pargrid.getGlobalIDs()[blockID];
+	 particles[s].state[particle::INI_X] = xBlock + particles[s].state[particle::X];
+	 particles[s].state[particle::INI_Y] = yBlock + particles[s].state[particle::Y];
+	 particles[s].state[particle::INI_Z] = zBlock + particles[s].state[particle::Z];
+	 particles[s].state[particle::INI_VX] =  particles[s].state[particle::VX];
+	 particles[s].state[particle::INI_VY] =  particles[s].state[particle::VY];
+	 particles[s].state[particle::INI_VZ] =  particles[s].state[particle::VZ];
+	 particles[s].state[particle::INI_TIME] = sim->t;
 #endif
-      // inject counter
-      Hybrid::particleCounterInject[species.popid-1] += w;
-      Hybrid::particleCounterInjectMacroparticles[species.popid-1] += 1;
-      ++s;
+	 ++s;
+      }
    }
-   return true;
 }
 
 bool InjectorIonosphere::addConfigFileItems(ConfigReader& cr,const std::string& configRegionName) {
@@ -460,6 +570,8 @@ bool InjectorIonosphere::initialize(Simulation& sim,SimulationClasses& simClasse
 				    const std::string& configRegionName,const ParticleListBase* plist) {
    initialized = ParticleInjectorBase::initialize(sim,simClasses,cr,configRegionName,plist);
    this->species = reinterpret_cast<const Species*>(plist->getSpecies());
+   randomStreamID = newRandomStreamID();
+   injection.setName(species->name+" injection");
    string profileName = "";
    Real noonFactor = -1.0;
    Real nightFactor = -1.0;
@@ -491,6 +603,9 @@ bool InjectorIonosphere::initialize(Simulation& sim,SimulationClasses& simClasse
    else {
       N_macroParticlesPerDt = totalRate = w = 0.0;
    }
+#ifdef USE_SPECIES_WEIGHT
+   if(Species::setWeight(simClasses,species->popid,w) == false) { initialized = false; }
+#endif
    if(T > 0) { vth = sqrt(constants::BOLTZMANN*T/species->m); }
    else { vth = 0.0; }
    simClasses.logger
@@ -523,29 +638,10 @@ bool InjectorIonosphere::initialize(Simulation& sim,SimulationClasses& simClasse
 	 const Real xCell = crd[b3+0] + (i+0.5)*Hybrid::dx;
 	 const Real yCell = crd[b3+1] + (j+0.5)*Hybrid::dx;
 	 const Real zCell = crd[b3+2] + (k+0.5)*Hybrid::dx;
-	 const Real xCellMin = xCell - 0.5*Hybrid::dx;
-	 const Real yCellMin = yCell - 0.5*Hybrid::dx;
-	 const Real zCellMin = zCell - 0.5*Hybrid::dx;
-	 const Real xCellMax = xCell + 0.5*Hybrid::dx;
-	 const Real yCellMax = yCell + 0.5*Hybrid::dx;
-	 const Real zCellMax = zCell + 0.5*Hybrid::dx;
-	 // generate N random points inside each cell
-	 Real N_inside = 0;
-	 for(int s = 0;s<1000;s++) {
-	    const Real eps = 1.0e-2;
-	    Real x = xCell + (1.0-eps)*Hybrid::dx*(simClasses.random.uniform()-0.5);
-	    Real y = yCell + (1.0-eps)*Hybrid::dx*(simClasses.random.uniform()-0.5);
-	    Real z = zCell + (1.0-eps)*Hybrid::dx*(simClasses.random.uniform()-0.5);
-	    // project points on a shell r = R
-	    const Real norm = R/sqrt(sqr(x) + sqr(y) + sqr(z));
-	    x *= norm;
-	    y *= norm;
-	    z *= norm;
-	    // check how many of the projected points are inside each cell
-	    if(x > xCellMin && x < xCellMax && y > yCellMin && y < yCellMax && z > zCellMin && z < zCellMax) {
-	       N_inside++;
-	    }
-	 }
+	 // area of the emission shell r = R inside the cell
+	 const Real cellMin[3] = {xCell-0.5*Hybrid::dx,yCell-0.5*Hybrid::dx,zCell-0.5*Hybrid::dx};
+	 const uint64_t cell = static_cast<uint64_t>(simClasses.pargrid.getGlobalIDs()[b])*block::SIZE + block::index(i,j,k);
+	 Real N_inside = getShellCellArea(R,Hybrid::dx,cell,cellMin);
          // dayside: cos(sza) dependency and nightside: constant
          if(profileName.compare("ionoCosSzaDayConstantNight") == 0) {
             const Real rr = sqrt(sqr(xCell) + sqr(yCell) + sqr(zCell));
@@ -618,6 +714,7 @@ bool InjectorIonosphere::initialize(Simulation& sim,SimulationClasses& simClasse
 	 }
       }
    }
+   sources.build(simClasses,cellIonosphere,Hybrid::N_ionospherePopulations,N_ionoPop);
    return initialized;
 }
 
@@ -648,15 +745,35 @@ bool InjectorExosphere::inject(pargrid::DataID speciesDataID,unsigned int* N_par
    if(initialized == false) { return initialized; }
    bool success = true;
    if(sim->timestep <= 0) { return success; }
-   pargrid::DataWrapper<Particle<Real> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<Real> >(speciesDataID);
-   for(pargrid::CellID b=0;b<simClasses->pargrid.getNumberOfLocalCells();++b) {
-      if(injectParticles(b,*species,N_particles,wrapper) == false) { success = false; }
+   pargrid::DataWrapper<Particle<ParticleReal> > wrapper = simClasses->pargrid.getUserDataDynamic<Particle<ParticleReal> >(speciesDataID);
+   // rates move with their blocks in repartitioning, only the index of local blocks is rebuilt
+   if(sources.partition != Hybrid::partitionCounter) {
+      const Real* cellExosphere = simClasses->pargrid.getUserDataStatic<Real>(Hybrid::dataCellExosphereID);
+      sources.build(*simClasses,cellExosphere,Hybrid::N_exospherePopulations,N_exoPop);
    }
+   injection.inject(*this,*sim,*simClasses,sources.blocks,wrapper,N_particles);
    return success;
 }
 
-bool InjectorExosphere::injectParticles(pargrid::CellID blockID,const Species& species,unsigned int* N_particles,
-				       pargrid::DataWrapper<Particle<Real> >& wrapper) {
+// number of new particles in each source cell of the given source block
+size_t InjectorExosphere::countParticles(size_t sourceBlock,RandomStream& random,InjectorScratch& scratch) const {
+   const size_t firstSource = sources.offsets[sourceBlock];
+   const size_t N_sources = sources.offsets[sourceBlock+1] - firstSource;
+   const Real* rates = &sources.rates[firstSource];
+   if(scratch.cellCount.size() < N_sources) { scratch.cellCount.resize(N_sources); }
+   size_t N_inject = 0;
+   for(size_t c=0;c<N_sources;++c) {
+      scratch.cellCount[c] = random.probround(rates[c]);
+      N_inject += scratch.cellCount[c];
+   }
+   return N_inject;
+}
+
+void InjectorExosphere::writeParticles(size_t sourceBlock,RandomStream& random,InjectorScratch& scratch,size_t N_inject,
+				       Particle<ParticleReal>* particles) const {
+   const pargrid::CellID blockID = sources.blocks[sourceBlock];
+   const size_t firstSource = sources.offsets[sourceBlock];
+   const size_t N_sources = sources.offsets[sourceBlock+1] - firstSource;
 #ifdef ION_SPECTRA_ALONG_ORBIT
    const Real* crd = getBlockCoordinateArray(*sim,*simClasses);
    const size_t b3 = 3*blockID;
@@ -664,57 +781,40 @@ bool InjectorExosphere::injectParticles(pargrid::CellID blockID,const Species& s
    const Real yBlock = crd[b3+1];
    const Real zBlock = crd[b3+2];
 #endif
-   Real* cellExosphere = simClasses->pargrid.getUserDataStatic<Real>(Hybrid::dataCellExosphereID);
-   vector<Real> xinj,yinj,zinj;
-   for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) {
-      const int n = (blockID*block::SIZE+block::index(i,j,k));
-      const size_t nExo = n*Hybrid::N_exospherePopulations + N_exoPop;
-      const int N_injectCell = probround(*simClasses,cellExosphere[nExo]);
-      if(N_injectCell <= 0) { return true; }
-      const Real xCell = (i+0.5)*Hybrid::dx;
-      const Real yCell = (j+0.5)*Hybrid::dx;
-      const Real zCell = (k+0.5)*Hybrid::dx;
-      for(int s = 0;s<N_injectCell;s++) {
-	 const Real eps = 1.0e-2;
-	 const Real x = xCell + (1.0-eps)*Hybrid::dx*(simClasses->random.uniform()-0.5);
-	 const Real y = yCell + (1.0-eps)*Hybrid::dx*(simClasses->random.uniform()-0.5);
-	 const Real z = zCell + (1.0-eps)*Hybrid::dx*(simClasses->random.uniform()-0.5);
-	 xinj.push_back(x);
-	 yinj.push_back(y);
-	 zinj.push_back(z);
-      }
-   }
-   // Make room for new particles:
-   const int N_inject = static_cast<int>(xinj.size());
-   const pargrid::ArraySizetype oldSize = wrapper.size()[blockID];
-   N_particles[blockID] += N_inject;
-   wrapper.resize(blockID,oldSize+N_inject);
-   Particle<Real>* particles = wrapper.data()[blockID];
+   // random positions and velocities of all new particles
+   if(scratch.rnd.size() < 6*N_inject) { scratch.rnd.resize(6*N_inject); }
+   const Real* const rndPos = &scratch.rnd[0];
+   const Real* const rndVel = &scratch.rnd[3*N_inject];
+   random.uniform(&scratch.rnd[0],3*N_inject);
+   random.gauss(&scratch.rnd[3*N_inject],3*N_inject);
+   const Real eps = 1.0e-2;
    size_t s = 0;
-   for(size_t p=oldSize; p<oldSize+N_inject; ++p) {
-      particles[p].state[particle::X] = xinj[s];
-      particles[p].state[particle::Y] = yinj[s];
-      particles[p].state[particle::Z] = zinj[s];
-      particles[p].state[particle::VX] = vth*gaussrnd(*simClasses);
-      particles[p].state[particle::VY] = vth*gaussrnd(*simClasses);
-      particles[p].state[particle::VZ] = vth*gaussrnd(*simClasses);
-      particles[p].state[particle::WEIGHT] = w;
+   const Real* centers = &sources.centers[3*firstSource];
+   for(size_t c=0;c<N_sources;++c) {
+      const Real xCell = centers[3*c+0];
+      const Real yCell = centers[3*c+1];
+      const Real zCell = centers[3*c+2];
+      for(int p=0;p<scratch.cellCount[c];++p) {
+	 particles[s].state[particle::X] = xCell + (1.0-eps)*Hybrid::dx*(rndPos[3*s+0]-0.5);
+	 particles[s].state[particle::Y] = yCell + (1.0-eps)*Hybrid::dx*(rndPos[3*s+1]-0.5);
+	 particles[s].state[particle::Z] = zCell + (1.0-eps)*Hybrid::dx*(rndPos[3*s+2]-0.5);
+	 particles[s].state[particle::VX] = vth*rndVel[3*s+0];
+	 particles[s].state[particle::VY] = vth*rndVel[3*s+1];
+	 particles[s].state[particle::VZ] = vth*rndVel[3*s+2];
+	 setParticleWeight(particles[s],w);
 #ifdef ION_SPECTRA_ALONG_ORBIT
-      particles[p].state[particle::INI_CELLID] = simClasses->pargrid.getGlobalIDs()[blockID];
-      particles[p].state[particle::INI_X] = xBlock + particles[p].state[particle::X];
-      particles[p].state[particle::INI_Y] = yBlock + particles[p].state[particle::Y];
-      particles[p].state[particle::INI_Z] = zBlock + particles[p].state[particle::Z];
-      particles[p].state[particle::INI_VX] =  particles[p].state[particle::VX];
-      particles[p].state[particle::INI_VY] =  particles[p].state[particle::VY];
-      particles[p].state[particle::INI_VZ] =  particles[p].state[particle::VZ];
-      particles[p].state[particle::INI_TIME] = sim->t;
+	 particles[s].iniCellID = simClasses->pargrid.getGlobalIDs()[blockID];
+	 particles[s].state[particle::INI_X] = xBlock + particles[s].state[particle::X];
+	 particles[s].state[particle::INI_Y] = yBlock + particles[s].state[particle::Y];
+	 particles[s].state[particle::INI_Z] = zBlock + particles[s].state[particle::Z];
+	 particles[s].state[particle::INI_VX] =  particles[s].state[particle::VX];
+	 particles[s].state[particle::INI_VY] =  particles[s].state[particle::VY];
+	 particles[s].state[particle::INI_VZ] =  particles[s].state[particle::VZ];
+	 particles[s].state[particle::INI_TIME] = sim->t;
 #endif
-      // inject counter
-      Hybrid::particleCounterInject[species.popid-1] += w;
-      Hybrid::particleCounterInjectMacroparticles[species.popid-1] += 1;
-      ++s;
+	 ++s;
+      }
    }
-   return true;
 }
 
 bool InjectorExosphere::addConfigFileItems(ConfigReader& cr,const std::string& configRegionName) {
@@ -736,6 +836,8 @@ bool InjectorExosphere::initialize(Simulation& sim,SimulationClasses& simClasses
 				    const std::string& configRegionName,const ParticleListBase* plist) {
    initialized = ParticleInjectorBase::initialize(sim,simClasses,cr,configRegionName,plist);
    this->species = reinterpret_cast<const Species*>(plist->getSpecies());
+   randomStreamID = newRandomStreamID();
+   injection.setName(species->name+" injection");
    Real T = 0.0;
    Real totalRate = 0.0;
    cr.parse();
@@ -764,6 +866,9 @@ bool InjectorExosphere::initialize(Simulation& sim,SimulationClasses& simClasses
    else {
       N_macroParticlesPerDt = totalRate = w = 0.0;
    }
+#ifdef USE_SPECIES_WEIGHT
+   if(Species::setWeight(simClasses,species->popid,w) == false) { initialized = false; }
+#endif
    if(T > 0) { vth = sqrt(constants::BOLTZMANN*T/species->m); }
    else { vth = 0.0; }
    static unsigned int exoPopCnt = 0;
@@ -771,31 +876,50 @@ bool InjectorExosphere::initialize(Simulation& sim,SimulationClasses& simClasses
    exoPopCnt++;
    
    Real* cellExosphere = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataCellExosphereID);
+   const Real* crd = getBlockCoordinateArray(sim,simClasses);
+   NeutralProfileArgs a;
+   a.m = species->m;
+   a.r0 = r0;
+   a.n0 = n0;
+   a.H0 = H0;
+   a.T0 = T0;
+   a.k0 = k0;
+   a.R_exobase = R_exobase;
+   a.R_shadow = R_shadow;
+   // radial range of local cells
+   Real r_min = numeric_limits<Real>::max();
+   Real r_max = 0.0;
+   const int blockWidth[3] = {block::WIDTH_X,block::WIDTH_Y,block::WIDTH_Z};
+   for(pargrid::CellID b=0;b<simClasses.pargrid.getNumberOfLocalCells();++b) {
+      Real dMin2 = 0.0;
+      Real dMax2 = 0.0;
+      for(int i=0;i<3;++i) {
+	 const Real lo = crd[3*b+i];
+	 const Real hi = crd[3*b+i] + blockWidth[i]*Hybrid::dx;
+	 if(lo > 0.0) { dMin2 += sqr(lo); }
+	 else if(hi < 0.0) { dMin2 += sqr(hi); }
+	 dMax2 += sqr(max(fabs(lo),fabs(hi)));
+      }
+      r_min = min(r_min,sqrt(dMin2));
+      r_max = max(r_max,sqrt(dMax2));
+   }
+   NeutralProfileTable profile;
+   vector<Real> blockDensity(block::SIZE);
    Real sumThisProcess = 0.0;
-   for(pargrid::CellID b=0;b<simClasses.pargrid.getNumberOfLocalCells();++b) {  
-      const Real* crd = getBlockCoordinateArray(sim,simClasses);
-      const size_t b3 = 3*b;
-      for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) {
-	 const int n = (b*block::SIZE+block::index(i,j,k));
-	 const size_t nExo = n*Hybrid::N_exospherePopulations + N_exoPop;
-	 const Real xCell = crd[b3+0] + (i+0.5)*Hybrid::dx;
-	 const Real yCell = crd[b3+1] + (j+0.5)*Hybrid::dx;
-	 const Real zCell = crd[b3+2] + (k+0.5)*Hybrid::dx;
-	 NeutralProfileArgs a;
-	 a.m = species->m;
-	 a.r0 = r0;
-	 a.n0 = n0;
-	 a.H0 = H0;
-	 a.T0 = T0;
-	 a.k0 = k0;
-	 a.R_exobase = R_exobase;
-	 a.R_shadow = R_shadow;
-	 cellExosphere[nExo] = getNeutralDensity(simClasses,neutralProfileName,xCell,yCell,zCell,a)*Hybrid::dV;
-	 if(cellExosphere[nExo] < 0.0) {
-	    simClasses.logger << "(" << species->name << ") ERROR: Neutral profile init failed" << endl << write;
-	    initialized = false;
-	    goto break_for;
-	 }
+   if(profile.initialize(simClasses,neutralProfileName,a,r_min,r_max,Hybrid::dx/64) == false) {
+      simClasses.logger << "(" << species->name << ") ERROR: Neutral profile init failed" << endl << write;
+      initialized = false;
+      goto break_for;
+   }
+   for(pargrid::CellID b=0;b<simClasses.pargrid.getNumberOfLocalCells();++b) {
+      if(profile.densities(simClasses,&crd[3*b],Hybrid::dx,&blockDensity[0]) == false) {
+	 simClasses.logger << "(" << species->name << ") ERROR: Neutral profile init failed" << endl << write;
+	 initialized = false;
+	 goto break_for;
+      }
+      for(int n=0;n<block::SIZE;++n) {
+	 const size_t nExo = (b*block::SIZE+n)*Hybrid::N_exospherePopulations + N_exoPop;
+	 cellExosphere[nExo] = blockDensity[n]*Hybrid::dV;
 	 sumThisProcess += cellExosphere[nExo];
       }
    }
@@ -811,6 +935,7 @@ break_for:
 	 const size_t nExo = n*Hybrid::N_exospherePopulations + N_exoPop;
 	 cellExosphere[nExo] = N_macroParticlesPerDt*cellExosphere[nExo]*ionizationRate/totalRate; }
    }
+   sources.build(simClasses,cellExosphere,Hybrid::N_exospherePopulations,N_exoPop);
    simClasses.logger
      << "(" << species->name << ") neutral profile     = " << neutralProfileName << endl
      << "(" << species->name << ") neutral profile: r0 = " << radiusToString(r0) << endl
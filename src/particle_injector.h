@@ -21,6 +21,7 @@
 
 #include <cstdlib>
 #include <climits>
+#include <vector>
 
 #include <simulation.h>
 #include <simulationclasses.h>
@@ -29,6 +30,41 @@
 #include <base_class_particle_injector.h>
 #include "particle_definition.h"
 #include "particle_species.h"
+#include "random_stream.h"
+#include "block_scheduler.h"
+#include "hybrid.h"
+
+/** Buffers of one thread used by injectors.*/
+struct InjectorScratch {
+   std::vector<int> cellCount;        /**< Number of particles injected in each (source) cell of a block.*/
+   std::vector<Real> rnd;             /**< Random numbers of injected particles, reused between blocks.*/
+};
+
+/** Injects particles to a list of local blocks on OpenMP threads. ParGrid dynamic data is only
+ * resized serially, so new particles are first counted on threads, blocks are then resized, and
+ * new particles are written on threads. Each block has its own counter-based random stream that
+ * is started again for writing, so the counts drawn in both passes are the same and the result
+ * does not depend on the number of threads. Injection counters are summed in block order.
+ *
+ * The injector gives access to its species, w and randomStreamID, and implements
+ * size_t countParticles(size_t n,RandomStream& random,InjectorScratch& scratch) that draws the
+ * number of new particles of the n:th block and void writeParticles(size_t n,RandomStream& random,
+ * InjectorScratch& scratch,size_t N_inject,Particle<ParticleReal>* particles) that writes them,
+ * continuing the stream after countParticles.*/
+class BlockInjection {
+ public:
+   template<class INJECTOR>
+   void inject(INJECTOR& injector,Simulation& sim,SimulationClasses& simClasses,const std::vector<pargrid::CellID>& blocks,
+	       pargrid::DataWrapper<Particle<ParticleReal> >& wrapper,unsigned int* N_particles);
+   void setName(const std::string& name);
+
+ private:
+   BlockScheduler scheduler;
+   std::vector<InjectorScratch> scratch;          /**< Buffers of each thread.*/
+   std::vector<size_t> N_inject;                  /**< Number of new particles in each block.*/
+   std::vector<pargrid::ArraySizetype> oldSizes;  /**< Number of particles in each block before injection.*/
+   std::vector<unsigned int> weights;             /**< Scheduler weights of local blocks, zero outside injection.*/
+};
 
 class InjectorUniform: public ParticleInjectorBase {
  public:
@@ -43,9 +79,13 @@ class InjectorUniform: public ParticleInjectorBase {
    bool initialized;
    Real N_macroParticlesPerCell;
    const Species* species;
+   uint32_t randomStreamID;
    Real U,vth,n,w;
-   bool injectParticles(pargrid::CellID blockID,const Species& species,unsigned int* N_particles,
-			pargrid::DataWrapper<Particle<Real> >& wrapper);
+   std::vector<pargrid::CellID> blocks; /**< Local blocks where particles are injected.*/
+   BlockInjection injection;
+   size_t countParticles(size_t n,RandomStream& random,InjectorScratch& scratch) const;
+   void writeParticles(size_t n,RandomStream& random,InjectorScratch& scratch,size_t N_inject,Particle<ParticleReal>* particles) const;
+   friend class BlockInjection;
 };
 
 class InjectorSolarWind: public ParticleInjectorBase {
@@ -64,9 +104,27 @@ class InjectorSolarWind: public ParticleInjectorBase {
    Real N_macroParticlesPerCellPerDt;
    Real N_macroParticlesPerCell;
    const Species* species;
+   uint32_t randomStreamID;
    Real U,vth,n,w;
-   bool injectParticles(pargrid::CellID blockID,const Species& species,unsigned int* N_particles,
-			pargrid::DataWrapper<Particle<Real> >& wrapper);
+   std::vector<pargrid::CellID> blocks; /**< Local blocks where particles are injected.*/
+   BlockInjection injection;
+   size_t countParticles(size_t n,RandomStream& random,InjectorScratch& scratch) const;
+   void writeParticles(size_t n,RandomStream& random,InjectorScratch& scratch,size_t N_inject,Particle<ParticleReal>* particles) const;
+   friend class BlockInjection;
+};
+
+/** Sparse index of cells with a nonzero injection rate, built from the per-cell rates of
+ * an ionosphere or exosphere population. Source cells are stored block by block, so that
+ * injection only needs to visit local blocks and cells that can receive new particles.
+ * Blocks are local IDs, so the index is rebuilt when Hybrid::partitionCounter changes.*/
+struct InjectionSources {
+   unsigned int partition;               /**< Value of Hybrid::partitionCounter when the index was built.*/
+   std::vector<pargrid::CellID> blocks;  /**< Local blocks containing at least one source cell.*/
+   std::vector<size_t> offsets;          /**< Index of the first source cell of each block, size blocks.size()+1.*/
+   std::vector<Real> centers;            /**< Block-local cell centre coordinates of each source cell.*/
+   std::vector<Real> rates;              /**< Number of macroparticles injected per timestep in each source cell.*/
+
+   void build(SimulationClasses& simClasses,const Real* cellRates,unsigned int N_populations,unsigned int population);
 };
 
 class InjectorIonosphere: public ParticleInjectorBase {
@@ -83,10 +141,14 @@ class InjectorIonosphere: public ParticleInjectorBase {
  private:
    bool initialized;
    const Species* species;
+   uint32_t randomStreamID;
    unsigned int N_ionoPop;
    Real N_macroParticlesPerCell,N_macroParticlesPerDt,vth,w,R;
-   bool injectParticles(pargrid::CellID blockID,const Species& species,unsigned int* N_particles,
-			pargrid::DataWrapper<Particle<Real> >& wrapper);
+   InjectionSources sources;          /**< Cells with a nonzero emission rate.*/
+   BlockInjection injection;
+   size_t countParticles(size_t sourceBlock,RandomStream& random,InjectorScratch& scratch) const;
+   void writeParticles(size_t sourceBlock,RandomStream& random,InjectorScratch& scratch,size_t N_inject,Particle<ParticleReal>* particles) const;
+   friend class BlockInjection;
 };
 
 class InjectorExosphere: public ParticleInjectorBase {
@@ -103,14 +165,90 @@ class InjectorExosphere: public ParticleInjectorBase {
  private:
    bool initialized;
    const Species* species;
+   uint32_t randomStreamID;
    unsigned int N_exoPop;
    std::string neutralProfileName;
    Real N_macroParticlesPerCell,N_macroParticlesPerDt,vth,w,r0,R_exobase,R_shadow;
    std::vector<Real> n0,H0,T0,k0;
-   bool injectParticles(pargrid::CellID blockID,const Species& species,unsigned int* N_particles,
-			pargrid::DataWrapper<Particle<Real> >& wrapper);
+   InjectionSources sources;          /**< Cells with a nonzero emission rate.*/
+   BlockInjection injection;
+   size_t countParticles(size_t sourceBlock,RandomStream& random,InjectorScratch& scratch) const;
+   void writeParticles(size_t sourceBlock,RandomStream& random,InjectorScratch& scratch,size_t N_inject,Particle<ParticleReal>* particles) const;
+   friend class BlockInjection;
 };
 
+/** Inject particles to the given blocks.
+ * @param injector Injector that draws the new particles.
+ * @param sim Generic simulation variables.
+ * @param simClasses Generic simulation classes.
+ * @param blocks Local IDs of the blocks, countParticles and writeParticles get indices to this array.
+ * @param wrapper Particles of the injected species.
+ * @param N_particles Number of particles in each local block, updated.*/
+template<class INJECTOR> inline
+void BlockInjection::inject(INJECTOR& injector,Simulation& sim,SimulationClasses& simClasses,const std::vector<pargrid::CellID>& blocks,
+			    pargrid::DataWrapper<Particle<ParticleReal> >& wrapper,unsigned int* N_particles) {
+   if(blocks.size() == 0) { return; }
+   const pargrid::CellID N_localBlocks = simClasses.pargrid.getNumberOfLocalCells();
+   if(weights.size() != N_localBlocks) { weights.assign(N_localBlocks,0); }
+   if(scratch.size() < static_cast<size_t>(getMaxThreads())) { scratch.resize(getMaxThreads()); }
+   const std::vector<pargrid::CellID>& globalIDs = simClasses.pargrid.getGlobalIDs();
+   N_inject.resize(blocks.size());
+   oldSizes.resize(blocks.size());
+
+   // Count new particles, blocks have equal weights:
+   scheduler.schedule(blocks,&(weights[0]));
+   #ifdef _OPENMP
+      #pragma omp parallel
+   #endif
+   {
+      const int thread = getThreadNumber();
+      scheduler.startThread(thread);
+      size_t n;
+      while(scheduler.next(thread,n) == true) {
+	 RandomStream random(Hybrid::randomSeed,injector.randomStreamID,sim.timestep,globalIDs[blocks[n]]);
+	 N_inject[n] = injector.countParticles(n,random,scratch[thread]);
+      }
+      scheduler.stopThread(thread);
+   }
+
+   // Make room for new particles:
+   for(size_t n=0; n<blocks.size(); ++n) {
+      const pargrid::CellID blockID = blocks[n];
+      oldSizes[n] = wrapper.size()[blockID];
+      if(N_inject[n] == 0) { continue; }
+      N_particles[blockID] += N_inject[n];
+      wrapper.resize(blockID,oldSizes[n]+N_inject[n]);
+      weights[blockID] = N_inject[n];
+   }
+
+   // Write new particles, blocks are weighted by the number of new particles:
+   scheduler.schedule(blocks,&(weights[0]));
+   #ifdef _OPENMP
+      #pragma omp parallel
+   #endif
+   {
+      const int thread = getThreadNumber();
+      scheduler.startThread(thread);
+      size_t n;
+      while(scheduler.next(thread,n) == true) {
+	 if(N_inject[n] == 0) { continue; }
+	 const pargrid::CellID blockID = blocks[n];
+	 RandomStream random(Hybrid::randomSeed,injector.randomStreamID,sim.timestep,globalIDs[blockID]);
+	 injector.countParticles(n,random,scratch[thread]);
+	 injector.writeParticles(n,random,scratch[thread],N_inject[n],wrapper.data()[blockID]+oldSizes[n]);
+      }
+      scheduler.stopThread(thread);
+   }
+
+   // inject counters
+   const unsigned int popid = injector.species->popid;
+   for(size_t n=0; n<blocks.size(); ++n) {
+      weights[blocks[n]] = 0;
+      Hybrid::particleCounterInject[popid-1] += N_inject[n]*injector.w;
+      Hybrid::particleCounterInjectMacroparticles[popid-1] += N_inject[n];
+   }
+}
+
 inline ParticleInjectorBase* UniformIonCreator() {return new InjectorUniform();}
 inline ParticleInjectorBase* SolarWindIonCreator() {return new InjectorSolarWind();}
 inline ParticleInjectorBase* IonosphereIonCreator() {return new InjectorIonosphere();}
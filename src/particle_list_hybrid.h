@@ -90,7 +90,7 @@ bool ParticleListHybrid<SPECIES,PARTICLE>::writeParticles(const std::string& spa
 	 buffer[counter+hybsave::VX] = particleLists[block][p].state[particle::VX];
 	 buffer[counter+hybsave::VY] = particleLists[block][p].state[particle::VY];
 	 buffer[counter+hybsave::VZ] = particleLists[block][p].state[particle::VZ];
-	 buffer[counter+hybsave::WEIGHT] = particleLists[block][p].state[particle::WEIGHT];
+	 buffer[counter+hybsave::WEIGHT] = getParticleWeight(this->species,particleLists[block][p]);
 	 buffer[counter+hybsave::POPID] = this->species.popid;
 	 buffer[counter+hybsave::BLOCKID] = static_cast<double>(this->simClasses->pargrid.getGlobalIDs()[block]);
 #endif
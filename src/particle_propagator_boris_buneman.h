@@ -20,18 +20,27 @@
 #ifndef PARTICLE_PROPAGATOR_BORIS_BUNEMAN_H
 #define PARTICLE_PROPAGATOR_BORIS_BUNEMAN_H
 
+#include <algorithm>
+#include <vector>
+
 #include <configreader.h>
 #include <simulation.h>
 #include <simulationclasses.h>
 #include <base_class_particle_propagator.h>
 #include <linear_algebra.h>
 
+#include "block_scheduler.h"
 #include "hybrid.h"
 #include "hybrid_propagator.h"
+#include "particle_definition.h"
 #include "particle_species.h"
+#include "particle_sort.h"
 #ifdef USE_B_CONSTANT
 #include "magnetic_field.h"
 #endif
+#ifdef USE_FUSED_PUSH_ACCUMULATION
+#include "particle_accumulator.h"
+#endif
 
 template<class PARTICLE>
 class BorisBuneman: public ParticlePropagatorBase {
@@ -47,15 +56,119 @@ class BorisBuneman: public ParticlePropagatorBase {
    
  private:
    const Species* species;
+   uint64_t pushCounter;      // number of particle pushes done by this propagator
+   Real pushTime;             // wall time spent in pushing blocks [s]
+   BlockScheduler scheduler;  // distributes pushed blocks to threads
+   std::vector<char> pushed;  // nonzero for local blocks pushed on timestep pushTimestep
+   unsigned int pushTimestep; // timestep of the flags in pushed
    
-   void propagate(const Real xBlock,const Real yBlock,const Real zBlock,pargrid::CellID blockID,const Species& species,PARTICLE& particle,pargrid::CellID globalID);
+   void propagate(const Real xBlock,const Real yBlock,const Real zBlock,pargrid::CellID blockID,const Species& species,PARTICLE& particle,
+		  const bool accelerate,const Real* faceBArray,const Real* cellUeArray,Real* counterCellMaxVi);
+   void propagateBatched(const Real xBlock,const Real yBlock,const Real zBlock,pargrid::CellID blockID,const Species& species,PARTICLE* particles,size_t N_particles,
+			 const bool accelerate,const Real* faceBArray,const Real* cellUeArray,Real* counterCellMaxVi);
+   void propagateBlock(pargrid::CellID blockID,PARTICLE* particles,unsigned int N_particles);
+   void pushBlocks(pargrid::DataID particleDataID,const std::vector<pargrid::CellID>& blocks);
+#ifdef ION_SPECTRA_ALONG_ORBIT
+   void recordSpectraParticle(pargrid::CellID blockID,const Species& species,const PARTICLE& particle,pargrid::CellID globalID);
+#endif
 };
 
+// Boris-Buneman velocity update v -> v' in fields E and B, returns true if v' was limited to maxVi
+inline bool borisBunemanVelocity(const Real qmideltT2,const Real* E,const Real* B,Real& vx,Real& vy,Real& vz) {
+   Real tx,ty,tz,sx,sy,sz,dvx,dvy,dvz,vmx,vmy,vmz,v0x,v0y,v0z,vpx,vpy,vpz,t2,b2;
+   dvx=qmideltT2*E[0];
+   dvy=qmideltT2*E[1];
+   dvz=qmideltT2*E[2];
+   tx=qmideltT2*B[0];
+   ty=qmideltT2*B[1];
+   tz=qmideltT2*B[2];
+   t2=tx*tx+ty*ty+tz*tz;
+   b2=2./(1.+t2);
+   sx=b2*tx;
+   sy=b2*ty;
+   sz=b2*tz;
+   vmx=vx+dvx;
+   vmy=vy+dvy;
+   vmz=vz+dvz;
+   v0x=vmx+vmy*tz-vmz*ty;
+   v0y=vmy+vmz*tx-vmx*tz;
+   v0z=vmz+vmx*ty-vmy*tx;
+   vpx=vmx+v0y*sz-v0z*sy;
+   vpy=vmy+v0z*sx-v0x*sz;
+   vpz=vmz+v0x*sy-v0y*sx;
+   vx=vpx+dvx;
+   vy=vpy+dvy;
+   vz=vpz+dvz;
+   const Real v2 = sqr(vx) + sqr(vy) + sqr(vz);
+   if(v2 > Hybrid::maxVi2) {
+      const Real norm = sqrt(Hybrid::maxVi2/v2);
+      vx *= norm;
+      vy *= norm;
+      vz *= norm;
+      return true;
+   }
+   return false;
+}
+
+// number of particles pushed together by the batched Boris-Buneman kernel
+#define BORIS_BUNEMAN_BATCH_SIZE 64
+
+// Boris-Buneman velocity update of n particles with SIMD, the arithmetic is identical to
+// borisBunemanVelocity and the maxVi clamp is a blend, returns the number of limited velocities
+inline unsigned int borisBunemanVelocityBatch(const size_t n,const Real qmideltT2,
+					      const Real* __restrict__ Ex,const Real* __restrict__ Ey,const Real* __restrict__ Ez,
+					      const Real* __restrict__ Bx,const Real* __restrict__ By,const Real* __restrict__ Bz,
+					      Real* __restrict__ vx,Real* __restrict__ vy,Real* __restrict__ vz) {
+   const Real maxVi2 = Hybrid::maxVi2;
+   unsigned int N_maxVi = 0;
+   #pragma omp simd reduction(+:N_maxVi)
+   for(size_t p=0;p<n;++p) {
+      Real tx,ty,tz,sx,sy,sz,dvx,dvy,dvz,vmx,vmy,vmz,v0x,v0y,v0z,vpx,vpy,vpz,t2,b2;
+      dvx=qmideltT2*Ex[p];
+      dvy=qmideltT2*Ey[p];
+      dvz=qmideltT2*Ez[p];
+      tx=qmideltT2*Bx[p];
+      ty=qmideltT2*By[p];
+      tz=qmideltT2*Bz[p];
+      t2=tx*tx+ty*ty+tz*tz;
+      b2=2./(1.+t2);
+      sx=b2*tx;
+      sy=b2*ty;
+      sz=b2*tz;
+      vmx=vx[p]+dvx;
+      vmy=vy[p]+dvy;
+      vmz=vz[p]+dvz;
+      v0x=vmx+vmy*tz-vmz*ty;
+      v0y=vmy+vmz*tx-vmx*tz;
+      v0z=vmz+vmx*ty-vmy*tx;
+      vpx=vmx+v0y*sz-v0z*sy;
+      vpy=vmy+v0z*sx-v0x*sz;
+      vpz=vmz+v0x*sy-v0y*sx;
+      const Real ux = vpx+dvx;
+      const Real uy = vpy+dvy;
+      const Real uz = vpz+dvz;
+      const Real v2 = sqr(ux) + sqr(uy) + sqr(uz);
+      // masked blend: multiplying by 1 leaves unlimited velocities bit-identical
+      const bool limit = (v2 > maxVi2);
+      const Real norm = limit ? sqrt(maxVi2/v2) : 1.0;
+      vx[p] = ux*norm;
+      vy[p] = uy*norm;
+      vz[p] = uz*norm;
+      N_maxVi += limit ? 1 : 0;
+   }
+   return N_maxVi;
+}
+
 template<class PARTICLE>
 ParticlePropagatorBase* BBMaker() {return new BorisBuneman<PARTICLE>();}
 
 template<class PARTICLE>
-BorisBuneman<PARTICLE>::BorisBuneman() { }
+BorisBuneman<PARTICLE>::BorisBuneman() {
+   species = NULL;
+   pushCounter = 0;
+   pushTime = 0.0;
+   pushTimestep = 0;
+}
 
 template<class PARTICLE>
 bool BorisBuneman<PARTICLE>::addConfigFileItems(ConfigReader& cr,const std::string& configName) {
@@ -63,101 +176,62 @@ bool BorisBuneman<PARTICLE>::addConfigFileItems(ConfigReader& cr,const std::stri
 }
 
 template<class PARTICLE>
-bool BorisBuneman<PARTICLE>::finalize() {return true;}
+bool BorisBuneman<PARTICLE>::finalize() {
+   // particle push performance of this process
+   if(species != NULL && pushTime > 0.0) {
+      simClasses->logger
+	<< "(" << species->name << ") BorisBuneman: " << pushCounter << " particle pushes in " << pushTime << " s = "
+	<< pushCounter/pushTime << " pushes/s" << std::endl << write;
+   }
+   return true;
+}
 
 template<class PARTICLE>
-  void BorisBuneman<PARTICLE>::propagate(const Real xBlock,const Real yBlock,const Real zBlock,pargrid::CellID blockID,const Species& species,PARTICLE& particle,pargrid::CellID globalID) {
-   bool accelerate = species.accelerate;
-   if(simClasses->pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
-      accelerate = false;
-   }
-#ifdef USE_XMIN_BOUNDARY
-     // no particle velocity propagation at x < xmin
-     bool* xMinFlag = reinterpret_cast<bool*>(simClasses->pargrid.getUserData(Hybrid::dataXminFlagID));
-     if(xMinFlag[blockID] == true) { accelerate = false; }
-#endif
-   /*if(accelerate == true) {
-      Real dU[3] = { particle.state[particle::VX]-Ue[0], particle.state[particle::VY]-Ue[1], particle.state[particle::VZ]-Ue[2] };
-      const Real half_alpha = 0.5*species.q*sim->dt/species.m;
-      Real b[3] = {half_alpha*B[0], half_alpha*B[1], half_alpha*B[2]};
-      const Real b2 = sqr(b[0]) + sqr(b[1]) + sqr(b[2]);
-      const Real beta = 2.0/(1.0 + b2);
-      Real dUxb[3],dUxbxb[3];
-      cross(dU,b,dUxb);
-      cross(dUxb,b,dUxbxb);
-      particle.state[particle::VX] += beta*( dUxb[0] + dUxbxb[0] );
-      particle.state[particle::VY] += beta*( dUxb[1] + dUxbxb[1] );
-      particle.state[particle::VZ] += beta*( dUxb[2] + dUxbxb[2] );
-      
-      const Real v2 = sqr(particle.state[particle::VX]) + sqr(particle.state[particle::VY]) + sqr(particle.state[particle::VZ]);
-      if(v2 > Hybrid::maxVi2) {
-	 const Real norm = sqrt(Hybrid::maxVi2/v2);
-	 particle.state[particle::VX] *= norm;
-	 particle.state[particle::VY] *= norm;
-	 particle.state[particle::VZ] *= norm;
-	 Real* counterCellMaxVi = reinterpret_cast<Real*>(simClasses->pargrid.getUserData(Hybrid::dataCounterCellMaxViID));
-	 counterCellMaxVi[blockID]++;
-      }
-   }*/
-   
+  void BorisBuneman<PARTICLE>::propagate(const Real xBlock,const Real yBlock,const Real zBlock,pargrid::CellID blockID,const Species& species,PARTICLE& particle,
+					 const bool accelerate,const Real* faceBArray,const Real* cellUeArray,Real* counterCellMaxVi) {
    // accelerate particle
    if(accelerate == true) {
       Real E[3],B[3],Ue[3];
       Real r[3] = {particle.state[particle::X],particle.state[particle::Y],particle.state[particle::Z]};
-      getFields(r,B,Ue,*sim,*simClasses,blockID);
-#ifdef USE_B_CONSTANT
+      getFieldsLocal(r,faceBArray,cellUeArray,B,Ue);
+#if defined(USE_B_CONSTANT) && !defined(USE_B0_INTERPOLATION)
       addConstantB(r[0]+xBlock,r[1]+yBlock,r[2]+zBlock,B);
 #endif
       crossProduct(B,Ue,E);
-      Real tx,ty,tz,sx,sy,sz,dvx,dvy,dvz,vmx,vmy,vmz,v0x,v0y,v0z,vpx,vpy,vpz,qmideltT2,t2,b2;
-      qmideltT2= 0.5*species.q*sim->dt/species.m;
-      dvx=qmideltT2*E[0];
-      dvy=qmideltT2*E[1];
-      dvz=qmideltT2*E[2];
-      tx=qmideltT2*B[0];
-      ty=qmideltT2*B[1];
-      tz=qmideltT2*B[2];
-      t2=tx*tx+ty*ty+tz*tz;
-      b2=2./(1.+t2);
-      sx=b2*tx;
-      sy=b2*ty;
-      sz=b2*tz;
-      vmx=particle.state[particle::VX]+dvx;
-      vmy=particle.state[particle::VY]+dvy;
-      vmz=particle.state[particle::VZ]+dvz;
-      v0x=vmx+vmy*tz-vmz*ty;
-      v0y=vmy+vmz*tx-vmx*tz;
-      v0z=vmz+vmx*ty-vmy*tx;
-      vpx=vmx+v0y*sz-v0z*sy;
-      vpy=vmy+v0z*sx-v0x*sz;
-      vpz=vmz+v0x*sy-v0y*sx;
-      particle.state[particle::VX]=vpx+dvx;
-      particle.state[particle::VY]=vpy+dvy;
-      particle.state[particle::VZ]=vpz+dvz;
-      const Real v2 = sqr(particle.state[particle::VX]) + sqr(particle.state[particle::VY]) + sqr(particle.state[particle::VZ]);
-      if(v2 > Hybrid::maxVi2) {
-	 const Real norm = sqrt(Hybrid::maxVi2/v2);
-	 particle.state[particle::VX] *= norm;
-	 particle.state[particle::VY] *= norm;
-	 particle.state[particle::VZ] *= norm;
-	 Real* counterCellMaxVi = reinterpret_cast<Real*>(simClasses->pargrid.getUserData(Hybrid::dataCounterCellMaxViID));
+      const Real qmideltT2 = 0.5*species.q*sim->dt/species.m;
+      // velocity is updated in Real precision also if particles are stored in single precision
+      Real vx = particle.state[particle::VX];
+      Real vy = particle.state[particle::VY];
+      Real vz = particle.state[particle::VZ];
+      if(borisBunemanVelocity(qmideltT2,E,B,vx,vy,vz) == true) {
 	 counterCellMaxVi[blockID]++;
       }
+      particle.state[particle::VX] = vx;
+      particle.state[particle::VY] = vy;
+      particle.state[particle::VZ] = vz;
    }
+   
+   // move particle
+   particle.state[particle::X] += sim->dt*particle.state[particle::VX]; 
+   particle.state[particle::Y] += sim->dt*particle.state[particle::VY];
+   particle.state[particle::Z] += sim->dt*particle.state[particle::VZ];
+}
 
 #ifdef ION_SPECTRA_ALONG_ORBIT
+template<class PARTICLE>
+void BorisBuneman<PARTICLE>::recordSpectraParticle(pargrid::CellID blockID,const Species& species,const PARTICLE& particle,pargrid::CellID globalID) {
    bool* spectraFlag = reinterpret_cast<bool*>(simClasses->pargrid.getUserData(Hybrid::dataSpectraFlagID));
      if(spectraFlag[blockID] == true && Hybrid::recordSpectra == true) {
       //if(particle.state[particle::INI_TIME] >= 0.0) {
          Hybrid::spectraParticleOutput.push_back( static_cast<Real>(sim->t) );                               // 1
          Hybrid::spectraParticleOutput.push_back( static_cast<Real>(species.popid) );                        // 2
-         Hybrid::spectraParticleOutput.push_back( particle.state[particle::WEIGHT] );                        // 3
+         Hybrid::spectraParticleOutput.push_back( getParticleWeight(species,particle) );                      // 3
          Hybrid::spectraParticleOutput.push_back( static_cast<Real>(globalID) );                             // 4
          Hybrid::spectraParticleOutput.push_back( particle.state[particle::VX] );                            // 5
          Hybrid::spectraParticleOutput.push_back( particle.state[particle::VY] );                            // 6
          Hybrid::spectraParticleOutput.push_back( particle.state[particle::VZ] );                            // 7
          Hybrid::spectraParticleOutput.push_back( particle.state[particle::INI_TIME] );                      // 8
-         Hybrid::spectraParticleOutput.push_back( static_cast<Real>(particle.state[particle::INI_CELLID]) ); // 9
+         Hybrid::spectraParticleOutput.push_back( static_cast<Real>(particle.iniCellID) );                   // 9
          Hybrid::spectraParticleOutput.push_back( particle.state[particle::INI_X] );                         // 10
          Hybrid::spectraParticleOutput.push_back( particle.state[particle::INI_Y] );                         // 11
          Hybrid::spectraParticleOutput.push_back( particle.state[particle::INI_Z] );                         // 12
@@ -167,25 +241,186 @@ template<class PARTICLE>
 	 //particle.state[particle::INI_TIME] = -100.0; // only detect each particle once
       //}
    }
+}
 #endif
-   
-   // move particle
-   particle.state[particle::X] += sim->dt*particle.state[particle::VX]; 
-   particle.state[particle::Y] += sim->dt*particle.state[particle::VY];
-   particle.state[particle::Z] += sim->dt*particle.state[particle::VZ];
+
+// propagate particles of a block in batches: fields are gathered per particle into
+// batch arrays and the velocity update is done by the SIMD kernel for the whole batch
+template<class PARTICLE>
+void BorisBuneman<PARTICLE>::propagateBatched(const Real xBlock,const Real yBlock,const Real zBlock,pargrid::CellID blockID,const Species& species,PARTICLE* particles,size_t N_particles,
+					      const bool accelerate,const Real* faceBArray,const Real* cellUeArray,Real* counterCellMaxVi) {
+   const Real dt = sim->dt;
+   const Real qmideltT2 = 0.5*species.q*dt/species.m;
+   const long N_batches = (N_particles + BORIS_BUNEMAN_BATCH_SIZE - 1)/BORIS_BUNEMAN_BATCH_SIZE;
+   unsigned int N_maxVi = 0;
+   for(long batch=0;batch<N_batches;++batch) {
+      const size_t p0 = batch*BORIS_BUNEMAN_BATCH_SIZE;
+      const size_t n = std::min(static_cast<size_t>(BORIS_BUNEMAN_BATCH_SIZE),N_particles-p0);
+      Real Ex[BORIS_BUNEMAN_BATCH_SIZE],Ey[BORIS_BUNEMAN_BATCH_SIZE],Ez[BORIS_BUNEMAN_BATCH_SIZE];
+      Real Bx[BORIS_BUNEMAN_BATCH_SIZE],By[BORIS_BUNEMAN_BATCH_SIZE],Bz[BORIS_BUNEMAN_BATCH_SIZE];
+      Real vx[BORIS_BUNEMAN_BATCH_SIZE],vy[BORIS_BUNEMAN_BATCH_SIZE],vz[BORIS_BUNEMAN_BATCH_SIZE];
+      if(accelerate == true) {
+	 // gather fields at particle positions
+	 for(size_t i=0;i<n;++i) {
+	    Real E[3],B[3],Ue[3];
+	    const PARTICLE& particle = particles[p0+i];
+	    const Real r[3] = {particle.state[particle::X],particle.state[particle::Y],particle.state[particle::Z]};
+	    vx[i] = particle.state[particle::VX];
+	    vy[i] = particle.state[particle::VY];
+	    vz[i] = particle.state[particle::VZ];
+	    getFieldsLocal(r,faceBArray,cellUeArray,B,Ue);
+#if defined(USE_B_CONSTANT) && !defined(USE_B0_INTERPOLATION)
+	    addConstantB(r[0]+xBlock,r[1]+yBlock,r[2]+zBlock,B);
+#endif
+	    crossProduct(B,Ue,E);
+	    Ex[i] = E[0]; Ey[i] = E[1]; Ez[i] = E[2];
+	    Bx[i] = B[0]; By[i] = B[1]; Bz[i] = B[2];
+	 }
+	 N_maxVi += borisBunemanVelocityBatch(n,qmideltT2,Ex,Ey,Ez,Bx,By,Bz,vx,vy,vz);
+      }
+      // scatter velocities back and move particles
+      for(size_t i=0;i<n;++i) {
+	 PARTICLE& particle = particles[p0+i];
+	 if(accelerate == true) {
+	    particle.state[particle::VX] = vx[i];
+	    particle.state[particle::VY] = vy[i];
+	    particle.state[particle::VZ] = vz[i];
+	 }
+	 particle.state[particle::X] += dt*particle.state[particle::VX];
+	 particle.state[particle::Y] += dt*particle.state[particle::VY];
+	 particle.state[particle::Z] += dt*particle.state[particle::VZ];
+      }
+   }
+   counterCellMaxVi[blockID] += N_maxVi;
 }
 
+// push particles of one block, called by one thread per block
 template<class PARTICLE>
-bool BorisBuneman<PARTICLE>::propagateCell(pargrid::CellID blockID,pargrid::DataID particleDataID,const double* const coordinates,
-					   unsigned int N_particles) {
-   pargrid::DataWrapper<PARTICLE> wrapper = simClasses->pargrid.getUserDataDynamic<PARTICLE>(particleDataID);
+void BorisBuneman<PARTICLE>::propagateBlock(pargrid::CellID blockID,PARTICLE* particles,unsigned int N_particles) {
    const Real* crd = getBlockCoordinateArray(*sim,*simClasses);
    const size_t b3 = 3*blockID;
    const Real xBlock = crd[b3+0];
    const Real yBlock = crd[b3+1];
    const Real zBlock = crd[b3+2];
-   const pargrid::CellID globalID = simClasses->pargrid.getGlobalIDs()[blockID];
-   for(size_t p=0;p<N_particles;++p) { propagate(xBlock,yBlock,zBlock,blockID,*species,wrapper.data()[blockID][p],globalID); }
+   bool accelerate = species->accelerate;
+   if(simClasses->pargrid.getNeighbourFlags(blockID) != pargrid::ALL_NEIGHBOURS_EXIST) {
+      accelerate = false;
+   }
+#ifdef USE_XMIN_BOUNDARY
+   // no particle velocity propagation at x < xmin
+   bool* xMinFlag = reinterpret_cast<bool*>(simClasses->pargrid.getUserData(Hybrid::dataXminFlagID));
+   if(xMinFlag[blockID] == true) { accelerate = false; }
+#endif
+   // faceB and cellUe of this block and its neighbours, fetched once for all particles in the block
+   const unsigned int size = (block::WIDTH_X+2)*(block::WIDTH_Y+2)*(block::WIDTH_Z+2);
+#ifdef USE_FIELD_CACHE
+   const Real* fieldCache = reinterpret_cast<Real*>(simClasses->pargrid.getUserData(Hybrid::dataFieldCacheID));
+   const Real* faceBArray = fieldCache + blockID*FIELD_CACHE_SIZE;
+   const Real* cellUeArray = faceBArray + size*3;
+#else
+   Real faceBArray[size*3];
+   Real cellUeArray[size*3];
+   if(accelerate == true) {
+      Real* faceB  = reinterpret_cast<Real*>(simClasses->pargrid.getUserData(Hybrid::dataFaceBID));
+      Real* cellUe = reinterpret_cast<Real*>(simClasses->pargrid.getUserData(Hybrid::dataCellUeID));
+      fetchData(faceB,faceBArray,*simClasses,blockID,3);
+      fetchData(cellUe,cellUeArray,*simClasses,blockID,3);
+#ifdef USE_B0_INTERPOLATION
+      addFaceB0(faceBArray,*simClasses,blockID);
+#endif
+   }
+#endif
+   // maxVi clamps are counted per block, each block is pushed by one thread
+   Real* counterCellMaxVi = reinterpret_cast<Real*>(simClasses->pargrid.getUserData(Hybrid::dataCounterCellMaxViID));
+   if(Hybrid::batchedParticlePush == true) {
+      propagateBatched(xBlock,yBlock,zBlock,blockID,*species,particles,N_particles,accelerate,faceBArray,cellUeArray,counterCellMaxVi);
+   }
+   else {
+      // scalar reference push
+      for(size_t p=0;p<N_particles;++p) {
+	 propagate(xBlock,yBlock,zBlock,blockID,*species,particles[p],accelerate,faceBArray,cellUeArray,counterCellMaxVi);
+      }
+   }
+#ifdef USE_FUSED_PUSH_ACCUMULATION
+   // accumulate particles that stayed in this block while they are still in cache
+   accumulateFusedBlock(*simClasses,*species,blockID,N_particles,particles);
+#endif
+}
+
+// push the given blocks on OpenMP threads
+template<class PARTICLE>
+void BorisBuneman<PARTICLE>::pushBlocks(pargrid::DataID particleDataID,const std::vector<pargrid::CellID>& blocks) {
+   startParticleProfile();
+   const Real t_propag = MPI_Wtime();
+   pargrid::DataWrapper<PARTICLE> wrapper = simClasses->pargrid.getUserDataDynamic<PARTICLE>(particleDataID);
+   const unsigned int* N_particles = wrapper.size();
+#ifdef USE_FUSED_PUSH_ACCUMULATION
+   // fused accumulation adds to cells of neighbouring blocks, so blocks are pushed by colours
+   // in a fixed order like in the accumulator
+   std::vector<pargrid::CellID> colouredBlocks[8];
+   const bool parallel = colourBlocks(*sim,*simClasses,blocks,colouredBlocks);
+   const std::vector<pargrid::CellID>* blockSets = colouredBlocks;
+   const int N_sets = 8;
+#else
+   const bool parallel = true;
+   const std::vector<pargrid::CellID>* blockSets = &blocks;
+   const int N_sets = 1;
+#endif
+   for(int s=0;s<N_sets;++s) {
+      if(blockSets[s].size() == 0) { continue; }
+      scheduler.schedule(blockSets[s],N_particles);
+      #ifdef _OPENMP
+         #pragma omp parallel if(parallel)
+      #endif
+      {
+	 const int thread = getThreadNumber();
+	 scheduler.startThread(thread);
+	 size_t b;
+	 while(scheduler.next(thread,b) == true) {
+	    const pargrid::CellID blockID = blockSets[s][b];
+	    propagateBlock(blockID,wrapper.data()[blockID],N_particles[blockID]);
+	 }
+	 scheduler.stopThread(thread);
+      }
+   }
+   for(size_t b=0;b<blocks.size();++b) {
+      const pargrid::CellID blockID = blocks[b];
+      pushed[blockID] = 1;
+      pushCounter += N_particles[blockID];
+#ifdef ION_SPECTRA_ALONG_ORBIT
+      // recorded serially after the push: velocities are the updated ones, positions are not recorded
+      const pargrid::CellID globalID = simClasses->pargrid.getGlobalIDs()[blockID];
+      for(unsigned int p=0;p<N_particles[blockID];++p) { recordSpectraParticle(blockID,*species,wrapper.data()[blockID][p],globalID); }
+#endif
+   }
+   pushTime += MPI_Wtime() - t_propag;
+   addParticleTime(MPI_Wtime() - t_propag);
+   stopParticleProfile();
+}
+
+/** Corsair's particle list calls propagateCell for one block at a time. On the first call for
+ * a block that has not been pushed on this timestep, all boundary or all inner blocks (the set
+ * that contains the block) are pushed on threads, and the calls for the other blocks of the
+ * set return immediately. Particles are only migrated after the list has called propagateCell
+ * for all blocks of the set.*/
+template<class PARTICLE>
+bool BorisBuneman<PARTICLE>::propagateCell(pargrid::CellID blockID,pargrid::DataID particleDataID,const double* const coordinates,
+					   unsigned int N_particles) {
+   const pargrid::CellID N_blocks = simClasses->pargrid.getNumberOfLocalCells();
+   if(pushTimestep != sim->timestep || pushed.size() != N_blocks) {
+      pushed.assign(N_blocks,0);
+      pushTimestep = sim->timestep;
+   }
+   if(pushed[blockID] != 0) { return true; }
+   const std::vector<pargrid::CellID>& boundaryBlocks = simClasses->pargrid.getBoundaryCells(pargrid::DEFAULT_STENCIL);
+   if(std::find(boundaryBlocks.begin(),boundaryBlocks.end(),blockID) != boundaryBlocks.end()) {
+      pushBlocks(particleDataID,boundaryBlocks);
+   }
+   else {
+      pushBlocks(particleDataID,simClasses->pargrid.getInnerCells(pargrid::DEFAULT_STENCIL));
+   }
+   // a block that is in neither set is pushed alone
+   if(pushed[blockID] == 0) { pushBlocks(particleDataID,std::vector<pargrid::CellID>(1,blockID)); }
    return true;
 }
 
@@ -195,6 +430,7 @@ bool BorisBuneman<PARTICLE>::initialize(Simulation& sim,SimulationClasses& simCl
    bool success = true;
    if (ParticlePropagatorBase::initialize(sim,simClasses,cr,regionName,plist) == false) success = false;
    species = reinterpret_cast<const Species*>(plist->getSpecies());
+   scheduler.setName(species->name+" push");
    return success;
 }
 
@@ -0,0 +1,178 @@
+/** This file is part of the RHybrid simulation.
+ *
+ *  Copyright 2015- Finnish Meteorological Institute
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+#include "hybrid.h"
+#include "block_scheduler.h"
+#include "particle_definition.h"
+#include "particle_sort.h"
+
+using namespace std;
+
+/** Per-thread buffers of the counting sort.*/
+struct SortScratch {
+   vector<unsigned int> cell;                    /**< Cell index of each particle.*/
+   vector<unsigned int> offsets;                 /**< Start of each cell in the sorted array.*/
+   vector<Particle<ParticleReal> > sorted;       /**< Sorted particles.*/
+};
+
+static vector<SortScratch> scratch;
+
+// Particle push and accumulation times on the timestep right after sorting and on the
+// timestep right before the next sort, when particles are least ordered. Only the time
+// spent in the propagator and the accumulator is counted, MPI waits in between are not.
+enum SORT_TIMING {SORTED,UNSORTED,N_TIMINGS};
+static int timing = N_TIMINGS;                  /**< Timing of the current timestep, N_TIMINGS if not timed.*/
+static double particleTime[N_TIMINGS] = {0.0,0.0};
+static double particleCount[N_TIMINGS] = {0.0,0.0};
+static double sortTime = 0.0;
+
+/** Counting sort of the particles of a block by local cell index.*/
+static void sortBlock(SortScratch& buffers,Particle<ParticleReal>* particles,unsigned int N_particles) {
+   if(N_particles < 2) { return; }
+   if(buffers.cell.size() < N_particles) {
+      buffers.cell.resize(N_particles);
+      buffers.sorted.resize(N_particles);
+   }
+   buffers.offsets.assign(block::SIZE+1,0);
+   unsigned int* const cell = buffers.cell.data();
+   unsigned int* const offsets = buffers.offsets.data();
+   for(unsigned int p=0;p<N_particles;++p) {
+      int i = static_cast<int>(floor(particles[p].state[particle::X]/Hybrid::dx));
+      int j = static_cast<int>(floor(particles[p].state[particle::Y]/Hybrid::dx));
+      int k = static_cast<int>(floor(particles[p].state[particle::Z]/Hybrid::dx));
+      i = min(max(i,0),block::WIDTH_X-1);
+      j = min(max(j,0),block::WIDTH_Y-1);
+      k = min(max(k,0),block::WIDTH_Z-1);
+      cell[p] = block::index(i,j,k);
+      ++offsets[cell[p]+1];
+   }
+   for(int c=0;c<block::SIZE;++c) { offsets[c+1] += offsets[c]; }
+   // stable scatter, so particles of a cell keep their relative order
+   for(unsigned int p=0;p<N_particles;++p) {
+      buffers.sorted[offsets[cell[p]]++] = particles[p];
+   }
+   copy(buffers.sorted.begin(),buffers.sorted.begin()+N_particles,particles);
+}
+
+/** Write sorting cost and the push and accumulation time per particle on sorted and
+ * unsorted timesteps to the log file.
+ * @param sim Generic simulation variables.
+ * @param simClasses Generic simulation classes.
+ * @return If true, statistics were written successfully.*/
+bool finalizeParticleSort(Simulation& sim,SimulationClasses& simClasses) {
+   scratch.clear();
+   if(Hybrid::particleSortInterval <= 0) { return true; }
+   double sumsLocal[2*N_TIMINGS+1] = {particleTime[SORTED],particleTime[UNSORTED],particleCount[SORTED],particleCount[UNSORTED],sortTime};
+   double sumsGlobal[2*N_TIMINGS+1];
+   MPI_Reduce(sumsLocal,sumsGlobal,2*N_TIMINGS+1,MPI_Type<double>(),MPI_SUM,sim.MASTER_RANK,sim.comm);
+   if(sim.mpiRank != sim.MASTER_RANK) { return true; }
+   simClasses.logger << "(RHYBRID) Particle sorting: total sort time " << sumsGlobal[2*N_TIMINGS]/sim.mpiProcesses << " s/process" << endl;
+   if(sumsGlobal[N_TIMINGS+SORTED] > 0.0 && sumsGlobal[N_TIMINGS+UNSORTED] > 0.0) {
+      const double tSorted   = sumsGlobal[SORTED]/sumsGlobal[N_TIMINGS+SORTED];
+      const double tUnsorted = sumsGlobal[UNSORTED]/sumsGlobal[N_TIMINGS+UNSORTED];
+      simClasses.logger
+	<< "(RHYBRID) Particle sorting: push and accumulation " << tSorted*1e9 << " ns/particle after sorting, "
+	<< tUnsorted*1e9 << " ns/particle before sorting, speedup " << tUnsorted/tSorted << endl;
+   }
+   simClasses.logger << write;
+   return true;
+}
+
+/** Sort particles of all local blocks by cell, if this is a sorting timestep.
+ * @param sim Generic simulation variables.
+ * @param simClasses Generic simulation classes.
+ * @param particleLists Particle lists of all species.
+ * @return If true, particles were sorted successfully.*/
+bool sortParticles(Simulation& sim,SimulationClasses& simClasses,const std::vector<ParticleListBase*>& particleLists) {
+   if(Hybrid::particleSortInterval <= 0) { return true; }
+   if(sim.timestep % Hybrid::particleSortInterval != 0) { return true; }
+   static int profSortParticlesID = -1;
+   profile::start("sort particles",profSortParticlesID);
+   const double t_start = MPI_Wtime();
+   scratch.resize(getMaxThreads());
+   const long N_blocks = simClasses.pargrid.getNumberOfLocalCells();
+   for(size_t s=0;s<particleLists.size();++s) {
+      pargrid::DataID speciesDataID = pargrid::INVALID_DATAID;
+      if(particleLists[s]->getParticles(speciesDataID) == false) { continue; }
+      pargrid::DataWrapper<Particle<ParticleReal> > wrapper = simClasses.pargrid.getUserDataDynamic<Particle<ParticleReal> >(speciesDataID);
+      Particle<ParticleReal>** particles = wrapper.data();
+      const pargrid::ArraySizetype* N_particles = wrapper.size();
+      #ifdef _OPENMP
+	 #pragma omp parallel for schedule(dynamic,16)
+      #endif
+      for(long b=0;b<N_blocks;++b) {
+	 sortBlock(scratch[getThreadNumber()],particles[b],N_particles[b]);
+      }
+   }
+   sortTime += MPI_Wtime() - t_start;
+   profile::stop();
+   return true;
+}
+
+/** Add wall time spent in pushing or accumulating particles. Called by the propagator and
+ * the accumulator outside of parallel regions, ignored on timesteps that are not timed.
+ * @param seconds Wall time in seconds.*/
+void addParticleTime(double seconds) {
+   if(timing == N_TIMINGS) { return; }
+   particleTime[timing] += seconds;
+}
+
+/** Start profile region "particles after sort" or "particles before sort" on timed timesteps,
+ * so that the push and accumulation times of both show up in the profile. Called by the
+ * propagator and the accumulator outside of parallel regions, paired with stopParticleProfile.*/
+void startParticleProfile() {
+   static int profSortedID = -1;
+   static int profUnsortedID = -1;
+   if(timing == SORTED) { profile::start("particles after sort",profSortedID); }
+   else if(timing == UNSORTED) { profile::start("particles before sort",profUnsortedID); }
+}
+
+/** Start timing particle push and accumulation, called before particles are propagated.
+ * Only the timestep following a sort and the timestep preceding the next sort are timed.
+ * @param sim Generic simulation variables.
+ * @param simClasses Generic simulation classes.
+ * @param particleLists Particle lists of all species.*/
+void startParticleTiming(Simulation& sim,SimulationClasses& simClasses,const std::vector<ParticleListBase*>& particleLists) {
+   timing = N_TIMINGS;
+   if(Hybrid::particleSortInterval <= 1) { return; }
+   if(sim.timestep % Hybrid::particleSortInterval == 0) { timing = SORTED; }
+   else if((sim.timestep+1) % Hybrid::particleSortInterval == 0) { timing = UNSORTED; }
+   else { return; }
+   // particles pushed on this timestep
+   for(size_t s=0;s<particleLists.size();++s) {
+      pargrid::DataID speciesDataID = pargrid::INVALID_DATAID;
+      if(particleLists[s]->getParticles(speciesDataID) == false) { continue; }
+      pargrid::DataWrapper<Particle<ParticleReal> > wrapper = simClasses.pargrid.getUserDataDynamic<Particle<ParticleReal> >(speciesDataID);
+      for(pargrid::CellID b=0;b<simClasses.pargrid.getNumberOfLocalCells();++b) { particleCount[timing] += wrapper.size()[b]; }
+   }
+}
+
+/** Stop the profile region started by startParticleProfile.*/
+void stopParticleProfile() {
+   if(timing != N_TIMINGS) { profile::stop(); }
+}
+
+/** Stop timing particle push and accumulation, called after particles are accumulated.*/
+void stopParticleTiming() {
+   timing = N_TIMINGS;
+}
@@ -0,0 +1,36 @@
+/** This file is part of the RHybrid simulation.
+ *
+ *  Copyright 2015- Finnish Meteorological Institute
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARTICLE_SORT_H
+#define PARTICLE_SORT_H
+
+#include <vector>
+
+#include <simulation.h>
+#include <simulationclasses.h>
+#include <particle_list_base.h>
+
+bool finalizeParticleSort(Simulation& sim,SimulationClasses& simClasses);
+bool sortParticles(Simulation& sim,SimulationClasses& simClasses,const std::vector<ParticleListBase*>& particleLists);
+void addParticleTime(double seconds);
+void startParticleProfile();
+void startParticleTiming(Simulation& sim,SimulationClasses& simClasses,const std::vector<ParticleListBase*>& particleLists);
+void stopParticleProfile();
+void stopParticleTiming();
+
+#endif
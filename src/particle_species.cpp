@@ -17,10 +17,13 @@
  */
 
 #include <climits>
+#include <cmath>
 #include "particle_species.h"
 
 using namespace std;
 
+vector<Real> Species::weights;
+
 bool Species::finalize() {
    return true;   
 }
@@ -40,6 +43,7 @@ bool Species::readParameters(Simulation& sim,SimulationClasses& simClasses,Confi
    static int popid_cnt = 1;
    this->popid = popid_cnt;
    popid_cnt++;
+   if(weights.size() < static_cast<size_t>(popid)) { weights.resize(popid,0.0); }
    
    // Read species' parameters from config file:
    string q_unit,m_unit;
@@ -107,3 +111,28 @@ bool Species::readParameters(Simulation& sim,SimulationClasses& simClasses,Confi
    
    return success;
 }
+
+/** Set the weight of all macroparticles of a species. With USE_SPECIES_WEIGHT particle
+ * records do not have a weight, so all injectors of a species must use the same weight.
+ * @param simClasses Generic simulation classes.
+ * @param popid Population ID of the species.
+ * @param w Macroparticle weight of an injector.
+ * @return If false, the species is unknown or already has a different weight.*/
+bool Species::setWeight(SimulationClasses& simClasses,int popid,Real w) {
+   if(w <= 0.0) { return true; }
+   if(popid < 1 || static_cast<size_t>(popid) > weights.size()) {
+      simClasses.logger << "(SPECIES) ERROR: unknown popid " << popid << " in setWeight!" << endl << write;
+      return false;
+   }
+   Real& weight = weights[popid-1];
+   if(weight <= 0.0) {
+      weight = w;
+      return true;
+   }
+   if(fabs(w-weight) > 1e-12*weight) {
+      simClasses.logger << "(SPECIES) ERROR: species with popid " << popid << " has macroparticle weight " << weight
+	<< " but an injector uses weight " << w << ", all injectors must use the same weight with USE_SPECIES_WEIGHT!" << endl << write;
+      return false;
+   }
+   return true;
+}
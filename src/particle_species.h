@@ -20,6 +20,7 @@
 #define PARTICLE_SPECIES_H
 
 #include <cstdlib>
+#include <vector>
 
 #include <definitions.h>
 #include <simulation.h>
@@ -43,6 +44,10 @@ struct Species {
    std::string getName() const;
    const std::string& getSpeciesType() const;
    bool readParameters(Simulation& sim,SimulationClasses& simClasses,ConfigReader& cr,const std::string& name);   
+   
+   static bool setWeight(SimulationClasses& simClasses,int popid,Real w);
+   static std::vector<Real> weights;  /**< Weight of all macroparticles of each species with USE_SPECIES_WEIGHT, index popid-1,
+				       * zero until set by an injector. Shared by all copies of a Species.*/
 };
    
 #endif
@@ -0,0 +1,210 @@
+/** This file is part of the RHybrid simulation.
+ *
+ *  Copyright 2015- Finnish Meteorological Institute
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RANDOM_STREAM_H
+#define RANDOM_STREAM_H
+
+#include <cstdlib>
+#include <cmath>
+#include <stdint.h>
+
+#include <definitions.h>
+
+/** Counter-based random number stream using the Philox4x32-10 generator of Salmon et al.,
+ * "Parallel random numbers: as easy as 1, 2, 3" (SC11). Each value depends only on the key
+ * and the counter, so a stream identified by (seed, stream, timestep, id) produces the same
+ * numbers regardless of which thread or process generates it. Streams are cheap to create,
+ * so a new one is typically set up per block per timestep on the stack of the calling thread.
+ *
+ * The bulk functions fill arrays using independent counters, the inner loops have no
+ * dependencies between iterations and can be vectorised by the compiler.*/
+class RandomStream {
+ public:
+   RandomStream();
+   RandomStream(uint32_t seed,uint32_t stream,uint32_t timestep,uint64_t id);
+
+   void setStream(uint32_t seed,uint32_t stream,uint32_t timestep,uint64_t id);
+
+   Real uniform();
+   Real gauss();
+   Real derivgauss(Real x0);
+   int probround(Real x);
+
+   void uniform(Real* values,size_t N);
+   void gauss(Real* values,size_t N);
+   void derivgauss(Real x0,Real* values,size_t N);
+
+ private:
+   uint32_t key[2];
+   uint32_t counter[4];               /**< counter[0] is the index of the next block of four 32 bit values.*/
+   Real saved;                        /**< Second uniform of the last generated block.*/
+   bool isSaved;
+
+   static void philox(const uint32_t* key,const uint32_t* counter,uint32_t* out);
+   static Real toUniform(uint32_t hi,uint32_t lo);
+};
+
+inline RandomStream::RandomStream() {
+   setStream(0,0,0,0);
+}
+
+inline RandomStream::RandomStream(uint32_t seed,uint32_t stream,uint32_t timestep,uint64_t id) {
+   setStream(seed,stream,timestep,id);
+}
+
+/** Set the stream identifier, the stream starts from its first value.
+ * @param seed Global seed of the simulation.
+ * @param stream Identifier of the user of the stream, e.g. injector.
+ * @param timestep Timestep.
+ * @param id Identifier within the timestep, e.g. global ID of a block.*/
+inline void RandomStream::setStream(uint32_t seed,uint32_t stream,uint32_t timestep,uint64_t id) {
+   key[0] = seed;
+   key[1] = stream;
+   counter[0] = 0;
+   counter[1] = timestep;
+   counter[2] = static_cast<uint32_t>(id);
+   counter[3] = static_cast<uint32_t>(id >> 32);
+   isSaved = false;
+}
+
+inline void RandomStream::philox(const uint32_t* key,const uint32_t* counter,uint32_t* out) {
+   const uint32_t M0 = 0xD2511F53;
+   const uint32_t M1 = 0xCD9E8D57;
+   const uint32_t W0 = 0x9E3779B9;
+   const uint32_t W1 = 0xBB67AE85;
+   uint32_t c0 = counter[0];
+   uint32_t c1 = counter[1];
+   uint32_t c2 = counter[2];
+   uint32_t c3 = counter[3];
+   uint32_t k0 = key[0];
+   uint32_t k1 = key[1];
+   for(int round=0;round<10;++round) {
+      const uint64_t p0 = static_cast<uint64_t>(M0)*c0;
+      const uint64_t p1 = static_cast<uint64_t>(M1)*c2;
+      const uint32_t hi0 = static_cast<uint32_t>(p0 >> 32);
+      const uint32_t lo0 = static_cast<uint32_t>(p0);
+      const uint32_t hi1 = static_cast<uint32_t>(p1 >> 32);
+      const uint32_t lo1 = static_cast<uint32_t>(p1);
+      c0 = hi1 ^ c1 ^ k0;
+      c1 = lo1;
+      c2 = hi0 ^ c3 ^ k1;
+      c3 = lo0;
+      k0 += W0;
+      k1 += W1;
+   }
+   out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// 53 bit uniform in [0,1) from two 32 bit values
+inline Real RandomStream::toUniform(uint32_t hi,uint32_t lo) {
+   return ((hi >> 5)*67108864.0 + (lo >> 6))*(1.0/9007199254740992.0);
+}
+
+/** Uniform random number in [0,1).*/
+inline Real RandomStream::uniform() {
+   if(isSaved == true) {
+      isSaved = false;
+      return saved;
+   }
+   uint32_t out[4];
+   philox(key,counter,out);
+   ++counter[0];
+   saved = toUniform(out[2],out[3]);
+   isSaved = true;
+   return toUniform(out[0],out[1]);
+}
+
+/** Normally distributed random number with zero mean and unit variance.*/
+inline Real RandomStream::gauss() {
+   const Real u1 = 1.0 - uniform();
+   const Real u2 = uniform();
+   return sqrt(-2.0*log(u1))*cos(2.0*M_PI*u2);
+}
+
+/** Random number from the flux weighted (derivative) gaussian distribution
+ * f(x) ~ x*exp(-(x-x0)^2/2), x > 0, sampled by rejection.
+ * @param x0 Bulk speed in units of the thermal speed.*/
+inline Real RandomStream::derivgauss(Real x0) {
+   const Real invsqrt2 = 1.0/sqrt(2.0);
+   const Real sqrt_halfpi = sqrt(0.5*M_PI);
+   const Real xm = 0.5*(x0 + sqrt(x0*x0 + 4.0));
+   const Real c = 1.0/(exp(-0.5*x0*x0) + x0*sqrt_halfpi*erfc(-x0*invsqrt2));
+   const Real d = (x0-xm)*(x0-xm);
+   const Real cxm = c*xm;
+   while(true) {
+      const Real x = xm + gauss();
+      if(x < 0) { continue; }
+      const Real majorant = cxm*exp(-0.5*((x-xm)*(x-xm) + d));
+      const Real pdf = c*x*exp(-0.5*(x-x0)*(x-x0));
+      if(uniform()*majorant <= pdf) { return x; }
+   }
+}
+
+/** Probabilistic rounding, x is rounded up with probability x-floor(x).*/
+inline int RandomStream::probround(Real x) {
+   if(x <= 0) { return 0; }
+   const int f = static_cast<int>(floor(x));
+   if(uniform() < x-f) { return f+1; }
+   else { return f; }
+}
+
+/** Fill an array with uniform random numbers in [0,1). The omp simd loops of this file are
+ * vectorised with -fopenmp or -fopenmp-simd (see Makefile) and run as plain loops otherwise,
+ * the numbers do not depend on it.*/
+inline void RandomStream::uniform(Real* values,size_t N) {
+   size_t n = 0;
+   if(N > 0 && isSaved == true) {
+      values[n++] = saved;
+      isSaved = false;
+   }
+   const size_t N_pairs = (N-n)/2;
+   const uint32_t base = counter[0];
+   #pragma omp simd
+   for(size_t i=0;i<N_pairs;++i) {
+      const uint32_t ctr[4] = {base+static_cast<uint32_t>(i),counter[1],counter[2],counter[3]};
+      uint32_t out[4];
+      philox(key,ctr,out);
+      values[n+2*i+0] = toUniform(out[0],out[1]);
+      values[n+2*i+1] = toUniform(out[2],out[3]);
+   }
+   counter[0] += N_pairs;
+   n += 2*N_pairs;
+   if(n < N) { values[n] = uniform(); }
+}
+
+/** Fill an array with normally distributed random numbers (Box-Muller transform).*/
+inline void RandomStream::gauss(Real* values,size_t N) {
+   uniform(values,N);
+   const size_t N_pairs = N/2;
+   #pragma omp simd
+   for(size_t i=0;i<N_pairs;++i) {
+      const Real r = sqrt(-2.0*log(1.0-values[2*i]));
+      const Real phi = 2.0*M_PI*values[2*i+1];
+      values[2*i+0] = r*cos(phi);
+      values[2*i+1] = r*sin(phi);
+   }
+   if(2*N_pairs < N) { values[N-1] = gauss(); }
+}
+
+/** Fill an array with random numbers from the flux weighted gaussian distribution.
+ * @param x0 Bulk speed in units of the thermal speed.*/
+inline void RandomStream::derivgauss(Real x0,Real* values,size_t N) {
+   for(size_t i=0;i<N;++i) { values[i] = derivgauss(x0); }
+}
+
+#endif
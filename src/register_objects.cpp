@@ -39,7 +39,7 @@
 
 using namespace std;
 
-typedef Particle<Real> PARTICLE;
+typedef Particle<ParticleReal> PARTICLE;
 typedef Species SPECIES;
 
 bool registerObjectMakers(ObjectFactories& objectFactories) {
@@ -21,6 +21,9 @@
 #include <iostream>
 #include <iterator>
 #include <istream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <user.h>
 #include <particle_list_skeleton.h>
 #include <gridbuilder.h>
@@ -34,10 +37,11 @@
 #include "particle_injector.h"
 #include "particle_list_hybrid.h"
 #include "operator_userdata.h"
+#include "particle_sort.h"
 #ifdef USE_RESISTIVITY
 #include "resistivity.h"
 #endif
-#ifdef USE_B_INITIAL
+#if defined(USE_B_INITIAL) || defined(USE_B_CONSTANT)
 #include "magnetic_field.h"
 #endif
 
@@ -45,6 +49,7 @@ using namespace std;
 
 bool propagate(Simulation& sim,SimulationClasses& simClasses,vector<ParticleListBase*>& particleLists) {
    bool rvalue = true;
+   checkPartitioning(simClasses);
    if(Hybrid::logInterval > 0) {
       if( (sim.timestep)%(Hybrid::logInterval) == 0.0) {
          if(writeLogs(sim,simClasses,particleLists) == false) { rvalue = false; }
@@ -57,15 +62,24 @@ bool propagate(Simulation& sim,SimulationClasses& simClasses,vector<ParticleList
    }
    else { Hybrid::recordSpectra = false; }
 #endif
+   if(sortParticles(sim,simClasses,particleLists) == false) { rvalue = false; }
    setupGetFields(sim,simClasses);
+   startParticleTiming(sim,simClasses,particleLists);
+#ifdef USE_FUSED_PUSH_ACCUMULATION
+   // particles staying in their block are accumulated during the push, so clear arrays first
+   for(size_t p=0;p<particleLists.size();++p) { if(particleLists[p]->clearAccumulationArrays() == false) { rvalue = false; } }
+#endif
    // Propagate all particles:
    for(size_t p=0;p<particleLists.size();++p) { if(particleLists[p]->propagateBoundaryCellParticles() == false) { rvalue = false; }  }
    for(size_t p=0;p<particleLists.size();++p) { if(particleLists[p]->propagateInnerCellParticles() == false) { rvalue = false; } }
+#ifndef USE_FUSED_PUSH_ACCUMULATION
    for(size_t p=0;p<particleLists.size();++p) { if(particleLists[p]->clearAccumulationArrays() == false) { rvalue = false; } }
+#endif
    for(size_t p=0;p<particleLists.size();++p) { if(particleLists[p]->waitParticleSends() == false) { rvalue = false; } }
    // Accumulate particle quantities to simulation mesh:
    for(size_t p=0;p<particleLists.size();++p) { if(particleLists[p]->accumulateBoundaryCells() == false) { rvalue = false; } }
    for(size_t p=0;p<particleLists.size();++p) { if(particleLists[p]->accumulateInnerCells() == false) { rvalue = false; } }
+   stopParticleTiming();
    // Apply boundary conditions:
    for(size_t p=0;p<particleLists.size();++p) { if(particleLists[p]->applyBoundaryConditions() == false) { rvalue = false; } }
    // Inject new particles:
@@ -206,6 +220,8 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
    string resistivityProfileName = "";
 #endif
    cr.add("Hybrid.log_interval","Log interval in units of timestep [-] (int)",0);
+   cr.add("Hybrid.random_seed","Seed of the random number streams of particle injectors [-] (int)",1);
+   cr.add("Hybrid.particle_sort_interval","Interval of sorting particles by cell in units of timestep, 0 = no sorting [-] (int)",0);
    cr.add("Hybrid.includeInnerCellsInFieldLog","Include cells inside the inner field boundary in the field log [-] (bool)",false);
    cr.add("Hybrid.output_parameters","Parameters to write in output files (string)","");
    cr.add("Hybrid.R_object","Radius of simulated object [m] (float)",defaultValue);
@@ -225,6 +241,8 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
    cr.add("Hybrid.maxVw","Maximum value of whistler wave speed [m/s] (float)",defaultValue);
 #endif
    cr.add("Hybrid.hall_term","Use Hall term in the electric field [-] (bool)",true);
+   cr.add("Hybrid.threads","Number of OpenMP threads per process, 0 = OpenMP default [-] (int)",0);
+   cr.add("Hybrid.batched_particle_push","Use the batched particle push instead of the scalar reference one [-] (bool)",false);
    cr.add("Hybrid.Efilter","E filtering number [-] (int)",static_cast<int>(0));
    cr.add("Hybrid.EfilterNodeGaussSigma","E filtering number [dx] (float)",defaultValue);
    cr.add("OuterBoundaryZone.type","Type of the outer boundary zone: 0 = not used, 1 = full walls, 2 = all edges except +x edges [-] (int)",0);
@@ -255,6 +273,10 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
 #endif
    cr.parse();
    cr.get("Hybrid.log_interval",Hybrid::logInterval);
+   cr.get("Hybrid.particle_sort_interval",Hybrid::particleSortInterval);
+   int randomSeed = 1;
+   cr.get("Hybrid.random_seed",randomSeed);
+   Hybrid::randomSeed = static_cast<uint32_t>(randomSeed);
    cr.get("Hybrid.includeInnerCellsInFieldLog",Hybrid::includeInnerCellsInFieldLog);
    cr.get("Hybrid.output_parameters",outputParams);
    cr.get("Hybrid.R_object",Hybrid::R_object);
@@ -275,6 +297,21 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
    cr.get("Hybrid.maxVw",Hybrid::maxVw);   
 #endif
    cr.get("Hybrid.hall_term",Hybrid::useHallElectricField);
+   cr.get("Hybrid.batched_particle_push",Hybrid::batchedParticlePush);
+   cr.get("Hybrid.threads",Hybrid::N_threads);
+#ifdef _OPENMP
+   if(Hybrid::N_threads > 0) { omp_set_num_threads(Hybrid::N_threads); }
+   Hybrid::N_threads = omp_get_max_threads();
+   // MPI is called from the master thread only, Corsair must initialize MPI with MPI_Init_thread
+   int mpiThreadLevel = MPI_THREAD_SINGLE;
+   MPI_Query_thread(&mpiThreadLevel);
+   if(mpiThreadLevel < MPI_THREAD_FUNNELED) {
+      simClasses.logger << "(RHYBRID) ERROR: OpenMP threads need MPI thread support level MPI_THREAD_FUNNELED or higher (level = " << mpiThreadLevel << ")" << endl << write;
+      return false;
+   }
+#else
+   Hybrid::N_threads = 1;
+#endif
    cr.get("Hybrid.Efilter",Hybrid::Efilter);
    cr.get("Hybrid.EfilterNodeGaussSigma",Hybrid::EfilterNodeGaussSigma);
    cr.get("OuterBoundaryZone.type",Hybrid::outerBoundaryZoneType);
@@ -315,12 +352,14 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
    Hybrid::laminarR2 =  sqr(Hybrid::laminarR2);
    Hybrid::dipMomCoeff = 3.0*Hybrid::dipSurfB*cube(Hybrid::dipSurfR);
    Hybrid::dipMinR2 = sqr(Hybrid::dipMinR2);
+   setDipoleRotation();
    if(setMagneticFieldProfile(magneticFieldProfileName) == false) {
       simClasses.logger << "(RHYBRID) ERROR: Given magnetic field profile not found (" << magneticFieldProfileName << ")" << endl << write;
       exit(1);
    }
 #endif
    if(Hybrid::logInterval <= 0) { Hybrid::logInterval = 0; }
+   if(Hybrid::particleSortInterval <= 0) { Hybrid::particleSortInterval = 0; }
    // set parameters written in vlsv files
    Hybrid::outputCellParams = {
       {"faceB",false},
@@ -451,7 +490,9 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
    else { simClasses.logger << Hybrid::R2_particleObstacle << "" << endl; }   
    simClasses.logger
      << "M_object  = " << Hybrid::M_object     << " kg" << endl
-     << "Hall term = " << Hybrid::useHallElectricField << endl << endl
+     << "Hall term = " << Hybrid::useHallElectricField << endl
+     << "Batched particle push = " << Hybrid::batchedParticlePush << endl
+     << "Threads per process = " << Hybrid::N_threads << endl << endl
      << "(UPSTREAM IMF)" << endl
      << "Bx  = " << Hybrid::IMFBx/1e-9 << " nT" << endl
      << "By  = " << Hybrid::IMFBy/1e-9 << " nT" << endl
@@ -526,7 +567,9 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
    simClasses.logger
      << "(LOGGING)" << endl
      << "Particle and field log file interval = " << Hybrid::logInterval*sim.dt << " s = " << Hybrid::logInterval << " dt" << endl
-     << "Include cells inside the inner field boundary in the field log = " << Hybrid::includeInnerCellsInFieldLog << endl << endl;
+     << "Include cells inside the inner field boundary in the field log = " << Hybrid::includeInnerCellsInFieldLog << endl
+     << "Particle sort interval = " << Hybrid::particleSortInterval << " dt" << endl
+     << "Random seed of injectors = " << Hybrid::randomSeed << endl << endl;
    
    // read particle populations: uniform
    vector<string> uniformPopulations;
@@ -610,6 +653,9 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
    Hybrid::dataCellJiID              = simClasses.pargrid.invalidDataID();
    Hybrid::dataCellIonosphereID      = simClasses.pargrid.invalidDataID();
    Hybrid::dataCellExosphereID       = simClasses.pargrid.invalidDataID();
+#ifdef USE_B_CONSTANT
+   Hybrid::dataCellB0ID              = simClasses.pargrid.invalidDataID();
+#endif
    Hybrid::dataNodeRhoQiID           = simClasses.pargrid.invalidDataID();
    Hybrid::dataNodeEID               = simClasses.pargrid.invalidDataID();
    Hybrid::dataNodeBID               = simClasses.pargrid.invalidDataID();
@@ -618,6 +664,9 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
    Hybrid::dataNodeJiID              = simClasses.pargrid.invalidDataID();
 #ifdef USE_RESISTIVITY
    Hybrid::dataNodeEtaID             = simClasses.pargrid.invalidDataID();
+#endif
+#ifdef USE_B_CONSTANT
+   Hybrid::dataNodeB0ID              = simClasses.pargrid.invalidDataID();
 #endif
    Hybrid::dataCounterCellMaxUeID    = simClasses.pargrid.invalidDataID();
    Hybrid::dataCounterCellMaxViID    = simClasses.pargrid.invalidDataID();
@@ -628,6 +677,12 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
 #ifdef USE_MAXVW
    Hybrid::dataCounterNodeMaxVwID    = simClasses.pargrid.invalidDataID();
 #endif   
+#ifdef USE_FIELD_CACHE
+   Hybrid::dataFieldCacheID          = simClasses.pargrid.invalidDataID();
+#endif
+#ifdef USE_B0_INTERPOLATION
+   Hybrid::dataFaceB0ID              = simClasses.pargrid.invalidDataID();
+#endif
    Hybrid::dataInnerFlagFieldID      = simClasses.pargrid.invalidDataID();
    Hybrid::dataInnerFlagNodeID       = simClasses.pargrid.invalidDataID();
    Hybrid::dataInnerFlagParticleID   = simClasses.pargrid.invalidDataID();
@@ -682,6 +737,13 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
       simClasses.logger << "(USER) ERROR: Failed to add cellExosphere array to ParGrid!" << endl << write;
       return false;
    }
+#ifdef USE_B_CONSTANT
+   Hybrid::dataCellB0ID = simClasses.pargrid.addUserData<Real>("cellB0",block::SIZE*3);
+   if(Hybrid::dataCellB0ID == simClasses.pargrid.invalidCellID()) {
+      simClasses.logger << "(USER) ERROR: Failed to add cellB0 array to ParGrid!" << endl << write;
+      return false;
+   }
+#endif
    Hybrid::dataNodeRhoQiID = simClasses.pargrid.addUserData<Real>("nodeRhoQi",block::SIZE*1);
    if(Hybrid::dataNodeRhoQiID == simClasses.pargrid.invalidCellID()) {
       simClasses.logger << "(USER) ERROR: Failed to add nodeRhoQi array to ParGrid!" << endl << write;
@@ -718,6 +780,13 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
       simClasses.logger << "(USER) ERROR: Failed to add nodeEta array to ParGrid!" << endl << write;
       return false;
    }
+#endif
+#ifdef USE_B_CONSTANT
+   Hybrid::dataNodeB0ID = simClasses.pargrid.addUserData<Real>("nodeB0",block::SIZE*3);
+   if(Hybrid::dataNodeB0ID == simClasses.pargrid.invalidCellID()) {
+      simClasses.logger << "(USER) ERROR: Failed to add nodeB0 array to ParGrid!" << endl << write;
+      return false;
+   }
 #endif
    // counters
    Hybrid::dataCounterCellMaxUeID = simClasses.pargrid.addUserData<Real>("counterCellMaxUe",block::SIZE*1);
@@ -749,6 +818,22 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
       return false;
    }
 #endif
+#ifdef USE_FIELD_CACHE
+   // field cache: faceB and cellUe of a block and its neighbours, not exchanged
+   Hybrid::dataFieldCacheID = simClasses.pargrid.addUserData<Real>("fieldCache",FIELD_CACHE_SIZE);
+   if(Hybrid::dataFieldCacheID == simClasses.pargrid.invalidCellID()) {
+      simClasses.logger << "(USER) ERROR: Failed to add fieldCache array to ParGrid!" << endl << write;
+      return false;
+   }
+#endif
+#ifdef USE_B0_INTERPOLATION
+   // constant magnetic field at faces of a block and its neighbours, not exchanged
+   Hybrid::dataFaceB0ID = simClasses.pargrid.addUserData<Real>("faceB0",FACE_B0_SIZE);
+   if(Hybrid::dataFaceB0ID == simClasses.pargrid.invalidCellID()) {
+      simClasses.logger << "(USER) ERROR: Failed to add faceB0 array to ParGrid!" << endl << write;
+      return false;
+   }
+#endif
    
    // create stencils
    Hybrid::accumulationStencilID = sim.inverseStencilID;
@@ -848,6 +933,22 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
    if(simClasses.pargrid.addDataTransfer(Hybrid::dataNodeJiID,pargrid::DEFAULT_STENCIL) == false) {
       simClasses.logger << "(USER) ERROR: Failed to add nodeJi data transfer!" << endl << write; return false;
    }
+#ifdef USE_B_CONSTANT
+   if(simClasses.pargrid.addDataTransfer(Hybrid::dataCellB0ID,pargrid::DEFAULT_STENCIL) == false) {
+      simClasses.logger << "(USER) ERROR: Failed to add cellB0 data transfer!" << endl << write; return false;
+   }
+   if(simClasses.pargrid.addDataTransfer(Hybrid::dataNodeB0ID,pargrid::DEFAULT_STENCIL) == false) {
+      simClasses.logger << "(USER) ERROR: Failed to add nodeB0 data transfer!" << endl << write; return false;
+   }
+#endif
+   if(checkFieldKernelLayout() == false) {
+      simClasses.logger << "(USER) ERROR: Block layout of field kernels does not match block::index!" << endl << write; return false;
+   }
+#if defined(USE_BATCHED_EXCHANGE) || defined(USE_SHARED_MEMORY_EXCHANGE)
+   if(initializeHaloExchanges(simClasses) == false) {
+      simClasses.logger << "(USER) ERROR: Failed to initialize halo exchanges!" << endl << write; return false;
+   }
+#endif
 
    Real* faceB               = reinterpret_cast<Real*>(simClasses.pargrid.getUserData(Hybrid::dataFaceBID));
    Real* faceJ               = reinterpret_cast<Real*>(simClasses.pargrid.getUserData(Hybrid::dataFaceJID));
@@ -1185,32 +1286,64 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
       }
 #endif
    }
+#ifdef USE_B_CONSTANT
+   // constant magnetic field at nodes and cell centres, computed also after a restart
+   {
+      Real* nodeB0 = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataNodeB0ID);
+      Real* cellB0 = simClasses.pargrid.getUserDataStatic<Real>(Hybrid::dataCellB0ID);
+      const Real* crd = getBlockCoordinateArray(sim,simClasses);
+      for(size_t i=0; i<vectorArraySize; ++i) { nodeB0[i] = 0.0; }
+      for(size_t i=0; i<vectorArraySize; ++i) { cellB0[i] = 0.0; }
+      for (pargrid::CellID b=0; b<simClasses.pargrid.getNumberOfLocalCells(); ++b) {
+         const size_t b3 = 3*b;
+         for(int k=0;k<block::WIDTH_Z;++k) for(int j=0;j<block::WIDTH_Y;++j) for(int i=0;i<block::WIDTH_X;++i) {
+            const int n3 = (b*block::SIZE+block::index(i,j,k))*3;
+            const Real xNode = crd[b3+0] + (i+1.0)*Hybrid::dx;
+            const Real yNode = crd[b3+1] + (j+1.0)*Hybrid::dx;
+            const Real zNode = crd[b3+2] + (k+1.0)*Hybrid::dx;
+            addConstantB(xNode,yNode,zNode,&nodeB0[n3]);
+            const Real xCellCenter = crd[b3+0] + (i+0.5)*Hybrid::dx;
+            const Real yCellCenter = crd[b3+1] + (j+0.5)*Hybrid::dx;
+            const Real zCellCenter = crd[b3+2] + (k+0.5)*Hybrid::dx;
+            addConstantB(xCellCenter,yCellCenter,zCellCenter,&cellB0[n3]);
+         }
+      }
+      // copies in remote blocks
+      simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeB0ID);
+      simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataNodeB0ID);
+      simClasses.pargrid.startNeighbourExchange(pargrid::DEFAULT_STENCIL,Hybrid::dataCellB0ID);
+      simClasses.pargrid.wait(pargrid::DEFAULT_STENCIL,Hybrid::dataCellB0ID);
+   }
+#endif
+#ifdef USE_B0_INTERPOLATION
+   if(initializeFaceB0(sim,simClasses) == false) { return false; }
+#endif
 
    // initialize particle lists: uniform
    for (vector<string>::iterator it=uniformPopulations.begin(); it!=uniformPopulations.end(); ++it) {
       simClasses.logger << "(RHYBRID) Initializing an uniform particle population: " << *it << endl << write;
-      particleLists.push_back(new ParticleListHybrid<Species,Particle<Real> >);
+      particleLists.push_back(new ParticleListHybrid<Species,Particle<ParticleReal> >);
       if (particleLists[particleLists.size()-1]->initialize(sim,simClasses,cr,objectFactories,*it) == false) { return false; }
       Hybrid::populationNames.push_back(*it);
    }
    // initialize particle lists: solar wind
    for (vector<string>::iterator it=solarwindPopulations.begin(); it!=solarwindPopulations.end(); ++it) {
       simClasses.logger << "(RHYBRID) Initializing a solar wind particle population: " << *it << endl << write;
-      particleLists.push_back(new ParticleListHybrid<Species,Particle<Real> >);
+      particleLists.push_back(new ParticleListHybrid<Species,Particle<ParticleReal> >);
       if (particleLists[particleLists.size()-1]->initialize(sim,simClasses,cr,objectFactories,*it) == false) { return false; }
       Hybrid::populationNames.push_back(*it);
    }
    // initialize particle lists: ionosphere
    for (vector<string>::iterator it=ionospherePopulations.begin(); it!=ionospherePopulations.end(); ++it) {
       simClasses.logger << "(RHYBRID) Initializing an ionospheric particle population: " << *it << endl << write;
-      particleLists.push_back(new ParticleListHybrid<Species,Particle<Real> >);
+      particleLists.push_back(new ParticleListHybrid<Species,Particle<ParticleReal> >);
       if (particleLists[particleLists.size()-1]->initialize(sim,simClasses,cr,objectFactories,*it) == false) { return false; }
       Hybrid::populationNames.push_back(*it);
    }   
    // initialize particle lists: exosphere
    for (vector<string>::iterator it=exospherePopulations.begin(); it!=exospherePopulations.end(); ++it) {
       simClasses.logger << "(RHYBRID) Initializing an exospheric particle population: " << *it << endl << write;
-      particleLists.push_back(new ParticleListHybrid<Species,Particle<Real> >);
+      particleLists.push_back(new ParticleListHybrid<Species,Particle<ParticleReal> >);
       if (particleLists[particleLists.size()-1]->initialize(sim,simClasses,cr,objectFactories,*it) == false) { return false; }
       Hybrid::populationNames.push_back(*it);
    }
@@ -1591,6 +1724,10 @@ bool userLateInitialization(Simulation& sim,SimulationClasses& simClasses,Config
  * @return If true, finalization completed successfully.*/
 bool userFinalization(Simulation& sim,SimulationClasses& simClasses,vector<ParticleListBase*>& particleLists) {
    bool success = true;
+#if defined(USE_BATCHED_EXCHANGE) || defined(USE_SHARED_MEMORY_EXCHANGE)
+   if(finalizeHaloExchanges(simClasses) == false) { success = false; }
+#endif
+   if(finalizeParticleSort(sim,simClasses) == false) { success = false; }
    if(simClasses.pargrid.removeUserData(Hybrid::dataFaceBID)               == false) { success = false; }
    if(simClasses.pargrid.removeUserData(Hybrid::dataFaceJID)               == false) { success = false; }
    if(simClasses.pargrid.removeUserData(Hybrid::dataCellRhoQiID)           == false) { success = false; }
@@ -1608,6 +1745,10 @@ bool userFinalization(Simulation& sim,SimulationClasses& simClasses,vector<Parti
    if(simClasses.pargrid.removeUserData(Hybrid::dataNodeJiID)              == false) { success = false; }
 #ifdef USE_RESISTIVITY
    if(simClasses.pargrid.removeUserData(Hybrid::dataNodeEtaID)             == false) { success = false; }
+#endif
+#ifdef USE_B_CONSTANT
+   if(simClasses.pargrid.removeUserData(Hybrid::dataNodeB0ID)              == false) { success = false; }
+   if(simClasses.pargrid.removeUserData(Hybrid::dataCellB0ID)              == false) { success = false; }
 #endif
    if(simClasses.pargrid.removeUserData(Hybrid::dataCounterCellMaxUeID)    == false) { success = false; }
    if(simClasses.pargrid.removeUserData(Hybrid::dataCounterCellMaxViID)    == false) { success = false; }
@@ -1617,6 +1758,12 @@ bool userFinalization(Simulation& sim,SimulationClasses& simClasses,vector<Parti
 #endif
 #ifdef USE_MAXVW
    if(simClasses.pargrid.removeUserData(Hybrid::dataCounterNodeMaxVwID)    == false) { success = false; }
+#endif
+#ifdef USE_FIELD_CACHE
+   if(simClasses.pargrid.removeUserData(Hybrid::dataFieldCacheID)          == false) { success = false; }
+#endif
+#ifdef USE_B0_INTERPOLATION
+   if(simClasses.pargrid.removeUserData(Hybrid::dataFaceB0ID)              == false) { success = false; }
 #endif
    if(simClasses.pargrid.removeUserData(Hybrid::dataInnerFlagFieldID)      == false) { success = false; }
    if(simClasses.pargrid.removeUserData(Hybrid::dataInnerFlagParticleID)   == false) { success = false; }